@@ -0,0 +1,432 @@
+#pragma once
+
+#include "LogTransport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <link.h>
+#include <pthread.h>
+#endif //__linux__
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif //_WIN32
+
+namespace zs
+{
+  namespace log
+  {
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(32)> maxBacktraceDepth;
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Raw return addresses of the calling thread, found by following the
+    // frame pointer chain; nothing is looked up while logging, the stacks are
+    // symbolized offline against the module map (see ModuleMap). Code built
+    // without frame pointers yields shorter stacks, never a bad read: the
+    // walk stays within the bounds of the thread's stack. Only Linux walks
+    // stacks for now, elsewhere nothing is captured.
+    class Backtrace final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      //-----------------------------------------------------------------------
+      // off by default; applies to entries of Severity::Error and above
+      static void enable(bool value) noexcept { enabled_().store(value, std::memory_order_relaxed); }
+      [[nodiscard]] static bool enabled() noexcept { return enabled_().load(std::memory_order_relaxed); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static size_type capture(std::uint64_t* frames, size_type max) noexcept
+      {
+        size_type depth{};
+#ifdef __linux__
+        const auto& bounds{ stackBounds() };
+        auto* frame{ static_cast<const std::uintptr_t*>(__builtin_frame_address(0)) };
+        while (depth < max) {
+          const std::uintptr_t address{ reinterpret_cast<std::uintptr_t>(frame) };
+          if ((address < bounds.low_) || (address + (2 * sizeof(std::uintptr_t)) > bounds.high_) || (0 != (address % alignof(std::uintptr_t))))
+            break;
+          if (0 == frame[1])
+            break;
+          frames[depth++] = static_cast<std::uint64_t>(frame[1]);
+
+          // the stack grows down, so callers always sit above
+          const auto* next{ reinterpret_cast<const std::uintptr_t*>(frame[0]) };
+          if (reinterpret_cast<std::uintptr_t>(next) <= address)
+            break;
+          frame = next;
+        }
+#endif //__linux__
+        return depth;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::atomic_bool& enabled_() noexcept
+      {
+        static std::atomic_bool gEnabled{};
+        return gEnabled;
+      }
+
+#ifdef __linux__
+      //-----------------------------------------------------------------------
+      struct Bounds
+      {
+        std::uintptr_t low_{};
+        std::uintptr_t high_{};
+      };
+
+      //-----------------------------------------------------------------------
+      // looked up once per thread, the main thread's lookup reads /proc
+      [[nodiscard]] static const Bounds& stackBounds() noexcept
+      {
+        thread_local const Bounds bounds{ []() noexcept {
+          Bounds result;
+          pthread_attr_t attr;
+          if (0 != ::pthread_getattr_np(::pthread_self(), &attr))
+            return result;
+          void* low{};
+          size_t size{};
+          if (0 == ::pthread_attr_getstack(&attr, &low, &size)) {
+            result.low_ = reinterpret_cast<std::uintptr_t>(low);
+            result.high_ = result.low_ + size;
+          }
+          ::pthread_attr_destroy(&attr);
+          return result;
+        }() };
+        return bounds;
+      }
+#endif //__linux__
+    };
+
+    //-------------------------------------------------------------------------
+    // One loaded module; an address within [low_, high_) belongs to it and
+    // is found at address - base_ within the file at path_.
+    struct Module
+    {
+      std::uint64_t base_{};
+      std::uint64_t low_{};
+      std::uint64_t high_{};
+      std::string path_;
+      std::string buildId_;         // hex GNU build id, empty if there is none
+
+      [[nodiscard]] bool operator==(const Module&) const noexcept = default;
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // The modules loaded into this process, written as a modules record at
+    // the start of every sink's stream and again whenever modules come or go
+    // while backtraces are enabled.
+    class ModuleMap final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      //-----------------------------------------------------------------------
+      // changes whenever a module is loaded or unloaded
+      [[nodiscard]] static std::uint64_t generation() noexcept
+      {
+        std::uint64_t result{};
+#ifdef __linux__
+        ::dl_iterate_phdr([](struct dl_phdr_info* info, size_t size, void* data) noexcept -> int {
+          if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs))
+            *static_cast<std::uint64_t*>(data) = static_cast<std::uint64_t>(info->dlpi_adds) + static_cast<std::uint64_t>(info->dlpi_subs);
+          return 1;
+        }, &result);
+#endif //__linux__
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::vector<Module> current() noexcept
+      {
+        std::vector<Module> result;
+#ifdef __linux__
+        ::dl_iterate_phdr([](struct dl_phdr_info* info, size_t, void* data) noexcept -> int {
+          Module module;
+          module.base_ = static_cast<std::uint64_t>(info->dlpi_addr);
+          module.low_ = UINT64_MAX;
+          for (int index = 0; index < info->dlpi_phnum; ++index) {
+            const auto& header{ info->dlpi_phdr[index] };
+            if (PT_LOAD == header.p_type) {
+              module.low_ = std::min<std::uint64_t>(module.low_, info->dlpi_addr + header.p_vaddr);
+              module.high_ = std::max<std::uint64_t>(module.high_, info->dlpi_addr + header.p_vaddr + header.p_memsz);
+            }
+            else if (PT_NOTE == header.p_type)
+              buildId(info->dlpi_addr + header.p_vaddr, header.p_memsz, module.buildId_);
+          }
+          if (module.high_ <= module.low_)
+            return 0;
+          module.path_ = (info->dlpi_name && info->dlpi_name[0]) ? info->dlpi_name : executable();
+          static_cast<std::vector<Module>*>(data)->push_back(std::move(module));
+          return 0;
+        }, &result);
+#endif //__linux__
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      // appends a complete modules record
+      static void encode(std::vector<std::byte>& output, const std::vector<Module>& modules) noexcept
+      {
+        const size_type start{ output.size() };
+        output.resize(start + sizeof(RecordHeader));
+        auto put{ [&](const void* data, size_type size) noexcept {
+          const size_type offset{ output.size() };
+          output.resize(offset + size);
+          memcpy(output.data() + offset, data, size);
+        } };
+        auto putString{ [&](std::string_view value) noexcept {
+          const std::uint32_t length{ static_cast<std::uint32_t>(value.size()) };
+          put(&length, sizeof(length));
+          put(value.data(), value.size());
+        } };
+
+        const std::uint32_t count{ static_cast<std::uint32_t>(modules.size()) };
+        put(&count, sizeof(count));
+        for (auto& module : modules) {
+          put(&module.base_, sizeof(module.base_));
+          put(&module.low_, sizeof(module.low_));
+          put(&module.high_, sizeof(module.high_));
+          putString(module.path_);
+          putString(module.buildId_);
+        }
+
+        const size_type size{ RecordHeader::align(output.size() - start) };
+        output.resize(start + size);
+        RecordHeader header{};
+        header.size_ = static_cast<std::uint32_t>(size);
+        header.kind_ = RecordKind::Modules;
+        header.timestamp_ = RecordHeader::now();
+        memcpy(output.data() + start, &header, sizeof(header));
+      }
+
+      //-----------------------------------------------------------------------
+      // replaces output with the modules of a modules record payload; returns
+      // false (and leaves output alone) if the payload is malformed
+      [[nodiscard]] static bool decode(gsl::span<const std::byte> payload, std::vector<Module>& output) noexcept
+      {
+        const std::byte* pos{ payload.data() };
+        const std::byte* const end{ payload.data() + payload.size() };
+        auto get{ [&](auto& value) noexcept -> bool {
+          if (static_cast<size_type>(end - pos) < sizeof(value))
+            return false;
+          memcpy(&value, pos, sizeof(value));
+          pos += sizeof(value);
+          return true;
+        } };
+        auto getString{ [&](std::string& value) noexcept -> bool {
+          std::uint32_t length{};
+          if ((!get(length)) || (static_cast<size_type>(end - pos) < length))
+            return false;
+          value.assign(reinterpret_cast<const char*>(pos), length);
+          pos += length;
+          return true;
+        } };
+
+        std::uint32_t count{};
+        if (!get(count))
+          return false;
+
+        std::vector<Module> modules;
+        for (std::uint32_t index{}; index < count; ++index) {
+          Module module;
+          if (!(get(module.base_) && get(module.low_) && get(module.high_) && getString(module.path_) && getString(module.buildId_)))
+            return false;
+          modules.push_back(std::move(module));
+        }
+        output = std::move(modules);
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static const Module* find(const std::vector<Module>& modules, std::uint64_t address) noexcept
+      {
+        for (auto& module : modules) {
+          if ((address >= module.low_) && (address < module.high_))
+            return &module;
+        }
+        return nullptr;
+      }
+
+    protected:
+#ifdef __linux__
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::string executable() noexcept
+      {
+        char path[4096]{};
+        const auto length{ ::readlink("/proc/self/exe", path, sizeof(path) - 1) };
+        return length > 0 ? std::string{ path, static_cast<size_t>(length) } : std::string{};
+      }
+
+      //-----------------------------------------------------------------------
+      static void buildId(std::uint64_t address, std::uint64_t size, std::string& output) noexcept
+      {
+        const auto* pos{ reinterpret_cast<const std::byte*>(address) };
+        const auto* const end{ pos + size };
+        auto align{ [](std::uint32_t value) noexcept { return (value + 3) & ~static_cast<std::uint32_t>(3); } };
+        while (static_cast<std::uint64_t>(end - pos) >= sizeof(ElfW(Nhdr))) {
+          ElfW(Nhdr) note;
+          memcpy(&note, pos, sizeof(note));
+          const auto* name{ pos + sizeof(note) };
+          const auto* desc{ name + align(note.n_namesz) };
+          if (desc + note.n_descsz > end)
+            return;
+          if ((NT_GNU_BUILD_ID == note.n_type) && (4 == note.n_namesz) && (0 == memcmp(name, "GNU", 4))) {
+            static constexpr char digits[]{ "0123456789abcdef" };
+            output.clear();
+            for (std::uint32_t index{}; index < note.n_descsz; ++index) {
+              const auto value{ std::to_integer<unsigned>(desc[index]) };
+              output.push_back(digits[value >> 4]);
+              output.push_back(digits[value & 0xf]);
+            }
+            return;
+          }
+          pos = desc + align(note.n_descsz);
+        }
+      }
+#endif //__linux__
+    };
+
+#ifndef _WIN32
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Offline symbolization: the addresses asked for are grouped by module and
+    // each module's are handed to a single addr2line run. Results are cached,
+    // an address that cannot be resolved becomes "module+0xoffset".
+    class Symbolizer final
+    {
+    public:
+      //-----------------------------------------------------------------------
+      void resolve(const std::vector<Module>& modules, gsl::span<const std::uint64_t> addresses) noexcept
+      {
+        std::unordered_map<const Module*, std::vector<std::uint64_t>> byModule;
+        for (auto address : addresses) {
+          if (names_.count(address))
+            continue;
+          const Module* module{ ModuleMap::find(modules, address) };
+          if (!module) {
+            names_[address] = hex(address);
+            continue;
+          }
+          auto& pending{ byModule[module] };
+          if (std::find(pending.begin(), pending.end(), address) == pending.end())
+            pending.push_back(address);
+        }
+
+        for (auto& [module, pending] : byModule) {
+          std::vector<std::string> args{ "addr2line", "-f", "-C", "-e", module->path_ };
+          for (auto address : pending) {
+            // return addresses point past the call
+            args.push_back(hex(address - module->base_ - 1));
+          }
+          const auto lines{ run(args) };
+
+          for (std::size_t index{}; index < pending.size(); ++index) {
+            const auto address{ pending[index] };
+            const bool found{ (lines.size() == 2 * pending.size()) && ("??" != lines[2 * index]) };
+            names_[address] = found ?
+              lines[2 * index] + " " + lines[(2 * index) + 1] :
+              module->path_ + "+" + hex(address - module->base_);
+          }
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] std::string symbol(std::uint64_t address) const noexcept
+      {
+        auto found{ names_.find(address) };
+        return found == names_.end() ? hex(address) : found->second;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      // the lines a program writes to its standard output; it is started
+      // without a shell, since the module paths in args come from the log
+      // being read and must never be interpreted
+      [[nodiscard]] static std::vector<std::string> run(const std::vector<std::string>& args) noexcept
+      {
+        std::vector<std::string> result;
+        int fds[2]{ -1, -1 };
+        if (0 != ::pipe(fds))
+          return result;
+        ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+        std::vector<char*> argv;
+        for (auto& arg : args) {
+          argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        ::posix_spawn_file_actions_t actions;
+        ::posix_spawn_file_actions_init(&actions);
+        ::posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        ::posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        ::posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+        ::pid_t pid{};
+        const int spawned{ ::posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ) };
+        ::posix_spawn_file_actions_destroy(&actions);
+        ::close(fds[1]);
+        if (0 != spawned) {
+          ::close(fds[0]);
+          return result;
+        }
+
+        if (FILE* pipe{ ::fdopen(fds[0], "r") }) {
+          char line[4096];
+          while (std::fgets(line, sizeof(line), pipe)) {
+            std::string_view value{ line };
+            while ((!value.empty()) && (('\n' == value.back()) || ('\r' == value.back())))
+              value.remove_suffix(1);
+            result.emplace_back(value);
+          }
+          std::fclose(pipe);
+        }
+        else
+          ::close(fds[0]);
+
+        int status{};
+        while ((::waitpid(pid, &status, 0) < 0) && (EINTR == errno)) {}
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::string hex(std::uint64_t value) noexcept
+      {
+        char buffer[24]{};
+        std::snprintf(buffer, sizeof(buffer), "0x%llx", static_cast<unsigned long long>(value));
+        return buffer;
+      }
+
+    protected:
+      std::unordered_map<std::uint64_t, std::string> names_;
+    };
+
+#endif //_WIN32
+
+  } // namespace log
+} // namespace zs
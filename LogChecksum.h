@@ -0,0 +1,299 @@
+#pragma once
+
+#include "LogTransport.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ZS_LOG_HAS_CRC32C_SSE42
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif //_MSC_VER
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define ZS_LOG_HAS_CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+#if defined(ZS_LOG_HAS_CRC32C_SSE42) && (defined(__GNUC__) || defined(__clang__))
+#define ZS_LOG_CRC32C_TARGET __attribute__((target("sse4.2")))
+#else
+#define ZS_LOG_CRC32C_TARGET
+#endif
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    // payload of a RecordKind::Checksum record: the CRC32C of the bytes_
+    // bytes of the stream between the previous checksum record and this one.
+    // A writer starts its stream with one covering nothing, from which on
+    // the reader knows the stream is checksummed.
+    struct ChecksumRecord
+    {
+      std::uint32_t crc_{};
+      std::uint32_t reserved_{};
+      std::uint64_t bytes_{};
+    };
+
+    //-------------------------------------------------------------------------
+    // a whole checksum record, as the file sinks write it
+    struct Checksum
+    {
+      RecordHeader header_;
+      ChecksumRecord checksum_;
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static Checksum make(std::uint32_t crc, std::uint64_t bytes) noexcept
+      {
+        Checksum result;
+        result.header_.size_ = static_cast<std::uint32_t>(sizeof(result));
+        result.header_.kind_ = RecordKind::Checksum;
+        result.header_.timestamp_ = RecordHeader::now();
+        result.checksum_.crc_ = crc;
+        result.checksum_.bytes_ = bytes;
+        return result;
+      }
+    };
+
+    static_assert(sizeof(Checksum) == RecordHeader::recordSize(sizeof(ChecksumRecord)));
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // CRC32C (Castagnoli), as used by iSCSI, ext4 and SSE4.2. With the CRC32
+    // instruction three interleaved streams keep it busy every cycle and
+    // are combined with precomputed shift tables; without it the table
+    // driven fallback goes eight bytes at a time. update(0, ...) starts a
+    // checksum and update(crc, ...) carries one on over the next bytes.
+    class Crc32c final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::uint32_t update(std::uint32_t crc, const std::byte* data, size_type size) noexcept
+      {
+#if defined(ZS_LOG_HAS_CRC32C_SSE42) || defined(ZS_LOG_HAS_CRC32C_ARM)
+        if (hardware())
+          return updateHardware(crc, data, size);
+#endif
+        return updateSoftware(crc, data, size);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static bool hardware() noexcept
+      {
+#if defined(ZS_LOG_HAS_CRC32C_SSE42)
+        static const bool gHardware{ detect() };
+        return gHardware;
+#elif defined(ZS_LOG_HAS_CRC32C_ARM)
+        return true;
+#else
+        return false;
+#endif
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::uint32_t updateSoftware(std::uint32_t crc, const std::byte* data, size_type size) noexcept
+      {
+        const auto& table{ software() };
+        crc = ~crc;
+        while (size >= sizeof(std::uint64_t)) {
+          std::uint64_t word;
+          memcpy(&word, data, sizeof(word));
+          word ^= crc;
+          crc =
+            table[7][word & 0xff] ^ table[6][(word >> 8) & 0xff] ^ table[5][(word >> 16) & 0xff] ^ table[4][(word >> 24) & 0xff] ^
+            table[3][(word >> 32) & 0xff] ^ table[2][(word >> 40) & 0xff] ^ table[1][(word >> 48) & 0xff] ^ table[0][word >> 56];
+          data += sizeof(word);
+          size -= sizeof(word);
+        }
+        while (size-- > 0) {
+          crc = table[0][(crc ^ static_cast<std::uint32_t>(*data++)) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+      }
+
+    protected:
+      using Table = std::array<std::array<std::uint32_t, 256>, 8>;
+      using Shift = std::array<std::array<std::uint32_t, 256>, 4>;
+      using Matrix = std::array<std::uint32_t, 32>;
+
+      [[nodiscard]] constexpr static std::uint32_t polynomial() noexcept { return 0x82f63b78; }    // reflected
+      [[nodiscard]] constexpr static size_type longBlock() noexcept { return 8192; }
+      [[nodiscard]] constexpr static size_type shortBlock() noexcept { return 256; }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static Table makeSoftware() noexcept
+      {
+        Table result{};
+        for (std::uint32_t index{}; index < 256; ++index) {
+          std::uint32_t crc{ index };
+          for (int bit{}; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ polynomial() : crc >> 1;
+          }
+          result[0][index] = crc;
+        }
+        for (std::uint32_t index{}; index < 256; ++index) {
+          for (size_type slice{ 1 }; slice < result.size(); ++slice) {
+            result[slice][index] = (result[slice - 1][index] >> 8) ^ result[0][result[slice - 1][index] & 0xff];
+          }
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static const Table& software() noexcept
+      {
+        static constexpr Table gTable{ makeSoftware() };
+        return gTable;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static std::uint32_t times(const Matrix& matrix, std::uint32_t vector) noexcept
+      {
+        std::uint32_t result{};
+        for (size_type row{}; 0 != vector; vector >>= 1, ++row) {
+          if (vector & 1)
+            result ^= matrix[row];
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static Matrix square(const Matrix& matrix) noexcept
+      {
+        Matrix result{};
+        for (size_type row{}; row < result.size(); ++row) {
+          result[row] = times(matrix, matrix[row]);
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      // the tables append size zero bytes (a power of two) to a CRC, which
+      // moves a stream's CRC past the streams that follow it
+      [[nodiscard]] constexpr static Shift makeShift(size_type size) noexcept
+      {
+        Matrix matrix{};
+        matrix[0] = polynomial();
+        for (size_type row{ 1 }; row < matrix.size(); ++row) {
+          matrix[row] = std::uint32_t{ 1 } << (row - 1);
+        }
+        // one zero bit squared three times is one zero byte
+        for (size_type bits{ 1 }; bits < 8 * size; bits *= 2) {
+          matrix = square(matrix);
+        }
+
+        Shift result{};
+        for (std::uint32_t index{}; index < 256; ++index) {
+          for (size_type part{}; part < result.size(); ++part) {
+            result[part][index] = times(matrix, index << (8 * part));
+          }
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::uint32_t shift(const Shift& table, std::uint32_t crc) noexcept
+      {
+        return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+      }
+
+#if defined(ZS_LOG_HAS_CRC32C_SSE42) || defined(ZS_LOG_HAS_CRC32C_ARM)
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static const Shift& longShift() noexcept
+      {
+        static constexpr Shift gShift{ makeShift(longBlock()) };
+        return gShift;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static const Shift& shortShift() noexcept
+      {
+        static constexpr Shift gShift{ makeShift(shortBlock()) };
+        return gShift;
+      }
+
+#if defined(ZS_LOG_HAS_CRC32C_SSE42)
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static bool detect() noexcept
+      {
+#ifdef _MSC_VER
+        int info[4]{};
+        __cpuid(info, 1);
+        return 0 != (info[2] & (1 << 20));
+#else
+        return __builtin_cpu_supports("sse4.2");
+#endif //_MSC_VER
+      }
+
+      ZS_LOG_CRC32C_TARGET static std::uint64_t step(std::uint64_t crc, std::uint64_t word) noexcept { return _mm_crc32_u64(crc, word); }
+      ZS_LOG_CRC32C_TARGET static std::uint32_t step(std::uint32_t crc, std::uint8_t byte) noexcept { return _mm_crc32_u8(crc, byte); }
+#else
+      static std::uint64_t step(std::uint64_t crc, std::uint64_t word) noexcept { return __crc32cd(static_cast<std::uint32_t>(crc), word); }
+      static std::uint32_t step(std::uint32_t crc, std::uint8_t byte) noexcept { return __crc32cb(crc, byte); }
+#endif
+
+      //-----------------------------------------------------------------------
+      // three streams of block bytes each at a time, the first carrying the
+      // CRC so far, for as long as there are that many bytes left
+      ZS_LOG_CRC32C_TARGET static void interleave(std::uint64_t& crc, const std::byte*& data, size_type& size, size_type block, const Shift& table) noexcept
+      {
+        while (size >= 3 * block) {
+          std::uint64_t crc1{};
+          std::uint64_t crc2{};
+          const std::byte* end{ data + block };
+          do {
+            std::uint64_t word0;
+            std::uint64_t word1;
+            std::uint64_t word2;
+            memcpy(&word0, data, sizeof(word0));
+            memcpy(&word1, data + block, sizeof(word1));
+            memcpy(&word2, data + (2 * block), sizeof(word2));
+            crc = step(crc, word0);
+            crc1 = step(crc1, word1);
+            crc2 = step(crc2, word2);
+            data += sizeof(std::uint64_t);
+          } while (data < end);
+          crc = shift(table, static_cast<std::uint32_t>(crc)) ^ crc1;
+          crc = shift(table, static_cast<std::uint32_t>(crc)) ^ crc2;
+          data += 2 * block;
+          size -= 3 * block;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      ZS_LOG_CRC32C_TARGET static std::uint32_t updateHardware(std::uint32_t crc, const std::byte* data, size_type size) noexcept
+      {
+        std::uint64_t result{ static_cast<std::uint32_t>(~crc) };
+        while ((0 != size) && (0 != (reinterpret_cast<std::uintptr_t>(data) & (sizeof(std::uint64_t) - 1)))) {
+          result = step(static_cast<std::uint32_t>(result), static_cast<std::uint8_t>(*data++));
+          --size;
+        }
+
+        interleave(result, data, size, longBlock(), longShift());
+        interleave(result, data, size, shortBlock(), shortShift());
+
+        while (size >= sizeof(std::uint64_t)) {
+          std::uint64_t word;
+          memcpy(&word, data, sizeof(word));
+          result = step(result, word);
+          data += sizeof(word);
+          size -= sizeof(word);
+        }
+        while (size-- > 0) {
+          result = step(static_cast<std::uint32_t>(result), static_cast<std::uint8_t>(*data++));
+        }
+        return ~static_cast<std::uint32_t>(result);
+      }
+#endif
+    };
+
+  } // namespace log
+} // namespace zs
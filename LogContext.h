@@ -0,0 +1,224 @@
+#pragma once
+
+#include "AutoScope.h"
+#include "LogTransport.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    struct ContextField
+    {
+      std::string key_;
+      std::string value_;
+
+      [[nodiscard]] bool operator==(const ContextField&) const noexcept = default;
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // The fields (request id, session id, ...) the calling thread is working
+    // on behalf of. They are packed once whenever the stack changes and sent
+    // as a single context record ahead of the next entry logged on the
+    // thread's ring; the entries themselves only carry the id of the context
+    // record, which the reader expands again. A reader that starts in the
+    // middle of a stream sees the ids of contexts it missed without fields.
+    // Once the stack empties, the last ring a context record went to gets a
+    // record flagged recordFlagEnded, so that readers holding on to records
+    // per context (see RetentionSink) know the context is over.
+    class LogContext final
+    {
+    public:
+      using size_type = zs::size_type;
+      using id_type = std::uint64_t;
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static LogContext& local() noexcept
+      {
+        thread_local LogContext context;
+        return context;
+      }
+
+      //-----------------------------------------------------------------------
+      // pushes a field for as long as the returned guard lives
+      [[nodiscard]] static auto scope(std::string_view key, std::string_view value) noexcept
+      {
+        local().push(key, value);
+        return zs::on_scope_exit([]() noexcept { local().pop(); });
+      }
+
+      [[nodiscard]] bool empty() const noexcept { return fields_.empty(); }
+      [[nodiscard]] size_type depth() const noexcept { return fields_.size(); }
+      [[nodiscard]] const std::vector<ContextField>& fields() const noexcept { return fields_; }
+
+      //-----------------------------------------------------------------------
+      void push(std::string_view key, std::string_view value) noexcept
+      {
+        fields_.push_back(ContextField{ std::string{ key }, std::string{ value } });
+        changed();
+      }
+
+      //-----------------------------------------------------------------------
+      void pop() noexcept
+      {
+        if (fields_.empty())
+          return;
+        fields_.pop_back();
+        if (fields_.empty())
+          end();
+        changed();
+      }
+
+      //-----------------------------------------------------------------------
+      // the id entries logged to ring right now carry, 0 if there is no
+      // context; the first call after a change writes the context record
+      [[nodiscard]] id_type prepare(Ring& ring) noexcept
+      {
+        if (fields_.empty())
+          return {};
+        if (&ring == emitted_)
+          return id_;
+
+        if (packed_.empty())
+          pack();
+
+        std::byte* record{ ring.reserve(RecordHeader::recordSize(packed_.size())) };
+        if (!record)
+          return {};
+
+        RecordHeader& header{ *reinterpret_cast<RecordHeader*>(record) };
+        header.size_ = static_cast<std::uint32_t>(RecordHeader::recordSize(packed_.size()));
+        header.kind_ = RecordKind::Context;
+        header.flags_ = {};
+        header.entry_ = id_;
+        header.timestamp_ = RecordHeader::now();
+        memcpy(record + sizeof(RecordHeader), packed_.data(), packed_.size());
+        ring.commit(header.size_);
+
+        emitted_ = &ring;
+        last_ = &ring;
+        lastId_ = id_;
+        return id_;
+      }
+
+      //-----------------------------------------------------------------------
+      // appends the fields of a context record payload; returns false (and
+      // appends nothing) if the payload is malformed
+      [[nodiscard]] static bool decode(gsl::span<const std::byte> payload, std::vector<ContextField>& output) noexcept
+      {
+        const std::byte* pos{ payload.data() };
+        const std::byte* const end{ payload.data() + payload.size() };
+        auto get{ [&](std::uint32_t& value) noexcept -> bool {
+          if (static_cast<size_type>(end - pos) < sizeof(value))
+            return false;
+          memcpy(&value, pos, sizeof(value));
+          pos += sizeof(value);
+          return true;
+        } };
+        auto getString{ [&](std::string& value) noexcept -> bool {
+          std::uint32_t length{};
+          if ((!get(length)) || (static_cast<size_type>(end - pos) < length))
+            return false;
+          value.assign(reinterpret_cast<const char*>(pos), length);
+          pos += length;
+          return true;
+        } };
+
+        std::uint32_t count{};
+        if (!get(count))
+          return false;
+
+        std::vector<ContextField> fields;
+        for (std::uint32_t index{}; index < count; ++index) {
+          ContextField field;
+          if (!(getString(field.key_) && getString(field.value_)))
+            return false;
+          fields.push_back(std::move(field));
+        }
+        output.insert(output.end(), std::make_move_iterator(fields.begin()), std::make_move_iterator(fields.end()));
+        return true;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      LogContext() noexcept = default;
+
+      //-----------------------------------------------------------------------
+      // context ids only have to be unique among the contexts a reader may
+      // see, including those of other processes sharing a collector
+      [[nodiscard]] static id_type nextId() noexcept
+      {
+        static std::atomic<id_type> next{ ((RecordHeader::now() ^ reinterpret_cast<std::uintptr_t>(&next)) * 0x9E3779B97F4A7C15ull) | 1 };
+        return next.fetch_add(1, std::memory_order_relaxed) | 1;
+      }
+
+      //-----------------------------------------------------------------------
+      void end() noexcept
+      {
+        Ring* const ring{ std::exchange(last_, nullptr) };
+        if (!ring)
+          return;
+        std::byte* record{ ring->reserve(sizeof(RecordHeader)) };
+        if (!record)
+          return;
+
+        RecordHeader& header{ *reinterpret_cast<RecordHeader*>(record) };
+        header.size_ = static_cast<std::uint32_t>(sizeof(RecordHeader));
+        header.kind_ = RecordKind::Context;
+        header.flags_ = recordFlagEnded();
+        header.entry_ = lastId_;
+        header.timestamp_ = RecordHeader::now();
+        ring->commit(header.size_);
+      }
+
+      //-----------------------------------------------------------------------
+      void changed() noexcept
+      {
+        packed_.clear();
+        emitted_ = nullptr;
+        id_ = nextId();
+      }
+
+      //-----------------------------------------------------------------------
+      void pack() noexcept
+      {
+        auto put{ [&](const void* data, size_type size) noexcept {
+          const size_type offset{ packed_.size() };
+          packed_.resize(offset + size);
+          memcpy(packed_.data() + offset, data, size);
+        } };
+        auto putString{ [&](const std::string& value) noexcept {
+          const std::uint32_t length{ static_cast<std::uint32_t>(value.size()) };
+          put(&length, sizeof(length));
+          put(value.data(), value.size());
+        } };
+
+        const std::uint32_t count{ static_cast<std::uint32_t>(fields_.size()) };
+        put(&count, sizeof(count));
+        for (auto& field : fields_) {
+          putString(field.key_);
+          putString(field.value_);
+        }
+      }
+
+    protected:
+      std::vector<ContextField> fields_;
+      std::vector<std::byte> packed_;
+      id_type id_{};
+      const Ring* emitted_{ nullptr };
+      Ring* last_{ nullptr };                 // the last ring a context record went to since the stack was empty
+      id_type lastId_{};
+    };
+
+  } // namespace log
+} // namespace zs
@@ -0,0 +1,271 @@
+
+#pragma once
+
+#include "LogChecksum.h"
+#include "LogTransport.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <climits>
+#include <deque>
+#include <vector>
+
+#include <poll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Writes drained records to a file or pipe descriptor with writev. The
+    // iovec array points straight into the producer rings; records that are
+    // adjacent in a ring are coalesced into a single iovec. The sink asks the
+    // drain to keep batching until either enough bytes are pending or the
+    // oldest pending record has waited maxLatency_. With checksumBytes_ set,
+    // a checksum record (see ChecksumRecord) follows the first batch that
+    // makes that many bytes since the previous one, and every flush. A
+    // target that stays full (a pipe or socket nobody reads) holds a write
+    // up for at most writeTimeout_; what is left of the batch is dropped.
+    class WritevSink : public Sink
+    {
+    public:
+      struct Options
+      {
+        std::chrono::microseconds maxLatency_{ 1000 };
+        std::chrono::milliseconds writeTimeout_{ 100 };
+        size_type batchBytes_{ 256 * 1024 };
+        bool closeOnDestroy_{};
+        bool sync_{};                   // fdatasync on flush
+        size_type checksumBytes_{};     // 0 for no checksum records
+      };
+
+      //-----------------------------------------------------------------------
+      WritevSink(int fd) noexcept : WritevSink(fd, Options{}) {}
+
+      //-----------------------------------------------------------------------
+      WritevSink(int fd, const Options& options) noexcept :
+        fd_{ fd },
+        options_{ options }
+      {
+        iovecs_.reserve(maxIovecs());
+      }
+
+      WritevSink(const WritevSink&) noexcept = delete;
+      WritevSink(WritevSink&&) noexcept = delete;
+
+      WritevSink& operator=(const WritevSink&) noexcept = delete;
+      WritevSink& operator=(WritevSink&&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      ~WritevSink() noexcept override
+      {
+        if (options_.closeOnDestroy_ && (fd_ >= 0))
+          ::close(fd_);
+      }
+
+      [[nodiscard]] int fd() const noexcept { return fd_; }
+      [[nodiscard]] size_type errors() const noexcept { return errors_; }
+      [[nodiscard]] size_type dropped() const noexcept { return dropped_; }      // bytes
+      [[nodiscard]] size_type syscalls() const noexcept { return syscalls_; }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool ready(const Batch& pending, clock_type::duration age) const noexcept override
+      {
+        return (pending.bytes_ >= options_.batchBytes_) || (age >= options_.maxLatency_);
+      }
+
+      //-----------------------------------------------------------------------
+      void write(const Batch& batch) noexcept override
+      {
+        if ((0 != options_.checksumBytes_) && (!checksummed_)) {
+          checksummed_ = true;
+          addChecksum();
+        }
+        for (auto& record : batch.records_) {
+          add(record.data(), record.size());
+        }
+        if (0 != options_.checksumBytes_) {
+          sum();
+          if (blockBytes_ >= options_.checksumBytes_)
+            addChecksum();
+        }
+        writeAll();
+        checksums_.clear();
+      }
+
+      //-----------------------------------------------------------------------
+      void flush() noexcept override
+      {
+        if (0 != blockBytes_) {
+          addChecksum();
+          writeAll();
+          checksums_.clear();
+        }
+        if (options_.sync_)
+          ::fdatasync(fd_);
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static size_type maxIovecs() noexcept
+      {
+#ifdef IOV_MAX
+        return IOV_MAX;
+#else
+        return 1024;
+#endif //IOV_MAX
+      }
+
+      //-----------------------------------------------------------------------
+      virtual ::ssize_t writeVectors(const ::iovec* vectors, int count) noexcept
+      {
+        return ::writev(fd_, vectors, count);
+      }
+
+      //-----------------------------------------------------------------------
+      void add(const std::byte* data, size_type size) noexcept
+      {
+        if (iovecs_.size() > summed_) {
+          auto& last{ iovecs_.back() };
+          if (static_cast<const std::byte*>(last.iov_base) + last.iov_len == data) {
+            last.iov_len += size;
+            return;
+          }
+        }
+        if (iovecs_.size() == maxIovecs())
+          writeAll();
+        iovecs_.push_back(::iovec{ const_cast<std::byte*>(data), size });
+      }
+
+      //-----------------------------------------------------------------------
+      void writeAll() noexcept
+      {
+        if (0 != options_.checksumBytes_)
+          sum();
+        summed_ = 0;
+
+        ::iovec* first{ iovecs_.data() };
+        ::iovec* last{ iovecs_.data() + iovecs_.size() };
+        clock_type::time_point deadline{};
+
+        while (first != last) {
+          ++syscalls_;
+          auto written{ writeVectors(first, static_cast<int>(last - first)) };
+          if (written < 0) {
+            if (EINTR == errno)
+              continue;
+            if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
+              const auto now{ clock_type::now() };
+              if (clock_type::time_point{} == deadline)
+                deadline = now + options_.writeTimeout_;
+              if (now < deadline) {
+                ::pollfd wait{ fd_, POLLOUT, 0 };
+                ::poll(&wait, 1, static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count()));
+                continue;
+              }
+              for (; first != last; ++first) {
+                dropped_ += first->iov_len;
+              }
+              break;
+            }
+            ++errors_;
+            break;
+          }
+
+          // skip fully written vectors and trim the partially written one
+          size_type remaining{ static_cast<size_type>(written) };
+          while ((first != last) && (remaining >= first->iov_len)) {
+            remaining -= first->iov_len;
+            ++first;
+          }
+          if (first != last) {
+            first->iov_base = static_cast<std::byte*>(first->iov_base) + remaining;
+            first->iov_len -= remaining;
+          }
+        }
+        iovecs_.clear();
+      }
+
+      //-----------------------------------------------------------------------
+      // takes the vectors not summed yet into the block's checksum
+      void sum() noexcept
+      {
+        for (; summed_ < iovecs_.size(); ++summed_) {
+          crc_ = Crc32c::update(crc_, static_cast<const std::byte*>(iovecs_[summed_].iov_base), iovecs_[summed_].iov_len);
+          blockBytes_ += iovecs_[summed_].iov_len;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // ends the block with a checksum record, which belongs to no block
+      void addChecksum() noexcept
+      {
+        sum();
+        auto& record{ checksums_.emplace_back(Checksum::make(crc_, blockBytes_)) };
+        crc_ = 0;
+        blockBytes_ = 0;
+
+        add(reinterpret_cast<const std::byte*>(&record), sizeof(record));
+        summed_ = iovecs_.size();
+      }
+
+    protected:
+      const int fd_{ -1 };
+      const Options options_;
+
+      std::vector<::iovec> iovecs_;
+      size_type summed_{};                      // iovecs_ taken into crc_
+      std::deque<Checksum> checksums_;          // written by the batch at hand
+      std::uint32_t crc_{};
+      size_type blockBytes_{};
+      bool checksummed_{};
+      size_type errors_{};
+      size_type dropped_{};
+      size_type syscalls_{};
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Same batching as WritevSink but writes at an explicit file offset with
+    // pwritev, so the descriptor does not need O_APPEND and the file position
+    // is never shared with anything else using the descriptor.
+    class PwriteSink : public WritevSink
+    {
+    public:
+      //-----------------------------------------------------------------------
+      PwriteSink(int fd, ::off_t offset = 0) noexcept : PwriteSink(fd, Options{}, offset) {}
+
+      //-----------------------------------------------------------------------
+      PwriteSink(int fd, const Options& options, ::off_t offset = 0) noexcept :
+        WritevSink(fd, options),
+        offset_{ offset }
+      {}
+
+      [[nodiscard]] ::off_t offset() const noexcept { return offset_; }
+
+    protected:
+      //-----------------------------------------------------------------------
+      ::ssize_t writeVectors(const ::iovec* vectors, int count) noexcept override
+      {
+        auto written{ ::pwritev(fd_, vectors, count, offset_) };
+        if (written > 0)
+          offset_ += written;
+        return written;
+      }
+
+    protected:
+      ::off_t offset_{};
+    };
+
+  } // namespace log
+} // namespace zs
+
+#endif //_WIN32
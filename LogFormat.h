@@ -0,0 +1,115 @@
+#pragma once
+
+#include <iterator>
+#include <string_view>
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Message format of a call site, e.g. "filled {qty} @ {px}". Every
+    // placeholder names one of the call site's parameters and "{{" and "}}"
+    // stand for literal braces. The format is only kept as metadata next to
+    // the call site's name; entries carry their raw arguments as always and
+    // the message is put together by whoever reads them.
+    class MessageFormat final
+    {
+    public:
+      using size_type = std::string_view::size_type;
+
+      //-----------------------------------------------------------------------
+      // calls text(std::string_view) for every run of literal text and
+      // name(std::string_view) for every placeholder, in order; returns false
+      // at the first unbalanced brace
+      template <typename TText, typename TName>
+      [[nodiscard]] constexpr static bool parse(std::string_view format, TText&& text, TName&& name) noexcept
+      {
+        size_type start{};
+        size_type pos{};
+        while (pos < format.size()) {
+          const char c{ format[pos] };
+          if (('{' != c) && ('}' != c)) {
+            ++pos;
+            continue;
+          }
+          if (pos > start)
+            text(format.substr(start, pos - start));
+
+          // doubled braces are one literal brace
+          if ((pos + 1 < format.size()) && (c == format[pos + 1])) {
+            text(format.substr(pos, 1));
+            pos += 2;
+            start = pos;
+            continue;
+          }
+          if ('}' == c)
+            return false;
+
+          const size_type close{ format.find_first_of("{}", pos + 1) };
+          if ((std::string_view::npos == close) || ('}' != format[close]))
+            return false;
+          name(format.substr(pos + 1, close - pos - 1));
+          pos = close + 1;
+          start = pos;
+        }
+        if (pos > start)
+          text(format.substr(start, pos - start));
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      // true if the format is well formed, every placeholder names a
+      // parameter and every parameter is named by exactly one placeholder
+      template <typename TNames>
+      [[nodiscard]] constexpr static bool check(std::string_view format, const TNames& names) noexcept
+      {
+        size_type placeholders{};
+        bool known{ true };
+        const bool parsed{ parse(format, [](std::string_view) noexcept {}, [&](std::string_view name) noexcept {
+          ++placeholders;
+          known = known && (index(names, name) < static_cast<size_type>(std::size(names)));
+        }) };
+        if ((!parsed) || (!known) || (placeholders != static_cast<size_type>(std::size(names))))
+          return false;
+
+        // as many placeholders as names, so a name used twice hides a missing one
+        for (auto& candidate : names) {
+          if (1 != count(format, candidate))
+            return false;
+        }
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      // how many placeholders of a well formed format name name
+      [[nodiscard]] constexpr static size_type count(std::string_view format, std::string_view name) noexcept
+      {
+        size_type result{};
+        (void)parse(format, [](std::string_view) noexcept {}, [&](std::string_view placeholder) noexcept {
+          if (placeholder == name)
+            ++result;
+        });
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      // position of name in names, the size of names if it is not there
+      template <typename TNames>
+      [[nodiscard]] constexpr static size_type index(const TNames& names, std::string_view name) noexcept
+      {
+        size_type result{};
+        for (auto& candidate : names) {
+          if (std::string_view{ candidate } == name)
+            break;
+          ++result;
+        }
+        return result;
+      }
+    };
+
+  } // namespace log
+} // namespace zs
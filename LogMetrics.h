@@ -0,0 +1,571 @@
+#pragma once
+
+#include "log.h"
+#include "LogTransport.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    enum class MetricKind : std::uint8_t
+    {
+      Counter,
+      Gauge,
+      Histogram,
+    };
+
+    //-------------------------------------------------------------------------
+    struct MetricKindDeclare : public EnumDeclare<MetricKind, 3>
+    {
+      constexpr const Entries operator()() const noexcept {
+        return { {
+          {MetricKind::Counter, "counter"},
+          {MetricKind::Gauge, "gauge"},
+          {MetricKind::Histogram, "histogram"},
+        } };
+      }
+    };
+
+    using MetricKindTraits = EnumTraits<MetricKind, MetricKindDeclare>;
+
+    // per thread cells are found through a two level table of this many
+    // blocks of this many metrics each
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(64)> metricBlockSize;
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(64 * 64)> maxMetrics;
+
+    // values below this are bucketed exactly, above it every power of two is
+    // split into histogramSubBuckets equally wide buckets
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(16)> histogramLinearBuckets;
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(8)> histogramSubBuckets;
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(16 + ((64 - 4) * 8))> histogramBuckets;
+
+    class MetricSlots;
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Metrics register like components, for the lifetime of the process, and
+    // are described by their component and name in every snapshot. Updates
+    // go to cells owned by the updating thread; nothing is shared or locked
+    // until a snapshot adds the cells of all threads up. Snapshots leave out
+    // the metrics of components that are switched off (Level::None).
+    class Metric
+    {
+    public:
+      using size_type = zs::size_type;
+      using value_type = std::uint64_t;
+
+      friend class MetricSlots;
+
+      Metric(const Metric&) noexcept = delete;
+      Metric& operator=(const Metric&) noexcept = delete;
+
+      [[nodiscard]] MetricKind kind() const noexcept { return kind_; }
+      [[nodiscard]] const Component& component() const noexcept { return component_; }
+      [[nodiscard]] std::string_view name() const noexcept { return name_; }
+      [[nodiscard]] size_type index() const noexcept { return index_; }
+
+      //-----------------------------------------------------------------------
+      // writes the cumulative values of every metric as metrics records into
+      // ring; returns the number of metrics written
+      static size_type snapshot(Ring& ring) noexcept;
+
+    protected:
+      //-----------------------------------------------------------------------
+      Metric(const Component& component, std::string_view name, MetricKind kind, size_type width) noexcept :
+        component_{ component },
+        name_{ name },
+        kind_{ kind },
+        width_{ width },
+        index_{ nextIndex() },
+        retired_{ width > 0 ? new value_type[width]{} : nullptr }
+      {
+        std::lock_guard lock{ registryMutex() };
+        next_ = std::exchange(head(), this);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static Metric*& head() noexcept
+      {
+        static Metric* gHead{ nullptr };
+        return gHead;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static size_type nextIndex() noexcept
+      {
+        static std::atomic<size_type> gIndex{};
+        return gIndex.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::mutex& registryMutex() noexcept
+      {
+        static std::mutex gMutex;
+        return gMutex;
+      }
+
+      //-----------------------------------------------------------------------
+      // the calling thread's cells for this metric, nullptr past maxMetrics
+      [[nodiscard]] std::atomic<value_type>* cells() const noexcept;
+
+      //-----------------------------------------------------------------------
+      // only ever written by the owning thread, so no read-modify-write
+      static void add(std::atomic<value_type>& cell, value_type value) noexcept
+      {
+        cell.store(cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+      }
+
+    protected:
+      const Component& component_;
+      const std::string_view name_;
+      const MetricKind kind_{};
+      const size_type width_{};           // cells per thread
+      const size_type index_{};
+      std::unique_ptr<value_type[]> retired_;   // folded in from threads that exited, guarded by registryMutex()
+      Metric* next_{ nullptr };
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Monotonic or up/down count; negative amounts wrap and add up correctly.
+    class Counter final : public Metric
+    {
+    public:
+      //-----------------------------------------------------------------------
+      Counter(const Component& component, std::string_view name) noexcept :
+        Metric{ component, name, MetricKind::Counter, 1 }
+      {}
+
+      //-----------------------------------------------------------------------
+      void add(std::int64_t amount = 1) noexcept
+      {
+        if (auto* cells{ Metric::cells() })
+          Metric::add(cells[0], static_cast<value_type>(amount));
+      }
+
+      void operator++() noexcept { add(1); }
+      void operator--() noexcept { add(-1); }
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // A current value has no meaningful per thread sum, so a gauge is the one
+    // metric kept in a single (relaxed, unlocked) atomic; counting something
+    // up and down from many threads is what Counter is for.
+    class Gauge final : public Metric
+    {
+    public:
+      //-----------------------------------------------------------------------
+      Gauge(const Component& component, std::string_view name) noexcept :
+        Metric{ component, name, MetricKind::Gauge, 0 }
+      {}
+
+      void set(std::int64_t value) noexcept { value_.store(value, std::memory_order_relaxed); }
+      [[nodiscard]] std::int64_t value() const noexcept { return value_.load(std::memory_order_relaxed); }
+
+    protected:
+      std::atomic<std::int64_t> value_{};
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Log-linear buckets: exact below histogramLinearBuckets, then 8 buckets
+    // per power of two (at most 12.5% relative error) up to the full range.
+    class Histogram final : public Metric
+    {
+    public:
+      //-----------------------------------------------------------------------
+      Histogram(const Component& component, std::string_view name) noexcept :
+        Metric{ component, name, MetricKind::Histogram, histogramBuckets() + 2 }
+      {}
+
+      //-----------------------------------------------------------------------
+      void record(value_type value) noexcept
+      {
+        auto* cells{ Metric::cells() };
+        if (!cells)
+          return;
+        Metric::add(cells[bucket(value)], 1);
+        Metric::add(cells[histogramBuckets()], 1);
+        Metric::add(cells[histogramBuckets() + 1], value);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static size_type bucket(value_type value) noexcept
+      {
+        if (value < histogramLinearBuckets())
+          return static_cast<size_type>(value);
+        const size_type exponent{ static_cast<size_type>(std::bit_width(value) - 1) };
+        const size_type sub{ static_cast<size_type>((value >> (exponent - 3)) & (histogramSubBuckets() - 1)) };
+        return histogramLinearBuckets() + ((exponent - 4) * histogramSubBuckets()) + sub;
+      }
+
+      //-----------------------------------------------------------------------
+      // the smallest value falling into bucket
+      [[nodiscard]] constexpr static value_type lowerBound(size_type bucket) noexcept
+      {
+        if (bucket < histogramLinearBuckets())
+          return static_cast<value_type>(bucket);
+        const size_type exponent{ ((bucket - histogramLinearBuckets()) / histogramSubBuckets()) + 4 };
+        const size_type sub{ (bucket - histogramLinearBuckets()) % histogramSubBuckets() };
+        return static_cast<value_type>(histogramSubBuckets() + sub) << (exponent - 3);
+      }
+    };
+
+    static_assert(Histogram::bucket(15) == 15);
+    static_assert(Histogram::bucket(16) == 16);
+    static_assert(Histogram::bucket(UINT64_MAX) == histogramBuckets() - 1);
+    static_assert(Histogram::lowerBound(Histogram::bucket(1000)) <= 1000);
+    static_assert(Histogram::lowerBound(Histogram::bucket(1000) + 1) > 1000);
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // The cells of one thread. Cells are allocated the first time the thread
+    // touches a metric and folded into the metric once the thread exits.
+    class MetricSlots final
+    {
+    public:
+      using size_type = zs::size_type;
+      using value_type = Metric::value_type;
+
+      friend class Metric;
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static MetricSlots& local() noexcept
+      {
+        thread_local MetricSlots slots;
+        return slots;
+      }
+
+      MetricSlots(const MetricSlots&) noexcept = delete;
+      MetricSlots& operator=(const MetricSlots&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] std::atomic<value_type>* cells(const Metric& metric) noexcept
+      {
+        if (metric.index_ >= maxMetrics())
+          return nullptr;
+        auto& block{ blocks_[metric.index_ / metricBlockSize()] };
+        auto* cells{ block ? (*block)[metric.index_ % metricBlockSize()].load(std::memory_order_relaxed) : nullptr };
+        return cells ? cells : allocate(metric);
+      }
+
+      //-----------------------------------------------------------------------
+      ~MetricSlots() noexcept
+      {
+        std::lock_guard lock{ Metric::registryMutex() };
+        for (auto* metric{ Metric::head() }; metric; metric = metric->next_) {
+          if (auto* cells{ find(*metric) }) {
+            for (size_type index{}; index < metric->width_; ++index) {
+              metric->retired_[index] += cells[index].load(std::memory_order_relaxed);
+            }
+          }
+        }
+        auto& all{ threads() };
+        all.erase(std::remove(all.begin(), all.end(), this), all.end());
+      }
+
+    protected:
+      using Block = std::array<std::atomic<std::atomic<value_type>*>, metricBlockSize()>;
+
+      //-----------------------------------------------------------------------
+      MetricSlots() noexcept
+      {
+        std::lock_guard lock{ Metric::registryMutex() };
+        threads().push_back(this);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::vector<MetricSlots*>& threads() noexcept
+      {
+        static std::vector<MetricSlots*> gThreads;
+        return gThreads;
+      }
+
+      //-----------------------------------------------------------------------
+      // whoever holds the registry mutex may look at the cells of any thread
+      [[nodiscard]] const std::atomic<value_type>* find(const Metric& metric) const noexcept
+      {
+        if (metric.index_ >= maxMetrics())
+          return nullptr;
+        auto& block{ blocks_[metric.index_ / metricBlockSize()] };
+        return block ? (*block)[metric.index_ % metricBlockSize()].load(std::memory_order_acquire) : nullptr;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] std::atomic<value_type>* allocate(const Metric& metric) noexcept
+      {
+        std::lock_guard lock{ Metric::registryMutex() };
+        auto& block{ blocks_[metric.index_ / metricBlockSize()] };
+        if (!block)
+          block = std::make_unique<Block>();
+
+        auto& cells{ storage_.emplace_back(new std::atomic<value_type>[metric.width_]) };
+        for (size_type index{}; index < metric.width_; ++index) {
+          cells[index].store(0, std::memory_order_relaxed);
+        }
+        (*block)[metric.index_ % metricBlockSize()].store(cells.get(), std::memory_order_release);
+        return cells.get();
+      }
+
+    protected:
+      std::array<std::unique_ptr<Block>, maxMetrics() / metricBlockSize()> blocks_;
+      std::vector<std::unique_ptr<std::atomic<value_type>[]>> storage_;
+    };
+
+    //-------------------------------------------------------------------------
+    inline std::atomic<Metric::value_type>* Metric::cells() const noexcept
+    {
+      return MetricSlots::local().cells(*this);
+    }
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // One metric as read back from a metrics record.
+    struct MetricSample
+    {
+      using size_type = zs::size_type;
+
+      MetricKind kind_{};
+      std::string component_;
+      std::string name_;
+      std::int64_t value_{};              // counters and gauges
+      std::uint64_t count_{};             // histograms
+      std::uint64_t sum_{};
+      std::vector<std::pair<std::uint32_t, std::uint64_t>> buckets_;   // bucket index and count, empty buckets left out
+
+      //-----------------------------------------------------------------------
+      // appends the metrics of a metrics record payload; returns false (and
+      // appends nothing) if the payload is malformed
+      [[nodiscard]] static bool decode(gsl::span<const std::byte> payload, std::vector<MetricSample>& output) noexcept
+      {
+        const std::byte* pos{ payload.data() };
+        const std::byte* const end{ payload.data() + payload.size() };
+        auto get{ [&](auto& value) noexcept -> bool {
+          if (static_cast<size_type>(end - pos) < sizeof(value))
+            return false;
+          memcpy(&value, pos, sizeof(value));
+          pos += sizeof(value);
+          return true;
+        } };
+        auto getString{ [&](std::string& value) noexcept -> bool {
+          std::uint32_t length{};
+          if ((!get(length)) || (static_cast<size_type>(end - pos) < length))
+            return false;
+          value.assign(reinterpret_cast<const char*>(pos), length);
+          pos += length;
+          return true;
+        } };
+
+        std::uint32_t count{};
+        if (!get(count))
+          return false;
+
+        std::vector<MetricSample> samples;
+        for (std::uint32_t index{}; index < count; ++index) {
+          MetricSample sample;
+          if (!(get(sample.kind_) && getString(sample.component_) && getString(sample.name_)))
+            return false;
+          if (MetricKind::Histogram != sample.kind_) {
+            if (!get(sample.value_))
+              return false;
+            samples.push_back(std::move(sample));
+            continue;
+          }
+
+          std::uint32_t buckets{};
+          if (!(get(sample.count_) && get(sample.sum_) && get(buckets)))
+            return false;
+          for (std::uint32_t bucket{}; bucket < buckets; ++bucket) {
+            std::pair<std::uint32_t, std::uint64_t> entry;
+            if (!(get(entry.first) && get(entry.second)))
+              return false;
+            sample.buckets_.push_back(entry);
+          }
+          samples.push_back(std::move(sample));
+        }
+        output.insert(output.end(), std::make_move_iterator(samples.begin()), std::make_move_iterator(samples.end()));
+        return true;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    inline Metric::size_type Metric::snapshot(Ring& ring) noexcept
+    {
+      std::vector<std::byte> payload;
+      std::uint32_t count{};
+      size_type total{};
+
+      auto put{ [&](const void* data, size_type size) noexcept {
+        const size_type offset{ payload.size() };
+        payload.resize(offset + size);
+        memcpy(payload.data() + offset, data, size);
+      } };
+      auto putString{ [&](std::string_view value) noexcept {
+        const std::uint32_t length{ static_cast<std::uint32_t>(value.size()) };
+        put(&length, sizeof(length));
+        put(value.data(), value.size());
+      } };
+      auto flush{ [&]() noexcept {
+        if (0 == count)
+          return;
+        memcpy(payload.data(), &count, sizeof(count));
+        std::byte* record{ ring.reserve(RecordHeader::recordSize(payload.size())) };
+        if (record) {
+          RecordHeader& header{ *reinterpret_cast<RecordHeader*>(record) };
+          header.size_ = static_cast<std::uint32_t>(RecordHeader::recordSize(payload.size()));
+          header.kind_ = RecordKind::Metrics;
+          header.flags_ = {};
+          header.entry_ = {};
+          header.timestamp_ = RecordHeader::now();
+          memcpy(record + sizeof(RecordHeader), payload.data(), payload.size());
+          ring.commit(header.size_);
+          total += count;
+        }
+        payload.resize(sizeof(count));
+        count = 0;
+      } };
+
+      payload.resize(sizeof(count));
+      const size_type maxPayload{ ring.maxRecordSize() - sizeof(RecordHeader) };
+      std::vector<value_type> sums;
+
+      std::lock_guard lock{ registryMutex() };
+      for (auto* metric{ head() }; metric; metric = metric->next_) {
+        if (!metric->component_.isLogging(Level::Basic))
+          continue;
+
+        sums.assign(metric->retired_.get(), metric->retired_.get() + metric->width_);
+        for (auto* slots : MetricSlots::threads()) {
+          if (auto* cells{ slots->find(*metric) }) {
+            for (size_type index{}; index < metric->width_; ++index) {
+              sums[index] += cells[index].load(std::memory_order_relaxed);
+            }
+          }
+        }
+
+        const size_type start{ payload.size() };
+        put(&metric->kind_, sizeof(metric->kind_));
+        putString(metric->component_.name());
+        putString(metric->name_);
+        switch (metric->kind_) {
+          case MetricKind::Counter: {
+            const std::int64_t value{ static_cast<std::int64_t>(sums[0]) };
+            put(&value, sizeof(value));
+            break;
+          }
+          case MetricKind::Gauge: {
+            const std::int64_t value{ static_cast<const Gauge*>(metric)->value() };
+            put(&value, sizeof(value));
+            break;
+          }
+          case MetricKind::Histogram: {
+            put(&sums[histogramBuckets()], sizeof(value_type));
+            put(&sums[histogramBuckets() + 1], sizeof(value_type));
+            const std::uint32_t buckets{ static_cast<std::uint32_t>(std::count_if(sums.begin(), sums.begin() + histogramBuckets(), [](value_type value) noexcept { return 0 != value; })) };
+            put(&buckets, sizeof(buckets));
+            for (std::uint32_t bucket{}; bucket < histogramBuckets(); ++bucket) {
+              if (0 == sums[bucket])
+                continue;
+              put(&bucket, sizeof(bucket));
+              put(&sums[bucket], sizeof(value_type));
+            }
+            break;
+          }
+        }
+
+        // a metric that does not fit the record any more starts the next one
+        if ((payload.size() > maxPayload) && (0 != count)) {
+          std::vector<std::byte> overflow{ payload.begin() + start, payload.end() };
+          payload.resize(start);
+          flush();
+          payload.insert(payload.end(), overflow.begin(), overflow.end());
+        }
+        ++count;
+      }
+      flush();
+      return total;
+    }
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Takes a snapshot every interval on a thread of its own; the snapshots
+    // travel through that thread's ring like any other record and so end up
+    // in the same segments, on the same timeline, as the entries.
+    class MetricsReporter final
+    {
+    public:
+      //-----------------------------------------------------------------------
+      MetricsReporter(std::chrono::milliseconds interval = std::chrono::milliseconds{ 1000 }) noexcept :
+        interval_{ interval }
+      {
+        thread_ = std::thread{ [this]() noexcept { run(); } };
+      }
+
+      MetricsReporter(const MetricsReporter&) noexcept = delete;
+      MetricsReporter& operator=(const MetricsReporter&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      // a last snapshot is taken on the way out
+      ~MetricsReporter() noexcept
+      {
+        {
+          std::lock_guard lock{ mutex_ };
+          stopping_ = true;
+        }
+        wake_.notify_all();
+        thread_.join();
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      void run() noexcept
+      {
+        Ring& ring{ Drain::local() };
+        std::unique_lock lock{ mutex_ };
+        while (true) {
+          const bool stopping{ wake_.wait_for(lock, interval_, [this]() noexcept { return stopping_; }) };
+          Metric::snapshot(ring);
+          if (stopping)
+            return;
+        }
+      }
+
+    protected:
+      const std::chrono::milliseconds interval_{};
+      std::mutex mutex_;
+      std::condition_variable wake_;
+      bool stopping_{};
+      std::thread thread_;
+    };
+
+  } // namespace log
+} // namespace zs
@@ -0,0 +1,1316 @@
+
+#pragma once
+
+#include "log.h"
+#include "LogBacktrace.h"
+#include "LogChecksum.h"
+#include "LogContext.h"
+#include "LogMetrics.h"
+#include "LogRepeat.h"
+#include "LogSchema.h"
+#include "LogSequence.h"
+#include "LogTransport.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif //__linux__
+#endif //_WIN32
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Walks the top level parameters of an entry record. Scalars and arrays
+    // of scalars are returned as raw element bytes; a parameter with sub
+    // entries ends the walk since its layout depends on the producing type.
+    class ParamReader final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      struct Param
+      {
+        const SchemaType* type_{ nullptr };
+        size_type count_{};                     // elements in data_
+        gsl::span<const std::byte> data_;
+      };
+
+      //-----------------------------------------------------------------------
+      ParamReader(const SchemaEntry& entry, gsl::span<const std::byte> payload) noexcept :
+        entry_{ entry },
+        payload_{ payload }
+      {}
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool next(Param& output) noexcept
+      {
+        if (index_ >= entry_.types_.size())
+          return false;
+
+        const SchemaType& type{ entry_.types_[index_] };
+        if (type.hasSubEntries() || (0 == type.elementWidth_))
+          return false;
+
+        size_type count{ type.totalElements_ };
+        if (type.isArrayVariableSized()) {
+          MetaDataTypeCommon::array_count_size_type packed{};
+          if (payload_.size() - pos_ < sizeof(packed))
+            return false;
+          memcpy(&packed, payload_.data() + pos_, sizeof(packed));
+          pos_ += sizeof(packed);
+          count = packed;
+        }
+
+        const size_type size{ count * type.elementWidth_ };
+        if (payload_.size() - pos_ < size)
+          return false;
+
+        output.type_ = &type;
+        output.count_ = count;
+        output.data_ = payload_.subspan(pos_, size);
+        pos_ += size;
+        ++index_;
+        return true;
+      }
+
+    protected:
+      const SchemaEntry& entry_;
+      const gsl::span<const std::byte> payload_;
+      size_type index_{};
+      size_type pos_{};
+    };
+
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(64 * 1024)> maxDecoderContexts;
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(16 * 1024 * 1024)> maxDecodedRecordSize;     // schema records of every call site included
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Incremental decoder for a stream of records as written by the sinks.
+    // Bytes may be handed over in any split; only complete records are
+    // decoded and the caller keeps whatever was not consumed for next time.
+    // Fragmented entries are put back together and handed over as a single
+    // record once the last fragment arrived; chains that never complete are
+    // discarded, oldest first, once they hold more than maxPending bytes.
+    // Entries logged within a context are handed over with the fields of the
+    // last maxDecoderContexts context records seen. The blocks of a
+    // checksummed stream are verified in the same pass; a header that makes
+    // no sense there (a size beyond maxDecodedRecordSize, say) spoils its
+    // block, and decoding picks up again at the checksum record ending it.
+    // A zeroed header followed by data is taken for damage (what power loss
+    // leaves behind) rather than for space not committed yet unless the
+    // input is a file still being written, see Input.
+    class RecordDecoder final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      struct Record
+      {
+        const RecordHeader& header_;
+        const SchemaEntry* entry_{ nullptr };   // nullptr if the schema was never seen
+        gsl::span<const std::byte> payload_;
+        std::uint64_t contextId_{};             // 0 if logged outside any context
+        const std::vector<ContextField>* context_{ nullptr };   // nullptr if the context record was never seen
+        gsl::span<const std::uint64_t> backtrace_;              // raw return addresses, innermost first (see modules())
+        std::uint64_t sequence_{};              // 0 unless logged while Sequence was enabled
+
+        //---------------------------------------------------------------------
+        // a Repeat record stands for that many more entries of the site, just
+        // like the last one written, and has no parameters
+        [[nodiscard]] std::uint64_t repeats() const noexcept
+        {
+          if ((RecordKind::Repeat != header_.kind_) || (payload_.size() < sizeof(RepeatRecord)))
+            return 0;
+          RepeatRecord repeat;
+          memcpy(&repeat, payload_.data(), sizeof(repeat));
+          return repeat.count_;
+        }
+      };
+
+      //-----------------------------------------------------------------------
+      // a stretch of the stream, by offset from where decoding started
+      struct Block
+      {
+        size_type offset_{};
+        size_type size_{};
+      };
+
+      //-----------------------------------------------------------------------
+      // what the bytes handed over are, which decides whether a zeroed header
+      // with data after it is a hole that will be filled or damage
+      enum class Input : std::uint8_t
+      {
+        Stream,     // damage in a checksummed stream, a hole otherwise
+        Live,       // a file still being written: always a hole
+        Complete,   // nothing more will be written: always damage
+      };
+
+      //-----------------------------------------------------------------------
+      RecordDecoder(size_type maxPending = 256 * 1024 * 1024) noexcept :
+        maxPending_{ maxPending }
+      {}
+
+      //-----------------------------------------------------------------------
+      RecordDecoder(Input input, size_type maxPending = 256 * 1024 * 1024) noexcept :
+        maxPending_{ maxPending },
+        input_{ input }
+      {}
+
+      [[nodiscard]] size_type records() const noexcept { return records_; }
+      [[nodiscard]] size_type corrupt() const noexcept { return corrupt_; }
+      [[nodiscard]] size_type discarded() const noexcept { return discarded_; }
+
+      //-----------------------------------------------------------------------
+      // checksummed streams (see ChecksumRecord) only: the blocks whose
+      // checksum matched, the stream offsets of those that could not be
+      // verified and how many bytes were decoded since the last checksum
+      // record
+      [[nodiscard]] size_type verified() const noexcept { return verified_; }
+      [[nodiscard]] const std::vector<Block>& damaged() const noexcept { return damaged_; }
+      [[nodiscard]] size_type unverified() const noexcept { return blockBytes_; }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] const SchemaEntry* find(std::uint64_t id) const noexcept
+      {
+        auto found{ entries_.find(id) };
+        return found == entries_.end() ? nullptr : &(found->second);
+      }
+
+      //-----------------------------------------------------------------------
+      // the modules of the latest modules record, to symbolize backtraces against
+      [[nodiscard]] const std::vector<Module>& modules() const noexcept { return modules_; }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] const std::vector<ContextField>* context(std::uint64_t id) const noexcept
+      {
+        auto found{ contexts_.find(id) };
+        return found == contexts_.end() ? nullptr : &(found->second);
+      }
+
+      //-----------------------------------------------------------------------
+      void reset() noexcept
+      {
+        entries_.clear();
+        chains_.clear();
+        contexts_.clear();
+        contextOrder_.clear();
+        modules_.clear();
+        pending_ = 0;
+        checksummed_ = false;
+        broken_ = false;
+        crc_ = 0;
+        blockBytes_ = 0;
+        blockStart_ = 0;
+        offset_ = 0;
+      }
+
+      //-----------------------------------------------------------------------
+      // the stream ended with undecoded bytes left over (the start of a
+      // record that was never completed); in a checksummed stream they and
+      // whatever came since the last checksum record are reported damaged,
+      // unless they are zeros only: space reserved but never written to
+      void finish(gsl::span<const std::byte> undecoded) noexcept
+      {
+        const bool written{ undecoded.size() != zeroed(undecoded) };
+        if (written && (!checksummed_))
+          ++corrupt_;
+        if (checksummed_ && (broken_ || written))
+          damaged_.push_back(Block{ blockStart_, blockBytes_ + undecoded.size() });
+        broken_ = false;
+        crc_ = 0;
+        blockBytes_ = 0;
+        offset_ += undecoded.size();
+        blockStart_ = offset_;
+      }
+
+      //-----------------------------------------------------------------------
+      // the caller gives up on decoding bytes, the next ones handed over
+      // follow them in the stream; counted as corrupt unless zeros only,
+      // which a checksummed stream still resyncs over at its next block
+      void skip(gsl::span<const std::byte> bytes) noexcept
+      {
+        if (bytes.size() != zeroed(bytes)) {
+          ++corrupt_;
+          if (checksummed_)
+            broken_ = true;
+        }
+        if (checksummed_)
+          sum(bytes);
+        offset_ += bytes.size();
+      }
+
+      //-----------------------------------------------------------------------
+      // Calls callback(const Record&) for every complete entry record at the
+      // start of bytes and returns the number of bytes consumed. Decoding
+      // stops at a partial record or at a zeroed header, which is space a
+      // writer has reserved (or a file hole) that is not committed yet; with
+      // data after it, it may be damage instead (see Input).
+      template <typename TCallback>
+      size_type decode(gsl::span<const std::byte> bytes, TCallback&& callback) noexcept
+      {
+        return decode(bytes, std::forward<TCallback>(callback), [](const RecordHeader&, const std::vector<MetricSample>&) noexcept {});
+      }
+
+      //-----------------------------------------------------------------------
+      // as above, also calling metrics(const RecordHeader&, const std::vector<MetricSample>&)
+      // for every metrics snapshot record
+      template <typename TCallback, typename TMetricsCallback>
+      size_type decode(gsl::span<const std::byte> bytes, TCallback&& callback, TMetricsCallback&& metrics) noexcept
+      {
+        size_type pos{};
+        size_type summed{};             // the checksum of the block covers bytes up to here
+        while (bytes.size() - pos >= sizeof(RecordHeader)) {
+          const RecordHeader& header{ *reinterpret_cast<const RecordHeader*>(bytes.data() + pos) };
+          if (broken_) {
+            // what is skipped is consumed, so the caller need not hold on to it
+            if (bytes.size() - pos < sizeof(Checksum))
+              break;
+            if (!boundary(bytes.subspan(pos), blockBytes_ + (pos - summed))) {
+              pos += recordAlignment();
+              continue;
+            }
+          }
+          if (0 == header.size_) {
+            const size_type zeros{ zeroed(bytes.subspan(pos)) };
+            if ((pos + zeros == bytes.size()) || (!spoilt()))
+              break;
+            // the zeros are skipped as one spoilt stretch; in a checksummed
+            // stream its block resyncs at the next checksum record as usual
+            ++corrupt_;
+            if (checksummed_)
+              broken_ = true;
+            else
+              pos += std::max<size_type>(zeros - (zeros % recordAlignment()), recordAlignment());
+            continue;
+          }
+
+          if ((!valid(header)) || (header.size_ > maxDecodedRecordSize())) {
+            ++corrupt_;
+            if (checksummed_)
+              broken_ = true;
+            else {
+              // skip ahead one alignment unit at a time until a header makes sense again
+              pos += recordAlignment();
+            }
+            continue;
+          }
+          if (bytes.size() - pos < header.size_)
+            break;
+
+          const gsl::span<const std::byte> payload{ bytes.subspan(pos + sizeof(RecordHeader), header.payloadSize()) };
+          pos += header.size_;
+
+          switch (header.kind_) {
+            case RecordKind::Schema:  describe(payload); break;
+            case RecordKind::Context: {
+              if (0 == (header.flags_ & recordFlagEnded()))
+                remember(header.entry_, payload);
+              break;
+            }
+            case RecordKind::Modules: {
+              if (!ModuleMap::decode(payload, modules_))
+                ++corrupt_;
+              break;
+            }
+            case RecordKind::Metrics: {
+              std::vector<MetricSample> samples;
+              if (!MetricSample::decode(payload, samples)) {
+                ++corrupt_;
+                break;
+              }
+              metrics(header, samples);
+              break;
+            }
+            case RecordKind::Entry:   {
+              Prefix prefix;
+              if (!read(header, payload, prefix)) {
+                ++corrupt_;
+                break;
+              }
+              const auto params{ payload.subspan(prefix.size_) };
+
+              if (0 != (header.flags_ & recordFlagContinued())) {
+                begin(header, params, prefix.contextId_, prefix.backtrace_, prefix.sequence_);
+                break;
+              }
+              ++records_;
+              callback(Record{ header, find(header.entry_), params, prefix.contextId_, context(prefix.contextId_), prefix.backtrace_, prefix.sequence_ });
+              break;
+            }
+            case RecordKind::Batch:   {
+              Prefix prefix;
+              BatchRecord batch;
+              if ((!read(header, payload, prefix)) || (payload.size() - prefix.size_ < sizeof(batch))) {
+                ++corrupt_;
+                break;
+              }
+              memcpy(&batch, payload.data() + prefix.size_, sizeof(batch));
+              const auto params{ payload.subspan(prefix.size_ + sizeof(batch)) };
+              if (params.size() / std::max<size_type>(1, batch.elementSize_) < batch.count_) {
+                ++corrupt_;
+                break;
+              }
+
+              // each element is handed over as an entry of its own
+              RecordHeader element{ header };
+              element.size_ = static_cast<std::uint32_t>(RecordHeader::recordSize(batch.elementSize_));
+              element.kind_ = RecordKind::Entry;
+              const SchemaEntry* entry{ find(header.entry_) };
+              const auto* fields{ context(prefix.contextId_) };
+              for (size_type index{}; index < batch.count_; ++index) {
+                ++records_;
+                callback(Record{ element, entry, params.subspan(index * batch.elementSize_, batch.elementSize_), prefix.contextId_, fields, prefix.backtrace_, prefix.sequence_ });
+              }
+              break;
+            }
+            case RecordKind::Fragment: {
+              if (!append(header, payload))
+                break;
+              auto found{ chains_.find(header.entry_) };
+              auto& bytes{ found->second.bytes_ };
+              const RecordHeader& whole{ *reinterpret_cast<const RecordHeader*>(bytes.data()) };
+              const auto contextId{ found->second.context_ };
+              ++records_;
+              callback(Record{ whole, find(whole.entry_), gsl::span<const std::byte>{ bytes }.subspan(sizeof(RecordHeader)), contextId, context(contextId), found->second.backtrace_, found->second.sequence_ });
+              pending_ -= bytes.size();
+              chains_.erase(found);
+              break;
+            }
+            case RecordKind::Checksum: {
+              verify(bytes.subspan(summed, pos - header.size_ - summed), payload, offset_ + pos);
+              summed = pos;
+              break;
+            }
+            case RecordKind::Repeat:  {
+              if (payload.size() < sizeof(RepeatRecord)) {
+                ++corrupt_;
+                break;
+              }
+              ++records_;
+              callback(Record{ header, find(header.entry_), payload, 0, nullptr, {}, 0 });
+              break;
+            }
+            default:                  break;
+          }
+        }
+        if (checksummed_)
+          sum(bytes.subspan(summed, pos - summed));
+        offset_ += pos;
+        return pos;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      // the number of zero bytes bytes start with
+      [[nodiscard]] static size_type zeroed(gsl::span<const std::byte> bytes) noexcept
+      {
+        const auto found{ std::find_if(bytes.begin(), bytes.end(), [](std::byte value) noexcept { return std::byte{} != value; }) };
+        return static_cast<size_type>(found - bytes.begin());
+      }
+
+      //-----------------------------------------------------------------------
+      // whether a zeroed header with data after it is damage
+      [[nodiscard]] bool spoilt() const noexcept
+      {
+        return (Input::Complete == input_) || ((Input::Stream == input_) && checksummed_);
+      }
+
+      //-----------------------------------------------------------------------
+      void sum(gsl::span<const std::byte> bytes) noexcept
+      {
+        crc_ = Crc32c::update(crc_, bytes.data(), bytes.size());
+        blockBytes_ += bytes.size();
+      }
+
+      //-----------------------------------------------------------------------
+      // checks the block ending with the checksum record, the next one starts
+      // at offset; the first checksum record only starts a block
+      void verify(gsl::span<const std::byte> bytes, gsl::span<const std::byte> payload, size_type offset) noexcept
+      {
+        ChecksumRecord checksum;
+        if (payload.size() < sizeof(checksum)) {
+          ++corrupt_;
+          return;
+        }
+        memcpy(&checksum, payload.data(), sizeof(checksum));
+
+        if (checksummed_) {
+          sum(bytes);
+          if ((!broken_) && (checksum.crc_ == crc_) && (checksum.bytes_ == blockBytes_)) {
+            if (0 != blockBytes_)
+              ++verified_;
+          }
+          else
+            damaged_.push_back(Block{ blockStart_, blockBytes_ });
+        }
+        checksummed_ = true;
+        broken_ = false;
+        crc_ = 0;
+        blockBytes_ = 0;
+        blockStart_ = offset;
+      }
+
+      //-----------------------------------------------------------------------
+      // whether bytes start with the checksum record ending a block of size
+      // bytes, which is where a spoilt block ends
+      [[nodiscard]] static bool boundary(gsl::span<const std::byte> bytes, size_type size) noexcept
+      {
+        Checksum checksum;
+        memcpy(&checksum, bytes.data(), sizeof(checksum));
+        return (RecordKind::Checksum == checksum.header_.kind_) && (sizeof(checksum) == checksum.header_.size_) && (size == checksum.checksum_.bytes_);
+      }
+
+      //-----------------------------------------------------------------------
+      // what an entry payload holds ahead of its parameters
+      struct Prefix
+      {
+        size_type size_{};
+        std::uint64_t contextId_{};
+        gsl::span<const std::uint64_t> backtrace_;
+        std::uint64_t sequence_{};
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static bool read(const RecordHeader& header, gsl::span<const std::byte> payload, Prefix& output) noexcept
+      {
+        const size_type prefix{ header.prefixSize() };
+        if (payload.size() < prefix)
+          return false;
+        output.size_ = prefix;
+        if (0 != header.contextSize())
+          memcpy(&output.contextId_, payload.data(), sizeof(output.contextId_));
+        if (prefix > header.contextSize() + header.sequenceSize()) {
+          const size_type depth{ (prefix - header.contextSize() - header.sequenceSize()) / sizeof(std::uint64_t) - 1 };
+          output.backtrace_ = gsl::span<const std::uint64_t>{ reinterpret_cast<const std::uint64_t*>(payload.data() + header.contextSize()) + 1, depth };
+        }
+        if (0 != header.sequenceSize())
+          memcpy(&output.sequence_, payload.data() + prefix - sizeof(output.sequence_), sizeof(output.sequence_));
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static bool valid(const RecordHeader& header) noexcept
+      {
+        return (header.size_ >= sizeof(RecordHeader)) &&
+          (0 == (header.size_ % recordAlignment())) &&
+          (static_cast<std::uint16_t>(header.kind_) < RecordKindTraits::total());
+      }
+
+      //-----------------------------------------------------------------------
+      void describe(gsl::span<const std::byte> payload) noexcept
+      {
+        std::vector<SchemaEntry> entries;
+        if (!SchemaReader::decode(payload, entries)) {
+          ++corrupt_;
+          return;
+        }
+        for (auto& entry : entries) {
+          const auto id{ entry.id_ };
+          entries_.insert_or_assign(id, std::move(entry));
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void remember(std::uint64_t id, gsl::span<const std::byte> payload) noexcept
+      {
+        std::vector<ContextField> fields;
+        if (!LogContext::decode(payload, fields)) {
+          ++corrupt_;
+          return;
+        }
+        if (contexts_.insert_or_assign(id, std::move(fields)).second)
+          contextOrder_.push_back(id);
+        while (contextOrder_.size() > maxDecoderContexts()) {
+          contexts_.erase(contextOrder_.front());
+          contextOrder_.pop_front();
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // the entry record starting a chain: its payload (past any context id)
+      // begins with the chain id
+      void begin(const RecordHeader& header, gsl::span<const std::byte> payload, std::uint64_t contextId, gsl::span<const std::uint64_t> backtrace, std::uint64_t sequence) noexcept
+      {
+        std::uint64_t id{};
+        if (payload.size() < sizeof(id)) {
+          ++corrupt_;
+          return;
+        }
+        memcpy(&id, payload.data(), sizeof(id));
+        discard(id);
+
+        Chain chain{ {}, ++order_, contextId, { backtrace.begin(), backtrace.end() }, sequence };
+        chain.bytes_.resize(sizeof(RecordHeader));
+        memcpy(chain.bytes_.data(), &header, sizeof(RecordHeader));
+        chain.bytes_.insert(chain.bytes_.end(), payload.begin() + sizeof(id), payload.end());
+        pending_ += chain.bytes_.size();
+        chains_.emplace(id, std::move(chain));
+        trim();
+      }
+
+      //-----------------------------------------------------------------------
+      // only fragments that are not the last in their chain fill their record
+      // completely, so the padding of the last one ends the whole payload;
+      // returns true once the chain is complete
+      [[nodiscard]] bool append(const RecordHeader& header, gsl::span<const std::byte> payload) noexcept
+      {
+        auto found{ chains_.find(header.entry_) };
+        if (found == chains_.end()) {
+          ++discarded_;
+          return false;
+        }
+
+        auto& bytes{ found->second.bytes_ };
+        bytes.insert(bytes.end(), payload.begin(), payload.end());
+        pending_ += payload.size();
+        if (0 != (header.flags_ & recordFlagContinued())) {
+          trim();
+          return false;
+        }
+
+        RecordHeader& whole{ *reinterpret_cast<RecordHeader*>(bytes.data()) };
+        whole.size_ = static_cast<std::uint32_t>(std::min<size_type>(RecordHeader::align(bytes.size()), UINT32_MAX));
+        whole.flags_ = {};
+        bytes.resize(RecordHeader::align(bytes.size()));
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      void discard(std::uint64_t id) noexcept
+      {
+        auto found{ chains_.find(id) };
+        if (found == chains_.end())
+          return;
+        pending_ -= found->second.bytes_.size();
+        chains_.erase(found);
+        ++discarded_;
+      }
+
+      //-----------------------------------------------------------------------
+      void trim() noexcept
+      {
+        while ((pending_ > maxPending_) && (!chains_.empty())) {
+          auto oldest{ std::min_element(chains_.begin(), chains_.end(), [](auto& left, auto& right) noexcept { return left.second.order_ < right.second.order_; }) };
+          discard(oldest->first);
+        }
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Chain
+      {
+        std::vector<std::byte> bytes_;      // the starting header followed by the payload so far
+        size_type order_{};
+        std::uint64_t context_{};
+        std::vector<std::uint64_t> backtrace_;
+        std::uint64_t sequence_{};
+      };
+
+      const size_type maxPending_{};
+      const Input input_{};
+      std::unordered_map<std::uint64_t, SchemaEntry> entries_;
+      std::unordered_map<std::uint64_t, Chain> chains_;
+      std::unordered_map<std::uint64_t, std::vector<ContextField>> contexts_;
+      std::deque<std::uint64_t> contextOrder_;
+      std::vector<Module> modules_;
+      size_type pending_{};
+      size_type order_{};
+      size_type records_{};
+      size_type corrupt_{};
+      size_type discarded_{};
+
+      bool checksummed_{};
+      bool broken_{};                       // the block holds a header that made no sense
+      std::uint32_t crc_{};
+      size_type blockBytes_{};
+      size_type blockStart_{};
+      size_type offset_{};                  // of the bytes handed to decode()
+      size_type verified_{};
+      std::vector<Block> damaged_;
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Puts the entries of several record streams (files of different sinks,
+    // processes or hosts) into one strict total order: by timestamp, then by
+    // sequence number (see Sequence), then by input and finally by position
+    // in it, so the same inputs always come out the same way. No single
+    // stream is in timestamp order, the drain writes a batch ring by ring, so
+    // the entries are held until every unfinished input has seen entries
+    // more than window later; an entry that still shows up behind one
+    // already handed over counts as late and goes out at once. At most
+    // maxBuffered_ entries are held, beyond that the earliest goes out
+    // whether or not it is certain of its place.
+    class RecordMerger final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      struct Options
+      {
+        std::chrono::nanoseconds window_{ std::chrono::seconds{ 1 } };
+        size_type maxBuffered_{ 1024 * 1024 };
+      };
+
+      //-----------------------------------------------------------------------
+      // a decoded entry copied out of the bytes it came from, which are gone
+      // by the time it is handed over
+      struct Entry
+      {
+        std::uint64_t timestamp_{};
+        std::uint64_t sequence_{};
+        size_type input_{};
+        size_type order_{};                 // position within the input
+        const SchemaEntry* entry_{ nullptr };
+        std::vector<std::byte> bytes_;      // the header followed by the parameters
+        std::uint64_t contextId_{};
+        std::optional<std::vector<ContextField>> context_;
+        std::vector<std::uint64_t> backtrace_;
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] static std::unique_ptr<Entry> make(size_type input, size_type order, const RecordDecoder::Record& record) noexcept
+        {
+          auto result{ std::make_unique<Entry>() };
+          result->timestamp_ = record.header_.timestamp_;
+          result->sequence_ = record.sequence_;
+          result->input_ = input;
+          result->order_ = order;
+          result->entry_ = record.entry_;
+          result->bytes_.resize(sizeof(RecordHeader) + record.payload_.size());
+          memcpy(result->bytes_.data(), &record.header_, sizeof(RecordHeader));
+          memcpy(result->bytes_.data() + sizeof(RecordHeader), record.payload_.data(), record.payload_.size());
+          result->contextId_ = record.contextId_;
+          if (record.context_)
+            result->context_ = *record.context_;
+          result->backtrace_.assign(record.backtrace_.begin(), record.backtrace_.end());
+          return result;
+        }
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] RecordDecoder::Record record() const noexcept
+        {
+          const RecordHeader& header{ *reinterpret_cast<const RecordHeader*>(bytes_.data()) };
+          return RecordDecoder::Record{ header, entry_, gsl::span<const std::byte>{ bytes_ }.subspan(sizeof(RecordHeader)), contextId_, context_ ? &(*context_) : nullptr, backtrace_, sequence_ };
+        }
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] bool operator<(const Entry& other) const noexcept
+        {
+          return std::tie(timestamp_, sequence_, input_, order_) < std::tie(other.timestamp_, other.sequence_, other.input_, other.order_);
+        }
+      };
+
+      //-----------------------------------------------------------------------
+      RecordMerger(size_type inputs) noexcept :
+        RecordMerger{ inputs, Options{} }
+      {}
+
+      //-----------------------------------------------------------------------
+      RecordMerger(size_type inputs, const Options& options) noexcept :
+        options_{ options },
+        inputs_(inputs)
+      {}
+
+      [[nodiscard]] size_type buffered() const noexcept { return held_.size(); }
+      [[nodiscard]] size_type buffered(size_type input) const noexcept { return inputs_[input].buffered_; }
+      [[nodiscard]] size_type late() const noexcept { return late_; }
+      [[nodiscard]] const RecordDecoder& decoder(size_type input) const noexcept { return inputs_[input].decoder_; }
+
+      //-----------------------------------------------------------------------
+      // decodes the next bytes of input like RecordDecoder::decode and calls
+      // callback(const RecordDecoder::Record&) for every entry, of any input,
+      // whose place in the order is now certain
+      template <typename TCallback>
+      size_type decode(size_type input, gsl::span<const std::byte> bytes, TCallback&& callback) noexcept
+      {
+        auto& source{ inputs_[input] };
+        const size_type consumed{ source.decoder_.decode(bytes, [&](const RecordDecoder::Record& record) noexcept {
+          add(Entry::make(input, ++source.entries_, record));
+        }) };
+        release(callback);
+        return consumed;
+      }
+
+      //-----------------------------------------------------------------------
+      // takes an entry decoded elsewhere; the entries of one input have to
+      // be added in the order they were decoded in
+      void add(std::unique_ptr<Entry> entry) noexcept
+      {
+        auto& source{ inputs_[entry->input_] };
+        source.latest_ = std::max(source.latest_, entry->timestamp_);
+        ++source.buffered_;
+
+        held_.push_back(std::move(entry));
+        std::push_heap(held_.begin(), held_.end(), Later{});
+      }
+
+      //-----------------------------------------------------------------------
+      // input has nothing more to come and no longer holds the others back
+      template <typename TCallback>
+      void finish(size_type input, TCallback&& callback) noexcept
+      {
+        inputs_[input].finished_ = true;
+        release(callback);
+      }
+
+      //-----------------------------------------------------------------------
+      // hands over every entry whose place in the order is certain; returns
+      // how many
+      template <typename TCallback>
+      size_type release(TCallback&& callback) noexcept
+      {
+        std::uint64_t watermark{ UINT64_MAX };
+        for (auto& source : inputs_) {
+          if (!source.finished_)
+            watermark = std::min(watermark, source.latest_);
+        }
+        const auto window{ static_cast<std::uint64_t>(options_.window_.count()) };
+        if (UINT64_MAX != watermark)
+          watermark = watermark > window ? watermark - window : 0;
+
+        size_type result{};
+        for (; (!held_.empty()) && ((held_.front()->timestamp_ < watermark) || (held_.size() > options_.maxBuffered_)); ++result) {
+          pop(callback);
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      // hands over the earliest entry held, certain of its place or not
+      template <typename TCallback>
+      void pop(TCallback&& callback) noexcept
+      {
+        std::pop_heap(held_.begin(), held_.end(), Later{});
+        std::unique_ptr<Entry> entry{ std::move(held_.back()) };
+        held_.pop_back();
+        --inputs_[entry->input_].buffered_;
+
+        if (entry->timestamp_ < emitted_)
+          ++late_;
+        emitted_ = std::max(emitted_, entry->timestamp_);
+
+        callback(entry->record());
+      }
+
+      //-----------------------------------------------------------------------
+      // hands over everything still held
+      template <typename TCallback>
+      void flush(TCallback&& callback) noexcept
+      {
+        while (!held_.empty()) {
+          pop(callback);
+        }
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Input
+      {
+        RecordDecoder decoder_;
+        std::uint64_t latest_{};
+        size_type entries_{};
+        size_type buffered_{};
+        bool finished_{};
+      };
+
+      //-----------------------------------------------------------------------
+      // turns the heap around so that the earliest entry is at the front
+      struct Later
+      {
+        [[nodiscard]] bool operator()(const std::unique_ptr<Entry>& left, const std::unique_ptr<Entry>& right) const noexcept { return *right < *left; }
+      };
+
+    protected:
+      const Options options_;
+      std::vector<Input> inputs_;
+      std::vector<std::unique_ptr<Entry>> held_;    // a heap, earliest first
+      size_type late_{};
+      std::uint64_t emitted_{};
+    };
+
+#ifndef _WIN32
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Follows a log file that is still being written, like tail -f. New bytes
+    // are read and decoded incrementally; a partially written record is kept
+    // until the rest of it arrives. Waiting for growth uses inotify where
+    // available and falls back to sleeping for the timeout elsewhere. A file
+    // that shrinks (truncated by a restarted writer) is followed from the
+    // start again. Bytes that could not be decoded yet are read again on the
+    // next call, so a hole (space reserved by a writer that completes out of
+    // order) is picked up once it is filled.
+    class LogFollower final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      struct Options
+      {
+        bool fromStart_{ true };
+        size_type readSize_{ 1024 * 1024 };
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<LogFollower> open(const char* path) noexcept { return open(path, Options{}); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<LogFollower> open(const char* path, const Options& options) noexcept
+      {
+        std::unique_ptr<LogFollower> result{ new LogFollower(options) };
+        result->fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (result->fd_ < 0)
+          return {};
+
+#ifdef __linux__
+        result->notify_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (result->notify_ >= 0)
+          ::inotify_add_watch(result->notify_, path, IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB);
+#endif //__linux__
+
+        if (!options.fromStart_) {
+          // start at the end but still pick up every schema record on the way
+          result->skip_ = true;
+          result->pump([](const RecordDecoder::Record&) noexcept {});
+          result->skip_ = false;
+        }
+        return result;
+      }
+
+      LogFollower(const LogFollower&) noexcept = delete;
+      LogFollower& operator=(const LogFollower&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      ~LogFollower() noexcept
+      {
+        if (notify_ >= 0)
+          ::close(notify_);
+        if (fd_ >= 0)
+          ::close(fd_);
+      }
+
+      [[nodiscard]] const RecordDecoder& decoder() const noexcept { return decoder_; }
+      [[nodiscard]] ::off_t offset() const noexcept { return offset_; }
+
+      //-----------------------------------------------------------------------
+      // decodes every record committed since the last call, waiting at most
+      // timeout for the file to grow if there are none; returns the number
+      // of records handed to callback(const RecordDecoder::Record&)
+      template <typename TCallback>
+      size_type follow(TCallback&& callback, std::chrono::milliseconds timeout = std::chrono::milliseconds{}) noexcept
+      {
+        size_type result{ pump(callback) };
+        if ((0 != result) || (timeout.count() <= 0))
+          return result;
+
+        const auto deadline{ std::chrono::steady_clock::now() + timeout };
+        while (0 == result) {
+          const auto now{ std::chrono::steady_clock::now() };
+          if (now >= deadline)
+            break;
+          wait(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds{ 1 });
+          result = pump(callback);
+        }
+        return result;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      LogFollower(const Options& options) noexcept :
+        options_{ options }
+      {}
+
+      //-----------------------------------------------------------------------
+      // the most read ahead of what could be decoded: a complete record at
+      // most, what lies past a hole is read again once it is filled anyway
+      [[nodiscard]] size_type maxBuffered() const noexcept { return maxDecodedRecordSize() + options_.readSize_; }
+
+      //-----------------------------------------------------------------------
+      template <typename TCallback>
+      size_type pump(TCallback&& callback) noexcept
+      {
+        struct ::stat info {};
+        if (0 != ::fstat(fd_, &info))
+          return 0;
+
+        if (info.st_size < offset_) {
+          offset_ = 0;
+          decoder_.reset();
+        }
+
+        size_type result{};
+        while (true) {
+          const size_type used{ buffer_.size() };
+          buffer_.resize(used + options_.readSize_);
+          const auto read{ ::pread(fd_, buffer_.data() + used, options_.readSize_, offset_ + static_cast<::off_t>(used)) };
+          buffer_.resize(used + static_cast<size_type>(std::max<::ssize_t>(read, 0)));
+          if (read < 0 && (EINTR == errno))
+            continue;
+          if (read <= 0)
+            break;
+
+          const size_type consumed{ decoder_.decode(buffer_, [&](const RecordDecoder::Record& record) noexcept {
+            ++result;
+            if (!skip_)
+              callback(record);
+          }) };
+          buffer_.erase(buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>(consumed));
+          offset_ += static_cast<::off_t>(consumed);
+
+          // stuck at a hole (zeroed header) or holding too much: nothing past
+          // it can be decoded before it is filled
+          if ((buffer_.size() >= sizeof(RecordHeader)) && (0 == reinterpret_cast<const RecordHeader*>(buffer_.data())->size_))
+            break;
+          if (buffer_.size() >= maxBuffered())
+            break;
+        }
+
+        // whatever was not decoded is read again next time, it may have been
+        // written to since
+        buffer_.clear();
+        return skip_ ? 0 : result;
+      }
+
+      //-----------------------------------------------------------------------
+      void wait(std::chrono::milliseconds timeout) noexcept
+      {
+        if (notify_ < 0) {
+          std::this_thread::sleep_for(std::min(timeout, std::chrono::milliseconds{ 100 }));
+          return;
+        }
+
+        ::pollfd wait{ notify_, POLLIN, 0 };
+        if (::poll(&wait, 1, static_cast<int>(timeout.count())) <= 0)
+          return;
+
+        // the events only say that something changed, the file is re-read anyway
+        std::byte events[4096];
+        while (::read(notify_, events, sizeof(events)) > 0) {}
+      }
+
+    protected:
+      const Options options_;
+      int fd_{ -1 };
+      int notify_{ -1 };
+      bool skip_{};
+
+      RecordDecoder decoder_{ RecordDecoder::Input::Live };
+      std::vector<std::byte> buffer_;       // read but not yet decoded, only while pumping
+      ::off_t offset_{};                    // file offset of buffer_
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Decodes complete log files (segments) on several threads and hands
+    // their entries over on the calling thread in the order of a
+    // RecordMerger. A segment is decoded readSize_ bytes at a time by one
+    // worker at a time, since its schema, context and fragment state only
+    // make sense in order; the workers move on to whichever segment most
+    // holds back the merge. A segment stops being decoded ahead while it has
+    // its share of the merge's maxBuffered_ entries decoded but not handed
+    // over yet, so memory stays bounded however large the files are. Should
+    // every segment be at its share without the merge being able to go on,
+    // the earliest entry goes out anyway.
+    class ParallelDecoder final
+    {
+    public:
+      using size_type = zs::size_type;
+      using Entry = RecordMerger::Entry;
+
+      struct Options
+      {
+        size_type threads_{};                           // 0 for one per hardware thread
+        size_type readSize_{ 4 * 1024 * 1024 };
+        RecordMerger::Options merge_;
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<ParallelDecoder> open(const std::vector<std::string>& paths) noexcept { return open(paths, Options{}); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<ParallelDecoder> open(const std::vector<std::string>& paths, const Options& options) noexcept
+      {
+        std::unique_ptr<ParallelDecoder> result{ new ParallelDecoder(paths.size(), options) };
+        for (size_type index{}; index < paths.size(); ++index) {
+          result->segments_[index].fd_ = ::open(paths[index].c_str(), O_RDONLY | O_CLOEXEC);
+          if (result->segments_[index].fd_ < 0)
+            return {};
+        }
+        return result;
+      }
+
+      ParallelDecoder(const ParallelDecoder&) noexcept = delete;
+      ParallelDecoder& operator=(const ParallelDecoder&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      ~ParallelDecoder() noexcept
+      {
+        for (auto& segment : segments_) {
+          if (segment.fd_ >= 0)
+            ::close(segment.fd_);
+        }
+      }
+
+      [[nodiscard]] size_type late() const noexcept { return merger_.late(); }
+      [[nodiscard]] const RecordDecoder& decoder(size_type segment) const noexcept { return segments_[segment].decoder_; }
+
+      //-----------------------------------------------------------------------
+      // the most a segment holds read but not decoded: a complete record
+      // at most, anything beyond is counted corrupt and skipped
+      [[nodiscard]] size_type maxBuffered() const noexcept { return maxDecodedRecordSize() + options_.readSize_; }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] size_type corrupt() const noexcept
+      {
+        size_type result{};
+        for (auto& segment : segments_) {
+          result += segment.decoder_.corrupt();
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      // blocks that could not be verified, decoder(segment).damaged() says where
+      [[nodiscard]] size_type damaged() const noexcept
+      {
+        size_type result{};
+        for (auto& segment : segments_) {
+          result += segment.decoder_.damaged().size();
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      // decodes every segment to its end, calling callback(const RecordDecoder::Record&)
+      // for each entry; returns the number of entries
+      template <typename TCallback>
+      size_type run(TCallback&& callback) noexcept
+      {
+        size_type result{};
+        auto counted{ [&](const RecordDecoder::Record& record) noexcept { ++result; callback(record); } };
+
+        size_type threads{ 0 != options_.threads_ ? options_.threads_ : std::max<size_type>(std::thread::hardware_concurrency(), 1) };
+        threads = std::max<size_type>(std::min(threads, segments_.size()), 1);
+        std::vector<std::thread> workers;
+        for (size_type index{}; index < threads; ++index) {
+          workers.emplace_back([this]() noexcept { work(); });
+        }
+
+        std::vector<std::unique_ptr<Entry>> decoded;
+        std::vector<size_type> finished;
+        while (true) {
+          {
+            std::unique_lock lock{ mutex_ };
+            wake_.wait(lock, [&]() noexcept { return ready_ || ((0 == busy_) && (!runnable())); });
+            ready_ = false;
+            for (auto& segment : segments_) {
+              std::move(segment.decoded_.begin(), segment.decoded_.end(), std::back_inserter(decoded));
+              segment.decoded_.clear();
+              if (segment.ended_ && (!segment.finished_)) {
+                segment.finished_ = true;
+                finished.push_back(static_cast<size_type>(&segment - segments_.data()));
+              }
+            }
+          }
+
+          for (auto& entry : decoded) {
+            merger_.add(std::move(entry));
+          }
+          for (auto segment : finished) {
+            merger_.finish(segment, counted);
+          }
+          const bool progress{ (!decoded.empty()) || (!finished.empty()) || (0 != merger_.release(counted)) };
+          decoded.clear();
+          finished.clear();
+
+          std::unique_lock lock{ mutex_ };
+          for (size_type index{}; index < segments_.size(); ++index) {
+            segments_[index].held_ = merger_.buffered(index);
+          }
+          if ((0 == busy_) && (!runnable()) && (!ready_)) {
+            if (std::all_of(segments_.begin(), segments_.end(), [](const Segment& segment) noexcept { return segment.finished_; }))
+              break;
+            if ((!progress) && (0 != merger_.buffered())) {
+              lock.unlock();
+              merger_.pop(counted);
+              lock.lock();
+              for (size_type index{}; index < segments_.size(); ++index) {
+                segments_[index].held_ = merger_.buffered(index);
+              }
+            }
+          }
+          work_.notify_all();
+        }
+
+        {
+          std::lock_guard lock{ mutex_ };
+          stopping_ = true;
+        }
+        work_.notify_all();
+        for (auto& worker : workers) {
+          worker.join();
+        }
+        merger_.flush(counted);
+        return result;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      ParallelDecoder(size_type segments, const Options& options) noexcept :
+        options_{ options },
+        segments_(segments),
+        merger_{ segments, options.merge_ },
+        share_{ std::max<size_type>(options.merge_.maxBuffered_ / std::max<size_type>(segments, 1), 1) }
+      {}
+
+      //-----------------------------------------------------------------------
+      struct Segment
+      {
+        int fd_{ -1 };
+        ::off_t offset_{};
+        RecordDecoder decoder_{ RecordDecoder::Input::Complete };
+        std::vector<std::byte> buffer_;     // read but not yet decoded
+        size_type entries_{};
+
+        // guarded by mutex_
+        std::uint64_t latest_{};
+        std::vector<std::unique_ptr<Entry>> decoded_;
+        size_type held_{};                  // entries of this segment in the merger
+        bool busy_{};
+        bool ended_{};
+        bool finished_{};                   // the merger was told
+      };
+
+      //-----------------------------------------------------------------------
+      // the segment a worker should decode next: the one with the earliest
+      // entries so far, it holds back the merge most
+      [[nodiscard]] Segment* next() noexcept
+      {
+        Segment* result{ nullptr };
+        for (auto& segment : segments_) {
+          if (segment.busy_ || segment.ended_ || (segment.decoded_.size() + segment.held_ >= share_))
+            continue;
+          if ((!result) || (segment.latest_ < result->latest_))
+            result = &segment;
+        }
+        return result;
+      }
+
+      [[nodiscard]] bool runnable() noexcept { return nullptr != next(); }
+
+      //-----------------------------------------------------------------------
+      void work() noexcept
+      {
+        std::unique_lock lock{ mutex_ };
+        while (true) {
+          Segment* segment{ nullptr };
+          work_.wait(lock, [&]() noexcept { return stopping_ || (nullptr != (segment = next())); });
+          if (stopping_)
+            return;
+
+          segment->busy_ = true;
+          ++busy_;
+          lock.unlock();
+
+          std::vector<std::unique_ptr<Entry>> decoded;
+          std::uint64_t latest{ segment->latest_ };
+          const bool ended{ decode(*segment, decoded, latest) };
+
+          lock.lock();
+          std::move(decoded.begin(), decoded.end(), std::back_inserter(segment->decoded_));
+          segment->latest_ = latest;
+          segment->ended_ = ended;
+          segment->busy_ = false;
+          --busy_;
+          ready_ = true;
+          wake_.notify_all();
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // decodes the next readSize_ bytes of segment; returns true at its end
+      [[nodiscard]] bool decode(Segment& segment, std::vector<std::unique_ptr<Entry>>& decoded, std::uint64_t& latest) noexcept
+      {
+        const size_type input{ static_cast<size_type>(&segment - segments_.data()) };
+        const size_type used{ segment.buffer_.size() };
+        segment.buffer_.resize(used + options_.readSize_);
+        ::ssize_t read{};
+        do {
+          read = ::pread(segment.fd_, segment.buffer_.data() + used, options_.readSize_, segment.offset_ + static_cast<::off_t>(used));
+        } while ((read < 0) && (EINTR == errno));
+        segment.buffer_.resize(used + static_cast<size_type>(std::max<::ssize_t>(read, 0)));
+        if (read <= 0) {
+          segment.decoder_.finish(segment.buffer_);
+          segment.buffer_.clear();
+          return true;
+        }
+
+        const size_type consumed{ segment.decoder_.decode(segment.buffer_, [&](const RecordDecoder::Record& record) noexcept {
+          decoded.push_back(Entry::make(input, ++segment.entries_, record));
+          latest = std::max(latest, record.header_.timestamp_);
+        }) };
+        segment.buffer_.erase(segment.buffer_.begin(), segment.buffer_.begin() + static_cast<std::ptrdiff_t>(consumed));
+        segment.offset_ += static_cast<::off_t>(consumed);
+
+        // the decoder rejects records this large, so no more is held on to
+        // than the header it is stuck at
+        if (segment.buffer_.size() >= maxBuffered()) {
+          const size_type dropped{ (segment.buffer_.size() - sizeof(RecordHeader)) & ~(recordAlignment() - 1) };
+          segment.decoder_.skip(gsl::span<const std::byte>{ segment.buffer_.data(), dropped });
+          segment.buffer_.erase(segment.buffer_.begin(), segment.buffer_.begin() + static_cast<std::ptrdiff_t>(dropped));
+          segment.offset_ += static_cast<::off_t>(dropped);
+        }
+        return false;
+      }
+
+    protected:
+      const Options options_;
+      std::vector<Segment> segments_;
+      RecordMerger merger_;                 // only used by the thread calling run()
+      const size_type share_{};
+
+      std::mutex mutex_;
+      std::condition_variable work_;
+      std::condition_variable wake_;
+      size_type busy_{};
+      bool ready_{};
+      bool stopping_{};
+    };
+
+#endif //_WIN32
+
+  } // namespace log
+} // namespace zs
@@ -0,0 +1,363 @@
+#pragma once
+
+#include "LogTransport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace zs
+{
+  namespace log
+  {
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(1000 * 1000 * 1000)> maxRepeatRunAge;   // nanoseconds a count may be held back
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(4096)> maxRepeatSites;                  // per thread
+
+    //-------------------------------------------------------------------------
+    // payload of a RecordKind::Repeat record, whose entry_ is the call site
+    // and whose timestamp_ is that of the last entry counted
+    struct RepeatRecord
+    {
+      std::uint64_t count_{};     // entries dropped since the last one written
+      std::uint64_t first_{};     // timestamp of the first of them
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Collapses runs of identical entries (retry loops, reconnect storms). A
+    // thread remembers the parameters of the last entry it wrote per call
+    // site; an entry whose parameters and context are byte for byte the same
+    // is not committed but counted, and the count goes out as one Repeat
+    // record once the site logs something different, once the run has been
+    // held for maxRepeatRunAge or when the thread exits. The drain writes the
+    // counts of a thread that stopped logging on its behalf, once they are
+    // as old or when it is flushed. Entries are compared by hash first and
+    // memcmp second. Entries that reference blobs, are fragmented or go to
+    // the urgent ring are always written.
+    class Repeats final
+    {
+    public:
+      //-----------------------------------------------------------------------
+      // off by default
+      static void enable(bool value) noexcept { enabled_().store(value, std::memory_order_relaxed); }
+      [[nodiscard]] static bool enabled() noexcept { return enabled_().load(std::memory_order_relaxed); }
+
+      //-----------------------------------------------------------------------
+      // record is finished but not committed yet and its parameters are
+      // [params, end); returns the record to commit, which moved if a count
+      // had to be written first, or nullptr if it repeats the previous entry
+      // of its call site
+      [[nodiscard]] static std::byte* check(Ring& ring, std::byte* record, const std::byte* params, const std::byte* end) noexcept
+      {
+        Sites& sites{ local() };
+        std::lock_guard lock{ sites.mutex_ };
+        return sites.check(ring, record, params, end);
+      }
+
+      //-----------------------------------------------------------------------
+      // writes the counts held back for too long; not while a record is
+      // reserved
+      static void settle() noexcept
+      {
+        Sites& sites{ local() };
+        std::lock_guard lock{ sites.mutex_ };
+        if (sites.stale_)
+          sites.settle(false);
+      }
+
+      //-----------------------------------------------------------------------
+      // writes every count the calling thread holds back
+      static void flush() noexcept
+      {
+        Sites& sites{ local() };
+        std::lock_guard lock{ sites.mutex_ };
+        sites.settle(true);
+      }
+
+      //-----------------------------------------------------------------------
+      // for the drain: the Repeat records of every thread's counts held back
+      // for maxRepeatRunAge by now, or all of them, go to
+      // write(std::vector<std::byte>&&) instead of the thread's ring. A count
+      // is only taken while scanned(const Ring&) says everything committed
+      // to its ring has been read, which puts it after the entry it
+      // repeats; a thread busy logging is left to settle its own.
+      template <typename TScanned, typename TWrite>
+      static void collect(bool all, std::uint64_t now, TScanned&& scanned, TWrite&& write) noexcept
+      {
+        Registry& registry{ Registry::singleton() };
+        std::lock_guard lock{ registry.mutex_ };
+        for (Sites* sites : registry.sites_) {
+          std::unique_lock guard{ sites->mutex_, std::try_to_lock };
+          if (!guard.owns_lock())
+            continue;
+          sites->settle(all, now, [&](Run& run) noexcept {
+            if (!scanned(static_cast<const Ring&>(*run.ring_)))
+              return false;
+            std::vector<std::byte> record(RecordHeader::recordSize(sizeof(RepeatRecord)));
+            encode(run, record.data());
+            write(std::move(record));
+            return true;
+          });
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::uint64_t hash(const std::byte* data, size_type size, std::uint64_t seed) noexcept
+      {
+        constexpr std::uint64_t multiplier{ 0x9e3779b97f4a7c15ull };
+        std::uint64_t result{ seed ^ (size * multiplier) };
+        while (size >= sizeof(std::uint64_t)) {
+          std::uint64_t word;
+          memcpy(&word, data, sizeof(word));
+          result = (result ^ word) * multiplier;
+          result ^= result >> 29;
+          data += sizeof(word);
+          size -= sizeof(word);
+        }
+        if (0 != size) {
+          std::uint64_t word{};
+          memcpy(&word, data, size);
+          result = (result ^ word) * multiplier;
+          result ^= result >> 29;
+        }
+        return result;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Run
+      {
+        std::uint64_t site_{};
+        Ring* ring_{ nullptr };
+        std::uint64_t hash_{};
+        std::uint64_t context_{};
+        std::vector<std::byte> params_;         // of the last entry written
+        std::uint64_t count_{};
+        std::uint64_t first_{};
+        std::uint64_t last_{};
+      };
+
+      //-----------------------------------------------------------------------
+      // the Repeat record of run, RecordHeader::recordSize(sizeof(RepeatRecord)) bytes
+      static void encode(const Run& run, std::byte* record) noexcept
+      {
+        RecordHeader& header{ *reinterpret_cast<RecordHeader*>(record) };
+        header.size_ = static_cast<std::uint32_t>(RecordHeader::recordSize(sizeof(RepeatRecord)));
+        header.kind_ = RecordKind::Repeat;
+        header.flags_ = 0;
+        header.entry_ = run.site_;
+        header.timestamp_ = run.last_;
+        const RepeatRecord repeat{ run.count_, run.first_ };
+        memcpy(record + sizeof(RecordHeader), &repeat, sizeof(repeat));
+      }
+
+      struct Sites;
+
+      //-----------------------------------------------------------------------
+      // every thread's Sites, for the drain to settle idle threads' counts
+      struct Registry
+      {
+        std::mutex mutex_;
+        std::vector<Sites*> sites_;
+
+        [[nodiscard]] static Registry& singleton() noexcept
+        {
+          static Registry gRegistry;
+          return gRegistry;
+        }
+      };
+
+      //-----------------------------------------------------------------------
+      struct Sites
+      {
+        std::mutex mutex_;                      // held by the owning thread while counting, tried by the drain
+        std::unordered_map<std::uint64_t, Run> runs_;
+        std::uint64_t site_{};
+        Run* last_{ nullptr };                  // run of site_
+        std::vector<std::byte> moved_;
+        size_type pending_{};                   // runs with a count
+        std::uint64_t oldest_{};                // no later than the first_ of any of them
+        std::uint64_t now_{};                   // timestamp of the latest entry checked
+        bool stale_{};
+
+        //---------------------------------------------------------------------
+        Sites() noexcept
+        {
+          Registry& registry{ Registry::singleton() };
+          std::lock_guard lock{ registry.mutex_ };
+          registry.sites_.push_back(this);
+        }
+
+        //---------------------------------------------------------------------
+        ~Sites() noexcept
+        {
+          {
+            Registry& registry{ Registry::singleton() };
+            std::lock_guard lock{ registry.mutex_ };
+            std::erase(registry.sites_, this);
+          }
+          settle(true);
+        }
+
+        Sites(const Sites&) noexcept = delete;
+        Sites& operator=(const Sites&) noexcept = delete;
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] std::byte* check(Ring& ring, std::byte* record, const std::byte* params, const std::byte* end) noexcept
+        {
+          const RecordHeader& header{ *reinterpret_cast<const RecordHeader*>(record) };
+          std::uint64_t context{};
+          if (0 != (header.flags_ & recordFlagContext()))
+            memcpy(&context, header.payload(), sizeof(context));
+          const size_type size{ static_cast<size_type>(end - params) };
+          const std::uint64_t hash{ Repeats::hash(params, size, context) };
+          now_ = header.timestamp_;
+          stale_ = (0 != pending_) && (now_ - oldest_ >= maxRepeatRunAge());
+
+          Run* found{ find(header.entry_) };
+          if (!found)
+            return record;
+          Run& run{ *found };
+          if ((&ring == run.ring_) && (hash == run.hash_) && (context == run.context_) && (size == run.params_.size()) && (0 == memcmp(params, run.params_.data(), size))) {
+            if (0 == run.count_++) {
+              run.first_ = now_;
+              if (0 == pending_++)
+                oldest_ = now_;
+            }
+            run.last_ = now_;
+            return nullptr;
+          }
+
+          std::byte* result{ record };
+          if (0 != run.count_) {
+            // the count goes ahead of the record, which is still only reserved
+            moved_.assign(record, record + header.size_);
+            write(run);
+            result = ring.reserve(moved_.size());
+            if (result)
+              memcpy(result, moved_.data(), moved_.size());
+          }
+          run.ring_ = &ring;
+          run.hash_ = hash;
+          run.context_ = context;
+          run.params_.assign(params, end);
+          return result;
+        }
+
+        //---------------------------------------------------------------------
+        // nullptr if the site is not tracked, too many of them are counting
+        [[nodiscard]] Run* find(std::uint64_t site) noexcept
+        {
+          if (last_ && (site == site_))
+            return last_;
+          auto found{ runs_.find(site) };
+          if (found == runs_.end()) {
+            if (runs_.size() >= maxRepeatSites())
+              std::erase_if(runs_, [](const auto& item) noexcept { return 0 == item.second.count_; });
+            if (runs_.size() >= maxRepeatSites())
+              return nullptr;
+            found = runs_.try_emplace(site).first;
+            found->second.site_ = site;
+          }
+          site_ = site;
+          last_ = &(found->second);
+          return last_;
+        }
+
+        //---------------------------------------------------------------------
+        void write(Run& run) noexcept
+        {
+          commit(run);
+          run.count_ = 0;
+          --pending_;
+        }
+
+        //---------------------------------------------------------------------
+        static void commit(const Run& run) noexcept
+        {
+          std::byte* record{ run.ring_->reserve(RecordHeader::recordSize(sizeof(RepeatRecord))) };
+          if (record) {
+            encode(run, record);
+            run.ring_->commit(RecordHeader::recordSize(sizeof(RepeatRecord)));
+          }
+        }
+
+        //---------------------------------------------------------------------
+        // the runs held back for maxRepeatRunAge by now_, or all of them
+        void settle(bool all) noexcept
+        {
+          settle(all, now_, [](Run& run) noexcept {
+            commit(run);
+            return true;
+          });
+        }
+
+        //---------------------------------------------------------------------
+        // as above by now, handing each run to write(Run&), which returns
+        // false if it could not be written this time
+        template <typename TWrite>
+        void settle(bool all, std::uint64_t now, TWrite&& write) noexcept
+        {
+          stale_ = false;
+          if (0 == pending_)
+            return;
+          std::uint64_t oldest{ UINT64_MAX };
+          for (auto& [site, run] : runs_) {
+            if (0 == run.count_)
+              continue;
+            if ((all || (now - run.first_ >= maxRepeatRunAge())) && write(run)) {
+              run.count_ = 0;
+              --pending_;
+              continue;
+            }
+            oldest = std::min(oldest, run.first_);
+          }
+          oldest_ = oldest;
+        }
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static Sites& local() noexcept
+      {
+        thread_local Sites sites;
+        return sites;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::atomic_bool& enabled_() noexcept
+      {
+        static std::atomic_bool gEnabled{};
+        return gEnabled;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    // the counts go after everything scanned, so only those of rings drained
+    // here and read up to their head are taken
+    inline void Drain::settleRepeats(bool all) noexcept
+    {
+      if (sinks_.empty())
+        return;
+      auto scanned{ [this](const Ring& ring) noexcept {
+        for (auto& source : sources_) {
+          if (source.ring_.get() == &ring)
+            return source.scan_ == ring.head();
+        }
+        return false;
+      } };
+      Repeats::collect(all, RecordHeader::now(), scanned, [this](std::vector<std::byte>&& record) noexcept {
+        if (pending_.empty())
+          pendingSince_ = clock_type::now();
+        repeats_.push_back(std::move(record));
+        pending_.add(*reinterpret_cast<const RecordHeader*>(repeats_.back().data()));
+      });
+    }
+
+  } // namespace log
+} // namespace zs
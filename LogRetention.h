@@ -0,0 +1,339 @@
+#pragma once
+
+#include "log.h"
+#include "LogContext.h"
+#include "LogSchema.h"
+#include "LogTransport.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Holds back the entries logged within a context (see LogContext) until
+    // the context proves worth keeping. Entries below threshold_ are kept in
+    // memory, in a window per value of the key_ context field (a request id,
+    // say), together with the context records describing them. The first
+    // entry at or above threshold_ writes the window to the next sink ahead
+    // of itself, and the rest of the context goes straight through. A context
+    // that ends without one (see recordFlagEnded) is discarded, and so are
+    // the oldest windows once more than maxHeldBytes_ are held; the rest of
+    // an evicted context is counted as evicted too, bar entries at or above
+    // threshold_, until it ends. Records logged outside any context pass
+    // through untouched.
+    class RetentionSink : public Sink
+    {
+    public:
+      struct Options
+      {
+        Severity threshold_{ Severity::Warning };
+        std::string key_;                               // the field naming the window, the outermost one if empty
+        size_type maxHeldBytes_{ 64 * 1024 * 1024 };
+      };
+
+      //-----------------------------------------------------------------------
+      RetentionSink(std::shared_ptr<Sink> next) noexcept : RetentionSink(std::move(next), Options{}) {}
+
+      //-----------------------------------------------------------------------
+      RetentionSink(std::shared_ptr<Sink> next, const Options& options) noexcept :
+        next_{ std::move(next) },
+        options_{ options }
+      {}
+
+      [[nodiscard]] size_type held() const noexcept { return heldBytes_; }
+      [[nodiscard]] size_type released() const noexcept { return released_; }
+      [[nodiscard]] size_type discarded() const noexcept { return discarded_; }
+      [[nodiscard]] size_type evicted() const noexcept { return evicted_; }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool ready(const Batch& pending, clock_type::duration age) const noexcept override { return next_->ready(pending, age); }
+
+      //-----------------------------------------------------------------------
+      void write(const Batch& batch) noexcept override
+      {
+        size_type index{};
+        while (index < batch.records_.size()) {
+          size_type end{ index + 1 };
+          while ((end < batch.records_.size()) && batch.continued_[end]) {
+            ++end;
+          }
+          route(batch, index, end);
+          index = end;
+        }
+        evict();
+
+        if (!output_.empty())
+          next_->write(output_);
+        output_.clear();
+        releasedBytes_.clear();
+      }
+
+      //-----------------------------------------------------------------------
+      void flush() noexcept override { next_->flush(); }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Window
+      {
+        std::vector<std::byte> bytes_;          // held records, back to back
+        std::vector<std::uint64_t> ids_;        // context records naming the window
+        size_type entries_{};
+        std::uint64_t generation_{};
+        bool released_{};
+      };
+
+      //-----------------------------------------------------------------------
+      // the record in spans [first, last) of batch
+      void route(const Batch& batch, size_type first, size_type last) noexcept
+      {
+        const RecordHeader& header{ *reinterpret_cast<const RecordHeader*>(batch.records_[first].data()) };
+        switch (header.kind_) {
+          case RecordKind::Schema: {
+            std::vector<SchemaEntry> entries;
+            if (SchemaReader::decode(batch.records_[first].subspan(sizeof(RecordHeader)), entries)) {
+              for (auto& entry : entries) {
+                severities_.insert_or_assign(entry.id_, entry.severity_);
+              }
+            }
+            break;
+          }
+          case RecordKind::Context: {
+            if (0 != (header.flags_ & recordFlagEnded())) {
+              if (!ended(header.entry_))
+                return;
+              break;
+            }
+            Window* window{ open(header.entry_, batch.records_[first].subspan(sizeof(RecordHeader), header.payloadSize())) };
+            if (window && !window->released_)
+              return hold(*window, batch, first, last, 0);
+            break;
+          }
+          case RecordKind::Entry:
+          case RecordKind::Batch: {
+            if (0 == (header.flags_ & recordFlagContext()))
+              break;
+            std::uint64_t contextId{};
+            memcpy(&contextId, header.payload(), sizeof(contextId));
+            auto id{ ids_.find(contextId) };
+            if (id == ids_.end()) {
+              if ((0 == evictedIds_.count(contextId)) || releases(header))
+                break;
+              evicted_ += entries(header);
+              if (0 != (header.flags_ & recordFlagContinued())) {
+                std::uint64_t chain{};
+                memcpy(&chain, header.payload() + header.prefixSize(), sizeof(chain));
+                evictedChains_.insert(chain);
+              }
+              return;
+            }
+            Window& window{ windows_[id->second] };
+            if (window.released_)
+              break;
+
+            if (releases(header)) {
+              release(window);
+              break;
+            }
+            if (0 != (header.flags_ & recordFlagContinued())) {
+              std::uint64_t chain{};
+              memcpy(&chain, header.payload() + header.prefixSize(), sizeof(chain));
+              chains_.insert_or_assign(chain, id->second);
+            }
+            return hold(window, batch, first, last, entries(header));
+          }
+          case RecordKind::Fragment: {
+            if (auto evicted{ evictedChains_.find(header.entry_) }; evicted != evictedChains_.end()) {
+              if (0 == (header.flags_ & recordFlagContinued()))
+                evictedChains_.erase(evicted);
+              return;
+            }
+            auto chain{ chains_.find(header.entry_) };
+            if (chain == chains_.end())
+              break;
+            auto window{ windows_.find(chain->second) };
+            if (0 == (header.flags_ & recordFlagContinued()))
+              chains_.erase(chain);
+            if (window == windows_.end())
+              return;
+            if (!window->second.released_)
+              return hold(window->second, batch, first, last, 0);
+            break;
+          }
+          default:  break;
+        }
+        pass(batch, first, last);
+      }
+
+      //-----------------------------------------------------------------------
+      void pass(const Batch& batch, size_type first, size_type last) noexcept
+      {
+        for (size_type index{ first }; index < last; ++index) {
+          output_.add(batch.records_[index], batch.continued_[index]);
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void hold(Window& window, const Batch& batch, size_type first, size_type last, size_type entries) noexcept
+      {
+        for (size_type index{ first }; index < last; ++index) {
+          window.bytes_.insert(window.bytes_.end(), batch.records_[index].begin(), batch.records_[index].end());
+          heldBytes_ += batch.records_[index].size();
+        }
+        window.entries_ += entries;
+      }
+
+      //-----------------------------------------------------------------------
+      // whether the entry is severe enough to write its window
+      [[nodiscard]] bool releases(const RecordHeader& header) const noexcept
+      {
+        auto severity{ severities_.find(header.entry_) };
+        return (severity != severities_.end()) && (severity->second >= options_.threshold_);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static size_type entries(const RecordHeader& header) noexcept
+      {
+        if (RecordKind::Batch != header.kind_)
+          return 1;
+        BatchRecord batch;
+        if (header.payloadSize() < header.prefixSize() + sizeof(batch))
+          return 0;
+        memcpy(&batch, header.payload() + header.prefixSize(), sizeof(batch));
+        return batch.count_;
+      }
+
+      //-----------------------------------------------------------------------
+      // the window of a context record, nullptr if it has no key
+      [[nodiscard]] Window* open(std::uint64_t id, gsl::span<const std::byte> payload) noexcept
+      {
+        std::vector<ContextField> fields;
+        if (!LogContext::decode(payload, fields))
+          return nullptr;
+
+        const ContextField* key{ nullptr };
+        for (auto& field : fields) {
+          if (options_.key_.empty() || (field.key_ == options_.key_)) {
+            key = &field;
+            break;
+          }
+        }
+        if (!key)
+          return nullptr;
+
+        auto [found, added]{ windows_.try_emplace(key->value_) };
+        Window& window{ found->second };
+        if (added) {
+          window.generation_ = ++generation_;
+          order_.emplace_back(key->value_, window.generation_);
+        }
+        window.ids_.push_back(id);
+        ids_.insert_or_assign(id, key->value_);
+        return &window;
+      }
+
+      //-----------------------------------------------------------------------
+      // moves the window's records into the output, ahead of whatever comes next
+      void release(Window& window) noexcept
+      {
+        window.released_ = true;
+        released_ += window.entries_;
+        heldBytes_ -= window.bytes_.size();
+        if (window.bytes_.empty())
+          return;
+
+        auto& bytes{ releasedBytes_.emplace_back(std::move(window.bytes_)) };
+        size_type pos{};
+        while (pos < bytes.size()) {
+          const RecordHeader& header{ *reinterpret_cast<const RecordHeader*>(bytes.data() + pos) };
+          output_.add(header);
+          pos += header.size_;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // returns true if the end of the context is worth passing on, which it
+      // is once the window was written
+      [[nodiscard]] bool ended(std::uint64_t id) noexcept
+      {
+        auto found{ ids_.find(id) };
+        if (found == ids_.end())
+          return 0 == evictedIds_.erase(id);
+        auto window{ windows_.find(found->second) };
+        if (window == windows_.end())
+          return true;
+        const bool released{ window->second.released_ };
+        close(window);
+        return released;
+      }
+
+      //-----------------------------------------------------------------------
+      void close(std::unordered_map<std::string, Window>::iterator window) noexcept
+      {
+        if (!window->second.released_) {
+          discarded_ += window->second.entries_;
+          heldBytes_ -= window->second.bytes_.size();
+        }
+        for (auto id : window->second.ids_) {
+          ids_.erase(id);
+        }
+        windows_.erase(window);
+      }
+
+      //-----------------------------------------------------------------------
+      // the oldest windows go first; order_ may still name windows that were
+      // closed (or closed and opened again) since
+      void evict() noexcept
+      {
+        while ((heldBytes_ > options_.maxHeldBytes_) && (!order_.empty())) {
+          auto [key, generation]{ std::move(order_.front()) };
+          order_.pop_front();
+          auto window{ windows_.find(key) };
+          if ((window == windows_.end()) || (window->second.generation_ != generation) || window->second.released_)
+            continue;
+          evicted_ += window->second.entries_;
+          window->second.entries_ = 0;
+          evictedIds_.insert(window->second.ids_.begin(), window->second.ids_.end());
+          close(window);
+        }
+        if (order_.size() > 2 * windows_.size() + 1024) {
+          std::erase_if(order_, [&](const auto& item) noexcept {
+            auto window{ windows_.find(item.first) };
+            return (window == windows_.end()) || (window->second.generation_ != item.second);
+          });
+        }
+      }
+
+    protected:
+      std::shared_ptr<Sink> next_;
+      const Options options_;
+
+      std::unordered_map<std::uint64_t, Severity> severities_;      // of every call site described
+      std::unordered_map<std::string, Window> windows_;
+      std::unordered_map<std::uint64_t, std::string> ids_;          // context id to window key
+      std::unordered_map<std::uint64_t, std::string> chains_;       // fragment chains started by held entries
+      std::unordered_set<std::uint64_t> evictedIds_;                // contexts still open whose window was evicted
+      std::unordered_set<std::uint64_t> evictedChains_;             // fragment chains started in those
+      std::deque<std::pair<std::string, std::uint64_t>> order_;     // key and generation, oldest window first
+      std::uint64_t generation_{};
+
+      Batch output_;
+      std::deque<std::vector<std::byte>> releasedBytes_;            // windows released by the batch being written
+      size_type heldBytes_{};
+      size_type released_{};
+      size_type discarded_{};
+      size_type evicted_{};
+    };
+
+  } // namespace log
+} // namespace zs
@@ -0,0 +1,418 @@
+
+#pragma once
+
+#include "log.h"
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Owning copy of a MetaDataTypeInfo as read back from a schema record.
+    struct SchemaType
+    {
+      using size_type = zs::size_type;
+
+      std::string typeName_;
+      std::string paramName_;
+      bool isIntegral_{};
+      bool isSigned_{};
+      bool isFloatingPoint_{};
+      size_type elementWidth_{};
+      size_type totalElements_{};
+      size_type totalSubEntries_{};
+
+      constexpr bool isArray() const noexcept { return (0 == totalElements_) || (totalElements_ > 1); }
+      constexpr bool isArrayVariableSized() const noexcept { return 0 == totalElements_; }
+      constexpr bool hasSubEntries() const noexcept { return 0 != totalSubEntries_; }
+
+      [[nodiscard]] bool operator==(const SchemaType&) const noexcept = default;
+    };
+
+    //-------------------------------------------------------------------------
+    // Owning copy of a MetaDataLogEntry as read back from a schema record.
+    struct SchemaEntry
+    {
+      std::uint64_t id_{};
+      std::string component_;
+      std::string name_;
+      std::string file_;
+      std::string func_;
+      std::string format_;                    // see MessageFormat, empty if none
+      int line_{};
+      Severity severity_{ Severity::Info };
+      std::vector<SchemaType> types_;
+
+      //-----------------------------------------------------------------------
+      // true if both describe the same call site, regardless of its id
+      [[nodiscard]] bool sameSite(const SchemaEntry& other) const noexcept
+      {
+        return (line_ == other.line_) &&
+          (severity_ == other.severity_) &&
+          (name_ == other.name_) &&
+          (file_ == other.file_) &&
+          (func_ == other.func_) &&
+          (format_ == other.format_) &&
+          (component_ == other.component_) &&
+          (types_ == other.types_);
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // A schema record carries the static description of call sites so that a
+    // stream of records can be decoded without the producing binary:
+    //
+    //   u32 entry count
+    //   per entry: u64 id, i32 line, u8 severity, str component, str name,
+    //              str file, str func, str format, u32 type count, types
+    //   per type:  str type name, str param name, u8 flags, u64 element width,
+    //              u64 total elements, u64 total sub entries
+    //   str:       u32 length followed by the characters
+    class SchemaWriter final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      //-----------------------------------------------------------------------
+      // appends one schema record describing the registered entries in
+      // [first, last) of the MetaDataLogEntry list
+      static void encode(std::vector<std::byte>& output, const MetaDataLogEntry* first, const MetaDataLogEntry* last = nullptr) noexcept
+      {
+        SchemaWriter writer{ output };
+        std::uint32_t count{};
+        for (auto entry{ first }; entry != last; entry = entry->next()) {
+          ++count;
+        }
+        writer.put(count);
+        for (auto entry{ first }; entry != last; entry = entry->next()) {
+          writer.put(static_cast<std::uint64_t>(entry->id()));
+          writer.put(static_cast<std::int32_t>(entry->line()));
+          writer.put(static_cast<std::uint8_t>(entry->severity()));
+          writer.put(entry->component() ? entry->component()->name() : std::string_view{});
+          writer.put(entry->name());
+          writer.put(entry->file());
+          writer.put(entry->func());
+          writer.put(entry->format());
+
+          auto types{ entry->types() };
+          writer.put(static_cast<std::uint32_t>(types.end() - types.begin()));
+          for (auto& type : types) {
+            writer.put(type.typeName_);
+            writer.put(type.paramName_);
+            writer.put(flags(type.isIntegral_, type.isSigned_, type.isFloatingPoint_));
+            writer.put(static_cast<std::uint64_t>(type.elementWidth_));
+            writer.put(static_cast<std::uint64_t>(type.totalElements_));
+            writer.put(static_cast<std::uint64_t>(type.totalSubEntries_));
+          }
+        }
+        writer.finish();
+      }
+
+      //-----------------------------------------------------------------------
+      // appends one schema record with already decoded entries
+      static void encode(std::vector<std::byte>& output, const std::vector<SchemaEntry>& entries) noexcept
+      {
+        SchemaWriter writer{ output };
+        writer.put(static_cast<std::uint32_t>(entries.size()));
+        for (auto& entry : entries) {
+          writer.put(entry.id_);
+          writer.put(static_cast<std::int32_t>(entry.line_));
+          writer.put(static_cast<std::uint8_t>(entry.severity_));
+          writer.put(std::string_view{ entry.component_ });
+          writer.put(std::string_view{ entry.name_ });
+          writer.put(std::string_view{ entry.file_ });
+          writer.put(std::string_view{ entry.func_ });
+          writer.put(std::string_view{ entry.format_ });
+          writer.put(static_cast<std::uint32_t>(entry.types_.size()));
+          for (auto& type : entry.types_) {
+            writer.put(std::string_view{ type.typeName_ });
+            writer.put(std::string_view{ type.paramName_ });
+            writer.put(flags(type.isIntegral_, type.isSigned_, type.isFloatingPoint_));
+            writer.put(static_cast<std::uint64_t>(type.elementWidth_));
+            writer.put(static_cast<std::uint64_t>(type.totalElements_));
+            writer.put(static_cast<std::uint64_t>(type.totalSubEntries_));
+          }
+        }
+        writer.finish();
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      SchemaWriter(std::vector<std::byte>& output) noexcept :
+        output_{ output },
+        start_{ output.size() }
+      {
+        output_.resize(start_ + sizeof(RecordHeader));
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static std::uint8_t flags(bool isIntegral, bool isSigned, bool isFloatingPoint) noexcept
+      {
+        return static_cast<std::uint8_t>((isIntegral ? 1 : 0) | (isSigned ? 2 : 0) | (isFloatingPoint ? 4 : 0));
+      }
+
+      //-----------------------------------------------------------------------
+      template <typename T>
+      void put(T value) noexcept
+      {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const size_type offset{ output_.size() };
+        output_.resize(offset + sizeof(value));
+        memcpy(output_.data() + offset, &value, sizeof(value));
+      }
+
+      //-----------------------------------------------------------------------
+      void put(std::string_view value) noexcept
+      {
+        put(static_cast<std::uint32_t>(value.size()));
+        const size_type offset{ output_.size() };
+        output_.resize(offset + value.size());
+        memcpy(output_.data() + offset, value.data(), value.size());
+      }
+
+      //-----------------------------------------------------------------------
+      void finish() noexcept
+      {
+        const size_type size{ RecordHeader::align(output_.size() - start_) };
+        output_.resize(start_ + size);
+
+        RecordHeader header{};
+        header.size_ = static_cast<std::uint32_t>(size);
+        header.kind_ = RecordKind::Schema;
+        memcpy(output_.data() + start_, &header, sizeof(header));
+      }
+
+    protected:
+      std::vector<std::byte>& output_;
+      const size_type start_{};
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    class SchemaReader final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      //-----------------------------------------------------------------------
+      // appends the entries of a schema record payload; returns false (and
+      // appends nothing) if the payload is malformed
+      [[nodiscard]] static bool decode(gsl::span<const std::byte> payload, std::vector<SchemaEntry>& output) noexcept
+      {
+        SchemaReader reader{ payload };
+        std::vector<SchemaEntry> entries;
+
+        std::uint32_t count{};
+        if (!reader.get(count))
+          return false;
+
+        for (std::uint32_t index{}; index < count; ++index) {
+          SchemaEntry entry;
+          std::int32_t line{};
+          std::uint8_t severity{};
+          std::uint32_t totalTypes{};
+          if (!(reader.get(entry.id_) && reader.get(line) && reader.get(severity) && reader.get(entry.component_) && reader.get(entry.name_) && reader.get(entry.file_) && reader.get(entry.func_) && reader.get(entry.format_) && reader.get(totalTypes)))
+            return false;
+          entry.line_ = line;
+          entry.severity_ = static_cast<Severity>(severity);
+
+          for (std::uint32_t typeIndex{}; typeIndex < totalTypes; ++typeIndex) {
+            SchemaType type;
+            std::uint8_t flags{};
+            std::uint64_t elementWidth{};
+            std::uint64_t totalElements{};
+            std::uint64_t totalSubEntries{};
+            if (!(reader.get(type.typeName_) && reader.get(type.paramName_) && reader.get(flags) && reader.get(elementWidth) && reader.get(totalElements) && reader.get(totalSubEntries)))
+              return false;
+            type.isIntegral_ = 0 != (flags & 1);
+            type.isSigned_ = 0 != (flags & 2);
+            type.isFloatingPoint_ = 0 != (flags & 4);
+            type.elementWidth_ = static_cast<size_type>(elementWidth);
+            type.totalElements_ = static_cast<size_type>(totalElements);
+            type.totalSubEntries_ = static_cast<size_type>(totalSubEntries);
+            entry.types_.push_back(std::move(type));
+          }
+          entries.push_back(std::move(entry));
+        }
+
+        output.insert(output.end(), std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()));
+        return true;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      SchemaReader(gsl::span<const std::byte> payload) noexcept :
+        pos_{ payload.data() },
+        end_{ payload.data() + payload.size() }
+      {}
+
+      //-----------------------------------------------------------------------
+      template <typename T>
+      [[nodiscard]] bool get(T& value) noexcept
+      {
+        static_assert(std::is_trivially_copyable_v<T>);
+        if (static_cast<size_type>(end_ - pos_) < sizeof(value))
+          return false;
+        memcpy(&value, pos_, sizeof(value));
+        pos_ += sizeof(value);
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool get(std::string& value) noexcept
+      {
+        std::uint32_t length{};
+        if (!get(length))
+          return false;
+        if (static_cast<size_type>(end_ - pos_) < length)
+          return false;
+        value.assign(reinterpret_cast<const char*>(pos_), length);
+        pos_ += length;
+        return true;
+      }
+
+    protected:
+      const std::byte* pos_{ nullptr };
+      const std::byte* const end_{ nullptr };
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Maps call sites described by any number of producers onto one id space
+    // so that their records can be written to a single stream.
+    class SchemaMerger final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      //-----------------------------------------------------------------------
+      // returns the merged id of the call site, adding it if it is new
+      [[nodiscard]] std::uint64_t merge(SchemaEntry&& entry) noexcept
+      {
+        const size_type key{ hash(entry) };
+        auto range{ index_.equal_range(key) };
+        for (auto iter{ range.first }; iter != range.second; ++iter) {
+          if (entries_[iter->second].sameSite(entry))
+            return entries_[iter->second].id_;
+        }
+
+        // keep the producer's id (a stable call site hash) unless another
+        // call site already has it
+        if ((0 == entry.id_) || (!ids_.insert(entry.id_).second)) {
+          do {
+            entry.id_ = ++counter_;
+          } while (!ids_.insert(entry.id_).second);
+        }
+        index_.emplace(key, entries_.size());
+        entries_.push_back(entry);
+        fresh_.push_back(std::move(entry));
+        return entries_.back().id_;
+      }
+
+      //-----------------------------------------------------------------------
+      // appends one schema record with the call sites merged since the last
+      // call; returns false (and appends nothing) if there are none
+      bool describe(std::vector<std::byte>& output) noexcept
+      {
+        if (fresh_.empty())
+          return false;
+        SchemaWriter::encode(output, fresh_);
+        fresh_.clear();
+        return true;
+      }
+
+      [[nodiscard]] const std::vector<SchemaEntry>& entries() const noexcept { return entries_; }
+
+    protected:
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static size_type hash(const SchemaEntry& entry) noexcept
+      {
+        return std::hash<std::string>{}(entry.file_) ^ (std::hash<std::string>{}(entry.name_) * 31) ^ static_cast<size_type>(entry.line_);
+      }
+
+    protected:
+      std::vector<SchemaEntry> entries_;
+      std::vector<SchemaEntry> fresh_;
+      std::unordered_multimap<size_type, size_type> index_;
+      std::unordered_set<std::uint64_t> ids_;
+      std::uint64_t counter_{};
+    };
+
+    //-------------------------------------------------------------------------
+    inline void Drain::describe() noexcept
+    {
+      describeModules();
+
+      const MetaDataLogEntry* head{ MetaDataLogEntry::first() };
+      if (head == described_)
+        return;
+
+      for (auto entry{ head }; entry != described_; entry = entry->next()) {
+        sites_.insert_or_assign(entry->id(), entry);
+      }
+
+      if (!sinks_.empty()) {
+        std::vector<std::byte> schema;
+        SchemaWriter::encode(schema, head, described_);
+        if (pending_.empty())
+          pendingSince_ = clock_type::now();
+        schemas_.push_back(std::move(schema));
+        pending_.add(*reinterpret_cast<const RecordHeader*>(schemas_.back().data()));
+      }
+      described_ = head;
+    }
+
+    //-------------------------------------------------------------------------
+    // stacks are only worth symbolizing against the modules loaded when they
+    // were captured, so the map follows every load and unload
+    inline void Drain::describeModules() noexcept
+    {
+      if (sinks_.empty() || !Backtrace::enabled())
+        return;
+      const std::uint64_t generation{ ModuleMap::generation() };
+      if (generation == modules_)
+        return;
+      modules_ = generation;
+
+      std::vector<std::byte> record;
+      ModuleMap::encode(record, ModuleMap::current());
+      if (pending_.empty())
+        pendingSince_ = clock_type::now();
+      schemas_.push_back(std::move(record));
+      pending_.add(*reinterpret_cast<const RecordHeader*>(schemas_.back().data()));
+    }
+
+    //-------------------------------------------------------------------------
+    inline void Drain::describeAll(Sink& sink) noexcept
+    {
+      std::vector<std::byte> schema;
+      SchemaWriter::encode(schema, MetaDataLogEntry::first());
+      std::vector<std::byte> modules;
+      if (Backtrace::enabled())
+        ModuleMap::encode(modules, ModuleMap::current());
+
+      Batch batch;
+      batch.add(*reinterpret_cast<const RecordHeader*>(schema.data()));
+      if (!modules.empty())
+        batch.add(*reinterpret_cast<const RecordHeader*>(modules.data()));
+      sink.write(batch);
+    }
+
+  } // namespace log
+} // namespace zs
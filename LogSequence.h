@@ -0,0 +1,69 @@
+#pragma once
+
+#include "LogTransport.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace zs
+{
+  namespace log
+  {
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(64)> sequenceBlockSize;
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Process wide sequence numbers for entry records, so that entries whose
+    // timestamps tie can still be put in one order, the same every time the
+    // log is read (see RecordMerger). Each thread takes sequenceBlockSize
+    // numbers at a time from the shared counter, so its cache line is only
+    // touched once per block. A thread's own numbers always increase; across
+    // threads they only say which thread took its block first, which is why
+    // they break timestamp ties rather than replace timestamps.
+    class Sequence final
+    {
+    public:
+      //-----------------------------------------------------------------------
+      // off by default
+      static void enable(bool value) noexcept { enabled_().store(value, std::memory_order_relaxed); }
+      [[nodiscard]] static bool enabled() noexcept { return enabled_().load(std::memory_order_relaxed); }
+
+      //-----------------------------------------------------------------------
+      // never 0, which stands for no sequence number
+      [[nodiscard]] static std::uint64_t next() noexcept
+      {
+        thread_local Block block;
+        if (block.next_ == block.end_) {
+          block.next_ = counter().fetch_add(sequenceBlockSize(), std::memory_order_relaxed);
+          block.end_ = block.next_ + sequenceBlockSize();
+        }
+        return block.next_++;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Block
+      {
+        std::uint64_t next_{};
+        std::uint64_t end_{};
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::atomic_bool& enabled_() noexcept
+      {
+        static std::atomic_bool gEnabled{};
+        return gEnabled;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::atomic<std::uint64_t>& counter() noexcept
+      {
+        alignas(64) static std::atomic<std::uint64_t> gCounter{ 1 };
+        return gCounter;
+      }
+    };
+
+  } // namespace log
+} // namespace zs
@@ -0,0 +1,727 @@
+
+#pragma once
+
+#include "log.h"
+#include "LogSchema.h"
+#include "LogTransport.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <condition_variable>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace zs
+{
+  namespace log
+  {
+    inline constexpr std::uint32_t sharedMemoryMagic{ 0x676c737a };     // "zslg"
+    inline constexpr std::uint32_t sharedMemoryVersion{ 2 };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Cross process transport. A collector owns a small directory region
+    // ("/zs.log.<name>") with one slot per producer process. Every producer
+    // creates its own region ("/zs.log.<name>.<pid>") holding its schema and
+    // a fixed set of thread rings, and publishes its pid in a directory slot.
+    // Producer threads write records straight into the shared rings, so the
+    // records survive the producer crashing; the collector drains every ring,
+    // merges the schemas and owns all of the I/O. Call sites registered after
+    // the producer attached (in a library loaded later, say) are published
+    // with the next schema generation, and the collector holds their records
+    // back in the ring until it has that generation.
+    struct SharedMemory final
+    {
+      using size_type = zs::size_type;
+
+      //-----------------------------------------------------------------------
+      struct DirectoryHeader
+      {
+        std::uint32_t magic_{};
+        std::uint32_t version_{};
+        std::uint32_t totalSlots_{};
+        std::uint32_t reserved_{};
+      };
+
+      //-----------------------------------------------------------------------
+      struct DirectorySlot
+      {
+        std::atomic<std::int32_t> pid_{};     // 0 when the slot is free
+      };
+
+      //-----------------------------------------------------------------------
+      struct ProcessHeader
+      {
+        std::uint32_t magic_{};
+        std::uint32_t version_{};
+        std::int32_t pid_{};
+        std::uint32_t totalRings_{};
+        std::uint64_t ringCapacity_{};
+        std::uint64_t schemaCapacity_{};
+        std::atomic<std::uint64_t> schemaGeneration_{};   // odd while the schema is being rewritten
+        std::atomic<std::uint64_t> schemaSize_{};
+        std::atomic<std::uint32_t> schemaOverflow_{};     // set once the schema outgrew schemaCapacity_
+        std::atomic<std::uint32_t> closed_{};
+      };
+
+      //-----------------------------------------------------------------------
+      struct ProcessLayout
+      {
+        size_type controls_{};
+        size_type schema_{};
+        size_type rings_{};
+        size_type total_{};
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] constexpr static ProcessLayout make(size_type totalRings, size_type ringCapacity, size_type schemaCapacity) noexcept
+        {
+          constexpr size_type page{ 4096 };
+          ProcessLayout result;
+          result.controls_ = roundUp(sizeof(ProcessHeader), alignof(RingControl));
+          result.schema_ = roundUp(result.controls_ + (totalRings * sizeof(RingControl)), recordAlignment());
+          result.rings_ = roundUp(result.schema_ + schemaCapacity, page);
+          result.total_ = result.rings_ + (totalRings * ringCapacity);
+          return result;
+        }
+      };
+
+      //-----------------------------------------------------------------------
+      // an mmap'ed POSIX shared memory object, unlinked on destruction if owned
+      class Mapping final
+      {
+      public:
+        Mapping() noexcept = default;
+        Mapping(const Mapping&) noexcept = delete;
+        Mapping& operator=(const Mapping&) noexcept = delete;
+
+        //---------------------------------------------------------------------
+        ~Mapping() noexcept
+        {
+          if (data_)
+            ::munmap(data_, size_);
+          if (owner_)
+            ::shm_unlink(name_.c_str());
+        }
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] bool create(std::string name, size_type size, bool exclusive) noexcept
+        {
+          name_ = std::move(name);
+          int fd{ ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (exclusive ? O_EXCL : 0), 0600) };
+          if ((fd < 0) && exclusive && (EEXIST == errno)) {
+            // left over from a crashed process that had the same pid
+            ::shm_unlink(name_.c_str());
+            fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+          }
+          if (fd < 0)
+            return false;
+          owner_ = true;
+
+          struct ::stat info {};
+          const bool sized{ (0 == ::fstat(fd, &info)) && (static_cast<size_type>(info.st_size) >= size) };
+          if ((!sized) && (0 != ::ftruncate(fd, static_cast<::off_t>(size)))) {
+            ::close(fd);
+            return false;
+          }
+          return map(fd, size);
+        }
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] bool open(std::string name) noexcept
+        {
+          name_ = std::move(name);
+          const int fd{ ::shm_open(name_.c_str(), O_RDWR | O_CLOEXEC, 0600) };
+          if (fd < 0)
+            return false;
+
+          struct ::stat info {};
+          if (0 != ::fstat(fd, &info)) {
+            ::close(fd);
+            return false;
+          }
+          return map(fd, static_cast<size_type>(info.st_size));
+        }
+
+        void own() noexcept { owner_ = true; }
+        void disown() noexcept { owner_ = false; }
+
+        [[nodiscard]] std::byte* data() const noexcept { return static_cast<std::byte*>(data_); }
+        [[nodiscard]] size_type size() const noexcept { return size_; }
+        [[nodiscard]] const std::string& name() const noexcept { return name_; }
+
+      protected:
+        //---------------------------------------------------------------------
+        [[nodiscard]] bool map(int fd, size_type size) noexcept
+        {
+          void* data{ ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) };
+          ::close(fd);
+          if (MAP_FAILED == data)
+            return false;
+          data_ = data;
+          size_ = size;
+          return true;
+        }
+
+      protected:
+        std::string name_;
+        void* data_{ nullptr };
+        size_type size_{};
+        bool owner_{};
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::string directoryName(std::string_view name) noexcept
+      {
+        std::string result{ "/zs.log." };
+        result += name;
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::string processName(std::string_view name, std::int32_t pid) noexcept
+      {
+        return directoryName(name) + "." + std::to_string(pid);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static DirectorySlot* slots(const Mapping& mapping) noexcept
+      {
+        return reinterpret_cast<DirectorySlot*>(mapping.data() + roundUp(sizeof(DirectoryHeader), alignof(DirectorySlot)));
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static size_type directorySize(size_type totalSlots) noexcept
+      {
+        return roundUp(sizeof(DirectoryHeader), alignof(DirectorySlot)) + (totalSlots * sizeof(DirectorySlot));
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static size_type roundUp(size_type value, size_type align) noexcept
+      {
+        return ((value + align - 1) / align) * align;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    class SharedMemoryProducer final : public std::enable_shared_from_this<SharedMemoryProducer>
+    {
+    public:
+      using size_type = zs::size_type;
+
+      struct Options
+      {
+        size_type rings_{ 16 };
+        size_type ringCapacity_{ defaultRingCapacity() };
+        size_type schemaCapacity_{ 1024 * 1024 };
+        std::chrono::microseconds schemaInterval_{ 1000 };   // how soon newly registered call sites are published
+      };
+
+      //-----------------------------------------------------------------------
+      // Joins the collector called name and routes the rings of threads that
+      // log for the first time from now on into shared memory. Returns nullptr
+      // if no such collector is running, it has no free slot or the schema
+      // does not fit schemaCapacity_.
+      [[nodiscard]] static std::shared_ptr<SharedMemoryProducer> attach(std::string_view name) noexcept { return attach(name, Options{}); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::shared_ptr<SharedMemoryProducer> attach(std::string_view name, const Options& options) noexcept
+      {
+        std::shared_ptr<SharedMemoryProducer> result{ new SharedMemoryProducer(options) };
+        if (!result->setup(name))
+          return {};
+        result->publisher_ = std::thread{ [producer = result.get()]() noexcept { producer->publish(); } };
+
+        std::weak_ptr<SharedMemoryProducer> weak{ result };
+        Drain::singleton().ringFactory([weak]() noexcept -> std::shared_ptr<Ring> {
+          auto producer{ weak.lock() };
+          return producer ? producer->claim() : std::shared_ptr<Ring>{};
+        });
+        return result;
+      }
+
+      SharedMemoryProducer(const SharedMemoryProducer&) noexcept = delete;
+      SharedMemoryProducer& operator=(const SharedMemoryProducer&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      ~SharedMemoryProducer() noexcept
+      {
+        if (publisher_.joinable()) {
+          {
+            std::lock_guard lock{ waitMutex_ };
+            stopping_ = true;
+          }
+          wake_.notify_all();
+          publisher_.join();
+        }
+
+        // the collector drains what is left, frees the slot and unlinks the region
+        if (header_) {
+          publishSchema();
+          header_->closed_.store(1, std::memory_order_release);
+        }
+        region_.disown();
+      }
+
+      //-----------------------------------------------------------------------
+      // threads that log for the first time after this use local rings again
+      void detach() noexcept { Drain::singleton().ringFactory({}); }
+
+      [[nodiscard]] std::int32_t pid() const noexcept { return pid_; }
+      [[nodiscard]] bool oversized() const noexcept { return 0 != header_->schemaOverflow_.load(std::memory_order_relaxed); }
+
+      //-----------------------------------------------------------------------
+      // claims a free shared ring; the ring keeps the region mapped for as
+      // long as the thread using it is alive
+      [[nodiscard]] std::shared_ptr<Ring> claim() noexcept
+      {
+        publishSchema();
+
+        for (size_type index{}; index < options_.rings_; ++index) {
+          RingControl& control{ controls_[index] };
+          RingState state{ control.state_.load(std::memory_order_acquire) };
+          while (RingState::Active != state) {
+            if (control.state_.compare_exchange_weak(state, RingState::Active, std::memory_order_acq_rel)) {
+              auto self{ shared_from_this() };
+              return std::shared_ptr<Ring>{
+                new Ring{ control, ring(index), options_.ringCapacity_ },
+                [self](Ring* ring) noexcept { delete ring; } };
+            }
+          }
+        }
+        return {};
+      }
+
+      //-----------------------------------------------------------------------
+      // rewrites the schema area if call sites were registered since the last
+      // time (the generation is odd while the area is being written); returns
+      // false once the schema has outgrown schemaCapacity_, which leaves the
+      // area as it was and flags the overflow for the collector
+      bool publishSchema() noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+
+        const MetaDataLogEntry* head{ MetaDataLogEntry::first() };
+        if (published_ && (head == described_))
+          return !oversized();
+
+        std::vector<std::byte> schema;
+        SchemaWriter::encode(schema, head);
+        if (schema.size() > options_.schemaCapacity_) {
+          header_->schemaOverflow_.store(1, std::memory_order_release);
+          described_ = head;
+          return false;
+        }
+
+        const std::uint64_t generation{ header_->schemaGeneration_.load(std::memory_order_relaxed) };
+        header_->schemaGeneration_.store(generation + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(region_.data() + layout_.schema_, schema.data(), schema.size());
+        header_->schemaSize_.store(schema.size(), std::memory_order_relaxed);
+        header_->schemaGeneration_.store(generation + 2, std::memory_order_release);
+
+        described_ = head;
+        published_ = true;
+        return true;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      SharedMemoryProducer(const Options& options) noexcept :
+        options_{ options },
+        pid_{ static_cast<std::int32_t>(::getpid()) }
+      {
+        options_.ringCapacity_ = Ring::roundCapacity(options_.ringCapacity_);
+        options_.schemaCapacity_ = RecordHeader::align(options_.schemaCapacity_);
+        layout_ = SharedMemory::ProcessLayout::make(options_.rings_, options_.ringCapacity_, options_.schemaCapacity_);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool setup(std::string_view name) noexcept
+      {
+        if (!directory_.open(SharedMemory::directoryName(name)))
+          return false;
+        if (directory_.size() < sizeof(SharedMemory::DirectoryHeader))
+          return false;
+        auto& directoryHeader{ *reinterpret_cast<const SharedMemory::DirectoryHeader*>(directory_.data()) };
+        if ((sharedMemoryMagic != directoryHeader.magic_) || (sharedMemoryVersion != directoryHeader.version_))
+          return false;
+
+        if (!region_.create(SharedMemory::processName(name, pid_), layout_.total_, true))
+          return false;
+
+        header_ = new (region_.data()) SharedMemory::ProcessHeader{};
+        header_->magic_ = sharedMemoryMagic;
+        header_->version_ = sharedMemoryVersion;
+        header_->pid_ = pid_;
+        header_->totalRings_ = static_cast<std::uint32_t>(options_.rings_);
+        header_->ringCapacity_ = options_.ringCapacity_;
+        header_->schemaCapacity_ = options_.schemaCapacity_;
+
+        controls_ = reinterpret_cast<RingControl*>(region_.data() + layout_.controls_);
+        for (size_type index{}; index < options_.rings_; ++index) {
+          new (&(controls_[index])) RingControl{};
+        }
+        if (!publishSchema())
+          return false;
+
+        // only now can the collector see the region
+        auto* slots{ SharedMemory::slots(directory_) };
+        for (size_type index{}; index < directoryHeader.totalSlots_; ++index) {
+          std::int32_t expected{};
+          if (slots[index].pid_.compare_exchange_strong(expected, pid_, std::memory_order_acq_rel))
+            return true;
+        }
+        return false;
+      }
+
+      //-----------------------------------------------------------------------
+      // call sites register whenever their code is first loaded, so the
+      // schema is looked at again every schemaInterval_
+      void publish() noexcept
+      {
+        std::unique_lock lock{ waitMutex_ };
+        while (!wake_.wait_for(lock, options_.schemaInterval_, [this]() noexcept { return stopping_; })) {
+          publishSchema();
+        }
+      }
+
+      [[nodiscard]] std::byte* ring(size_type index) const noexcept { return region_.data() + layout_.rings_ + (index * options_.ringCapacity_); }
+
+    protected:
+      Options options_;
+      const std::int32_t pid_{};
+      SharedMemory::ProcessLayout layout_;
+
+      SharedMemory::Mapping directory_;
+      SharedMemory::Mapping region_;
+      SharedMemory::ProcessHeader* header_{ nullptr };
+      RingControl* controls_{ nullptr };
+
+      std::mutex mutex_;
+      const MetaDataLogEntry* described_{ nullptr };
+      bool published_{};
+
+      std::thread publisher_;
+      std::mutex waitMutex_;
+      std::condition_variable wake_;
+      bool stopping_{};
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    class SharedMemoryCollector final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      struct Options
+      {
+        size_type maxProcesses_{ 64 };
+        std::shared_ptr<SchemaMerger> merger_;    // shared with other collectors writing to the same output
+      };
+
+      //-----------------------------------------------------------------------
+      // creates (or takes over) the directory region; returns nullptr if the
+      // shared memory object cannot be created
+      [[nodiscard]] static std::unique_ptr<SharedMemoryCollector> create(std::string_view name, std::shared_ptr<Sink> output) noexcept { return create(name, std::move(output), Options{}); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<SharedMemoryCollector> create(std::string_view name, std::shared_ptr<Sink> output, const Options& options) noexcept
+      {
+        std::unique_ptr<SharedMemoryCollector> result{ new SharedMemoryCollector(name, std::move(output), options.merger_ ? options.merger_ : std::make_shared<SchemaMerger>()) };
+        if (!result->directory_.create(SharedMemory::directoryName(name), SharedMemory::directorySize(options.maxProcesses_), false))
+          return {};
+
+        auto& header{ *reinterpret_cast<SharedMemory::DirectoryHeader*>(result->directory_.data()) };
+        if (sharedMemoryMagic != header.magic_) {
+          header.totalSlots_ = static_cast<std::uint32_t>(options.maxProcesses_);
+          header.version_ = sharedMemoryVersion;
+          header.magic_ = sharedMemoryMagic;
+        }
+        return result;
+      }
+
+      SharedMemoryCollector(const SharedMemoryCollector&) noexcept = delete;
+      SharedMemoryCollector& operator=(const SharedMemoryCollector&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      ~SharedMemoryCollector() noexcept
+      {
+        collectOnce();
+        output_->flush();
+      }
+
+      [[nodiscard]] size_type processes() const noexcept { return processes_.size(); }
+      [[nodiscard]] size_type unknown() const noexcept { return unknown_; }     // records whose call site was never described
+
+      //-----------------------------------------------------------------------
+      // producers whose schema outgrew their schema area
+      [[nodiscard]] size_type oversized() const noexcept
+      {
+        return static_cast<size_type>(std::count_if(processes_.begin(), processes_.end(), [](auto& process) noexcept {
+          return 0 != process->header_->schemaOverflow_.load(std::memory_order_relaxed);
+        }));
+      }
+      [[nodiscard]] const std::vector<SchemaEntry>& schema() const noexcept { return merger_->entries(); }
+
+      //-----------------------------------------------------------------------
+      // one pass over every producer; returns true if anything was written
+      bool collectOnce() noexcept
+      {
+        discover();
+
+        staging_.clear();
+        offsets_.clear();
+
+        for (auto& process : processes_) {
+          refreshSchema(*process);
+        }
+        if (merger_->describe(staging_))
+          offsets_.push_back(0);
+
+        for (auto& process : processes_) {
+          for (auto& ring : process->rings_) {
+            collect(*process, *ring);
+          }
+        }
+
+        const bool result{ !offsets_.empty() };
+        if (result) {
+          batch_.clear();
+          for (auto offset : offsets_) {
+            batch_.add(*reinterpret_cast<const RecordHeader*>(staging_.data() + offset));
+          }
+          output_->write(batch_);
+        }
+
+        retire();
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      void run(const std::atomic_bool& running, std::chrono::microseconds idle = std::chrono::microseconds{ 1000 }) noexcept
+      {
+        while (running.load(std::memory_order_acquire)) {
+          if (!collectOnce())
+            std::this_thread::sleep_for(idle);
+        }
+        collectOnce();
+        output_->flush();
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Process
+      {
+        std::int32_t pid_{};
+        size_type slot_{};
+        SharedMemory::Mapping region_;
+        SharedMemory::ProcessHeader* header_{ nullptr };
+        std::vector<std::unique_ptr<Ring>> rings_;
+        std::uint64_t schemaGeneration_{};
+        std::unordered_map<std::uint64_t, std::uint64_t> ids_;
+      };
+
+      //-----------------------------------------------------------------------
+      SharedMemoryCollector(std::string_view name, std::shared_ptr<Sink> output, std::shared_ptr<SchemaMerger> merger) noexcept :
+        name_{ name },
+        output_{ std::move(output) },
+        merger_{ std::move(merger) }
+      {}
+
+      //-----------------------------------------------------------------------
+      void discover() noexcept
+      {
+        auto& header{ *reinterpret_cast<const SharedMemory::DirectoryHeader*>(directory_.data()) };
+        auto* slots{ SharedMemory::slots(directory_) };
+
+        for (size_type index{}; index < header.totalSlots_; ++index) {
+          const std::int32_t pid{ slots[index].pid_.load(std::memory_order_acquire) };
+          if (0 == pid)
+            continue;
+          auto found{ std::find_if(processes_.begin(), processes_.end(), [&](auto& process) noexcept { return process->slot_ == index; }) };
+          if (found != processes_.end())
+            continue;
+
+          auto process{ std::make_unique<Process>() };
+          process->pid_ = pid;
+          process->slot_ = index;
+          if (!attach(*process)) {
+            // not a valid region (yet); forget the slot if its owner is gone
+            if (!alive(pid))
+              slots[index].pid_.store(0, std::memory_order_release);
+            continue;
+          }
+          processes_.push_back(std::move(process));
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool attach(Process& process) noexcept
+      {
+        if (!process.region_.open(SharedMemory::processName(name_, process.pid_)))
+          return false;
+        if (process.region_.size() < sizeof(SharedMemory::ProcessHeader))
+          return false;
+
+        auto* header{ reinterpret_cast<SharedMemory::ProcessHeader*>(process.region_.data()) };
+        if ((sharedMemoryMagic != header->magic_) || (sharedMemoryVersion != header->version_))
+          return false;
+
+        const auto layout{ SharedMemory::ProcessLayout::make(header->totalRings_, static_cast<size_type>(header->ringCapacity_), static_cast<size_type>(header->schemaCapacity_)) };
+        if (layout.total_ > process.region_.size())
+          return false;
+
+        process.header_ = header;
+        auto* controls{ reinterpret_cast<RingControl*>(process.region_.data() + layout.controls_) };
+        for (size_type index{}; index < header->totalRings_; ++index) {
+          process.rings_.push_back(std::make_unique<Ring>(controls[index], process.region_.data() + layout.rings_ + (index * header->ringCapacity_), static_cast<size_type>(header->ringCapacity_)));
+        }
+        process.region_.own();
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      void refreshSchema(Process& process) noexcept
+      {
+        auto& header{ *process.header_ };
+        const std::uint64_t generation{ header.schemaGeneration_.load(std::memory_order_acquire) };
+        if ((generation == process.schemaGeneration_) || (0 != (generation % 2)))
+          return;
+
+        const auto layout{ SharedMemory::ProcessLayout::make(header.totalRings_, static_cast<size_type>(header.ringCapacity_), static_cast<size_type>(header.schemaCapacity_)) };
+        const size_type size{ std::min(static_cast<size_type>(header.schemaSize_.load(std::memory_order_relaxed)), static_cast<size_type>(header.schemaCapacity_)) };
+        std::vector<std::byte> copy(process.region_.data() + layout.schema_, process.region_.data() + layout.schema_ + size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (generation != header.schemaGeneration_.load(std::memory_order_relaxed))
+          return;   // rewritten while copying, try again on the next pass
+
+        std::vector<SchemaEntry> entries;
+        if ((size < sizeof(RecordHeader)) || !SchemaReader::decode(gsl::span<const std::byte>{ copy }.subspan(sizeof(RecordHeader)), entries)) {
+          process.schemaGeneration_ = generation;
+          return;
+        }
+
+        for (auto& entry : entries) {
+          process.ids_[entry.id_] = merger_->merge(std::move(entry));
+        }
+        process.schemaGeneration_ = generation;
+      }
+
+      //-----------------------------------------------------------------------
+      // a record of a call site missing from the schema stops the ring until
+      // a schema generation describes it, unless none ever will
+      void collect(Process& process, Ring& ring) noexcept
+      {
+        const auto head{ ring.head() };
+        auto position{ ring.tail() };
+
+        while (position != head) {
+          const RecordHeader& header{ ring.at(position) };
+          if (RecordKind::Padding == header.kind_) {
+            position += header.size_;
+            continue;
+          }
+
+          // only entries, repeats and batches carry the id of a call site
+          std::uint64_t entry{ header.entry_ };
+          if ((RecordKind::Entry == header.kind_) || (RecordKind::Repeat == header.kind_) || (RecordKind::Batch == header.kind_)) {
+            auto found{ process.ids_.find(header.entry_) };
+            if (found == process.ids_.end()) {
+              if (awaitsSchema(process))
+                break;
+              ++unknown_;
+              position += header.size_;
+              continue;
+            }
+            entry = found->second;
+          }
+          position += header.size_;
+
+          const size_type offset{ staging_.size() };
+          staging_.resize(offset + header.size_);
+          memcpy(staging_.data() + offset, &header, header.size_);
+
+          RecordHeader* copy{ reinterpret_cast<RecordHeader*>(staging_.data() + offset) };
+          copy->entry_ = entry;
+          offsets_.push_back(offset);
+        }
+        ring.release(position);
+      }
+
+      //-----------------------------------------------------------------------
+      // whether a later schema generation can still describe what is missing
+      [[nodiscard]] static bool awaitsSchema(const Process& process) noexcept
+      {
+        auto& header{ *process.header_ };
+        if (0 != header.schemaOverflow_.load(std::memory_order_acquire))
+          return false;
+        const bool gone{ (0 != header.closed_.load(std::memory_order_acquire)) || !alive(process.pid_) };
+        if (!gone)
+          return true;
+        // a producer publishes its last generation before it closes
+        const std::uint64_t generation{ header.schemaGeneration_.load(std::memory_order_acquire) };
+        return (0 == (generation % 2)) && (generation != process.schemaGeneration_);
+      }
+
+      //-----------------------------------------------------------------------
+      // drop producers that exited (or crashed) once their rings are empty
+      void retire() noexcept
+      {
+        auto* slots{ SharedMemory::slots(directory_) };
+        auto finished{ [&](const std::unique_ptr<Process>& process) noexcept {
+          const bool gone{ (0 != process->header_->closed_.load(std::memory_order_acquire)) || !alive(process->pid_) };
+          if (!gone)
+            return false;
+          for (auto& ring : process->rings_) {
+            if (0 != ring->used())
+              return false;
+          }
+          slots[process->slot_].pid_.store(0, std::memory_order_release);
+          return true;
+        } };
+        processes_.erase(std::remove_if(processes_.begin(), processes_.end(), finished), processes_.end());
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static bool alive(std::int32_t pid) noexcept
+      {
+        return (0 == ::kill(static_cast<::pid_t>(pid), 0)) || (ESRCH != errno);
+      }
+
+    protected:
+      const std::string name_;
+      std::shared_ptr<Sink> output_;
+      SharedMemory::Mapping directory_;
+
+      std::shared_ptr<SchemaMerger> merger_;
+      std::vector<std::unique_ptr<Process>> processes_;
+
+      std::vector<std::byte> staging_;
+      std::vector<size_type> offsets_;
+      Batch batch_;
+      size_type unknown_{};
+    };
+
+  } // namespace log
+} // namespace zs
+
+#endif //_WIN32
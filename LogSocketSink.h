@@ -0,0 +1,855 @@
+
+#pragma once
+
+#include "log.h"
+#include "LogSchema.h"
+#include "LogTransport.h"
+
+#ifndef _WIN32
+
+#include <cerrno>
+#include <deque>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    enum class FrameKind : std::uint16_t
+    {
+      Hello,
+      Segment,
+      Credit
+    };
+
+    //-------------------------------------------------------------------------
+    struct FrameKindDeclare : public zs::EnumDeclare<FrameKind, 3>
+    {
+      constexpr const Entries operator()() const noexcept
+      {
+        return { {
+          {FrameKind::Hello, "hello"},
+          {FrameKind::Segment, "segment"},
+          {FrameKind::Credit, "credit"}
+        } };
+      }
+    };
+
+    using FrameKindTraits = zs::EnumTraits<FrameKind, FrameKindDeclare>;
+
+    //-------------------------------------------------------------------------
+    // Everything sent either way on a log stream socket is a frame:
+    //
+    //   Hello   (sink -> collector) sequence_ session id, value_ first
+    //           sequence the sink still holds
+    //   Segment (sink -> collector) sequence_ segment sequence (0 for the
+    //           unsequenced schema sent after connecting), payload records
+    //   Credit  (collector -> sink) sequence_ highest segment written to the
+    //           collector's output, value_ bytes the sink may send
+    struct FrameHeader
+    {
+      std::uint32_t size_{};            // payload bytes following the header
+      FrameKind kind_{};
+      std::uint16_t flags_{};
+      std::uint64_t sequence_{};
+      std::uint64_t value_{};
+    };
+
+    static_assert(24 == sizeof(FrameHeader));
+
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(64 * 1024 * 1024)> maxFrameSize;
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Address of a Unix domain or TCP stream endpoint.
+    struct SocketAddress
+    {
+      ::sockaddr_storage address_{};
+      ::socklen_t length_{};
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static bool unixPath(const char* path, SocketAddress& output) noexcept
+      {
+        ::sockaddr_un address{};
+        if (strlen(path) >= sizeof(address.sun_path))
+          return false;
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+        memcpy(&output.address_, &address, sizeof(address));
+        output.length_ = sizeof(address);
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static bool tcp(const char* host, std::uint16_t port, SocketAddress& output) noexcept
+      {
+        ::addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = host ? 0 : AI_PASSIVE;
+
+        ::addrinfo* found{};
+        const std::string service{ std::to_string(port) };
+        if ((0 != ::getaddrinfo(host, service.c_str(), &hints, &found)) || (!found))
+          return false;
+        memcpy(&output.address_, found->ai_addr, found->ai_addrlen);
+        output.length_ = static_cast<::socklen_t>(found->ai_addrlen);
+        ::freeaddrinfo(found);
+        return true;
+      }
+
+      [[nodiscard]] int family() const noexcept { return address_.ss_family; }
+      [[nodiscard]] const ::sockaddr* get() const noexcept { return reinterpret_cast<const ::sockaddr*>(&address_); }
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Streams batches as framed segments to a collector. Every segment stays
+    // in a bounded in-memory spool until the collector acknowledges having
+    // written it; after a reconnect the sink sends its accumulated schema and
+    // then resends every unacknowledged segment. The collector hands out
+    // credit in bytes and the sink never has more than one segment in flight
+    // beyond it. Nothing here blocks the drain except flush().
+    class SocketSink : public Sink
+    {
+    public:
+      struct Options
+      {
+        std::chrono::microseconds maxLatency_{ 1000 };
+        size_type batchBytes_{ 64 * 1024 };
+        size_type spoolBytes_{ 64 * 1024 * 1024 };
+        std::chrono::milliseconds reconnectMin_{ 10 };
+        std::chrono::milliseconds reconnectMax_{ 1000 };
+        std::chrono::milliseconds flushTimeout_{ 1000 };
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::shared_ptr<SocketSink> connectUnix(const char* path) noexcept { return connectUnix(path, Options{}); }
+
+      //-----------------------------------------------------------------------
+      // returns nullptr only if the address is invalid; the collector does
+      // not need to be running yet
+      [[nodiscard]] static std::shared_ptr<SocketSink> connectUnix(const char* path, const Options& options) noexcept
+      {
+        SocketAddress address;
+        if (!SocketAddress::unixPath(path, address))
+          return {};
+        return std::make_shared<SocketSink>(address, options);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::shared_ptr<SocketSink> connectTcp(const char* host, std::uint16_t port) noexcept { return connectTcp(host, port, Options{}); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::shared_ptr<SocketSink> connectTcp(const char* host, std::uint16_t port, const Options& options) noexcept
+      {
+        SocketAddress address;
+        if (!SocketAddress::tcp(host, port, address))
+          return {};
+        return std::make_shared<SocketSink>(address, options);
+      }
+
+      //-----------------------------------------------------------------------
+      SocketSink(const SocketAddress& address, const Options& options) noexcept :
+        address_{ address },
+        options_{ options },
+        session_{ std::random_device{}() ^ (static_cast<std::uint64_t>(::getpid()) << 32) ^ static_cast<std::uint64_t>(clock_type::now().time_since_epoch().count()) },
+        backoff_{ options.reconnectMin_ }
+      {}
+
+      SocketSink(const SocketSink&) noexcept = delete;
+      SocketSink& operator=(const SocketSink&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      ~SocketSink() noexcept override
+      {
+        disconnect();
+      }
+
+      [[nodiscard]] bool connected() const noexcept { return (fd_ >= 0) && (!connecting_); }
+      [[nodiscard]] size_type spooled() const noexcept { return spool_.size(); }
+      [[nodiscard]] size_type dropped() const noexcept { return dropped_; }
+      [[nodiscard]] size_type connects() const noexcept { return connects_; }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool ready(const Batch& pending, clock_type::duration age) const noexcept override
+      {
+        return (pending.bytes_ >= options_.batchBytes_) || (age >= options_.maxLatency_);
+      }
+
+      //-----------------------------------------------------------------------
+      void write(const Batch& batch) noexcept override
+      {
+        Segment segment;
+        segment.sequence_ = ++sequence_;
+        segment.bytes_.resize(sizeof(FrameHeader));
+
+        // the schema is never dropped, it is needed again after reconnecting
+        const bool full{ spoolBytes_ + sizeof(FrameHeader) + batch.bytes_ > options_.spoolBytes_ };
+        for (size_type index{}; index < batch.records_.size(); ++index) {
+          auto& record{ batch.records_[index] };
+          if (batch.continued_[index]) {
+            if (!full)
+              segment.bytes_.insert(segment.bytes_.end(), record.begin(), record.end());
+            continue;
+          }
+          auto& header{ *reinterpret_cast<const RecordHeader*>(record.data()) };
+          if ((RecordKind::Schema == header.kind_) || (RecordKind::Modules == header.kind_))
+            schema_.insert(schema_.end(), record.begin(), record.end());
+          else if (full) {
+            ++dropped_;
+            continue;
+          }
+          segment.bytes_.insert(segment.bytes_.end(), record.begin(), record.end());
+        }
+
+        if (segment.bytes_.size() > sizeof(FrameHeader)) {
+          FrameHeader header{};
+          header.size_ = static_cast<std::uint32_t>(segment.bytes_.size() - sizeof(FrameHeader));
+          header.kind_ = FrameKind::Segment;
+          header.sequence_ = segment.sequence_;
+          memcpy(segment.bytes_.data(), &header, sizeof(header));
+          spoolBytes_ += segment.bytes_.size();
+          spool_.push_back(std::move(segment));
+        }
+        else
+          --sequence_;
+
+        pump();
+      }
+
+      //-----------------------------------------------------------------------
+      // waits (at most flushTimeout_) for the collector to acknowledge every
+      // spooled segment
+      void flush() noexcept override
+      {
+        const auto deadline{ clock_type::now() + options_.flushTimeout_ };
+        while (true) {
+          pump();
+          if (spool_.empty())
+            break;
+          const auto now{ clock_type::now() };
+          if (now >= deadline)
+            break;
+          wait(std::min(deadline, (fd_ < 0) ? nextAttempt_ : (now + std::chrono::milliseconds{ 10 })));
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // makes as much progress as possible without blocking
+      void pump() noexcept
+      {
+        if (fd_ < 0)
+          connect();
+        if (connecting_)
+          finishConnect();
+        if (!connected())
+          return;
+        if (!receive())
+          return;
+        send();
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Segment
+      {
+        std::uint64_t sequence_{};
+        std::vector<std::byte> bytes_;      // frame header and records
+      };
+
+      //-----------------------------------------------------------------------
+      void connect() noexcept
+      {
+        if (clock_type::now() < nextAttempt_)
+          return;
+
+        fd_ = ::socket(address_.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd_ < 0) {
+          retryLater();
+          return;
+        }
+        if (AF_UNIX != address_.family()) {
+          int yes{ 1 };
+          ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        }
+
+        if (0 == ::connect(fd_, address_.get(), address_.length_))
+          restart();
+        else if (EINPROGRESS == errno)
+          connecting_ = true;
+        else
+          retryLater();
+      }
+
+      //-----------------------------------------------------------------------
+      void finishConnect() noexcept
+      {
+        ::pollfd wait{ fd_, POLLOUT, 0 };
+        if (::poll(&wait, 1, 0) <= 0)
+          return;
+
+        int error{};
+        ::socklen_t length{ sizeof(error) };
+        connecting_ = false;
+        if ((0 != ::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length)) || (0 != error)) {
+          retryLater();
+          return;
+        }
+        restart();
+      }
+
+      //-----------------------------------------------------------------------
+      // (re)starts the stream: hello, the accumulated schema and then every
+      // segment that was not acknowledged yet
+      void restart() noexcept
+      {
+        ++connects_;
+        control_.clear();
+        controlSent_ = {};
+        next_ = {};
+        partial_ = {};
+        credit_ = {};
+        input_.clear();
+
+        FrameHeader hello{};
+        hello.kind_ = FrameKind::Hello;
+        hello.sequence_ = session_;
+        hello.value_ = spool_.empty() ? (sequence_ + 1) : spool_.front().sequence_;
+        append(control_, hello, {});
+
+        if (!schema_.empty()) {
+          FrameHeader schema{};
+          schema.size_ = static_cast<std::uint32_t>(schema_.size());
+          schema.kind_ = FrameKind::Segment;
+          append(control_, schema, schema_);
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      static void append(std::vector<std::byte>& output, const FrameHeader& header, gsl::span<const std::byte> payload) noexcept
+      {
+        const size_type offset{ output.size() };
+        output.resize(offset + sizeof(header));
+        memcpy(output.data() + offset, &header, sizeof(header));
+        output.insert(output.end(), payload.begin(), payload.end());
+      }
+
+      //-----------------------------------------------------------------------
+      // reads credit frames; returns false if the connection was lost
+      [[nodiscard]] bool receive() noexcept
+      {
+        std::byte buffer[4096];
+        while (true) {
+          const auto result{ ::recv(fd_, buffer, sizeof(buffer), MSG_DONTWAIT) };
+          if (result > 0) {
+            input_.insert(input_.end(), buffer, buffer + result);
+            continue;
+          }
+          if ((result < 0) && (EINTR == errno))
+            continue;
+          if ((result < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno)))
+            break;
+          retryLater();
+          return false;
+        }
+
+        size_type offset{};
+        while (input_.size() - offset >= sizeof(FrameHeader)) {
+          FrameHeader header{};
+          memcpy(&header, input_.data() + offset, sizeof(header));
+          if (input_.size() - offset < sizeof(header) + header.size_)
+            break;
+          offset += sizeof(header) + header.size_;
+          if (FrameKind::Credit == header.kind_)
+            acknowledge(header.sequence_, header.value_);
+        }
+        input_.erase(input_.begin(), input_.begin() + static_cast<std::ptrdiff_t>(offset));
+
+        backoff_ = options_.reconnectMin_;
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      void acknowledge(std::uint64_t sequence, std::uint64_t credit) noexcept
+      {
+        credit_ += static_cast<std::int64_t>(credit);
+        while ((!spool_.empty()) && (spool_.front().sequence_ <= sequence) && ((next_ > 0) || (0 == partial_))) {
+          spoolBytes_ -= spool_.front().bytes_.size();
+          spool_.pop_front();
+          if (next_ > 0)
+            --next_;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void send() noexcept
+      {
+        while (controlSent_ < control_.size()) {
+          const auto result{ sendSome(control_.data() + controlSent_, control_.size() - controlSent_) };
+          if (result <= 0)
+            return;
+          controlSent_ += static_cast<size_type>(result);
+        }
+
+        while ((next_ < spool_.size()) && ((credit_ > 0) || (0 != partial_))) {
+          auto& bytes{ spool_[next_].bytes_ };
+          const auto result{ sendSome(bytes.data() + partial_, bytes.size() - partial_) };
+          if (result <= 0)
+            return;
+          partial_ += static_cast<size_type>(result);
+          if (partial_ == bytes.size()) {
+            credit_ -= static_cast<std::int64_t>(bytes.size());
+            partial_ = {};
+            ++next_;
+          }
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // returns the bytes sent, 0 if the socket is full and -1 if the
+      // connection was lost
+      [[nodiscard]] ::ssize_t sendSome(const std::byte* data, size_type size) noexcept
+      {
+        while (true) {
+          const auto result{ ::send(fd_, data, size, MSG_DONTWAIT | MSG_NOSIGNAL) };
+          if (result >= 0)
+            return result;
+          if (EINTR == errno)
+            continue;
+          if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+            return 0;
+          retryLater();
+          return -1;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void wait(clock_type::time_point until) noexcept
+      {
+        const auto now{ clock_type::now() };
+        if (until <= now)
+          return;
+        const int timeout{ static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(until - now).count()) + 1 };
+        if (fd_ < 0) {
+          std::this_thread::sleep_for(until - now);
+          return;
+        }
+        const bool sending{ connecting_ || (controlSent_ < control_.size()) || ((next_ < spool_.size()) && ((credit_ > 0) || (0 != partial_))) };
+        ::pollfd wait{ fd_, static_cast<short>(POLLIN | (sending ? POLLOUT : 0)), 0 };
+        ::poll(&wait, 1, timeout);
+      }
+
+      //-----------------------------------------------------------------------
+      void retryLater() noexcept
+      {
+        disconnect();
+        nextAttempt_ = clock_type::now() + backoff_;
+        backoff_ = std::min(backoff_ * 2, options_.reconnectMax_);
+      }
+
+      //-----------------------------------------------------------------------
+      void disconnect() noexcept
+      {
+        if (fd_ >= 0)
+          ::close(fd_);
+        fd_ = -1;
+        connecting_ = false;
+        partial_ = {};
+        next_ = {};
+      }
+
+    protected:
+      const SocketAddress address_;
+      const Options options_;
+      const std::uint64_t session_{};
+
+      int fd_{ -1 };
+      bool connecting_{};
+      clock_type::time_point nextAttempt_{};
+      std::chrono::milliseconds backoff_{};
+      size_type connects_{};
+
+      std::vector<std::byte> schema_;       // every schema (and modules) record ever written
+      std::vector<std::byte> control_;      // hello and schema sent after connecting
+      size_type controlSent_{};
+      std::vector<std::byte> input_;
+
+      std::deque<Segment> spool_;
+      size_type spoolBytes_{};
+      size_type next_{};                    // first spooled segment not sent yet
+      size_type partial_{};                 // bytes of spool_[next_] already sent
+      std::uint64_t sequence_{};
+      std::int64_t credit_{};
+      size_type dropped_{};
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Receiving end of SocketSink streams: remaps every stream onto one schema
+    // and writes the records to an output sink, acknowledging segments once
+    // they have been written. Sessions outlive connections so that segments
+    // resent after a reconnect are written only once.
+    class SocketCollector final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      struct Options
+      {
+        size_type window_{ 1024 * 1024 };         // credit granted to every connection
+        int backlog_{ 16 };
+        std::shared_ptr<SchemaMerger> merger_;    // shared with other collectors writing to the same output
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<SocketCollector> listenUnix(const char* path, std::shared_ptr<Sink> output) noexcept { return listenUnix(path, std::move(output), Options{}); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<SocketCollector> listenUnix(const char* path, std::shared_ptr<Sink> output, const Options& options) noexcept
+      {
+        SocketAddress address;
+        if (!SocketAddress::unixPath(path, address))
+          return {};
+        ::unlink(path);
+        auto result{ listen(address, std::move(output), options) };
+        if (result)
+          result->path_ = path;
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<SocketCollector> listenTcp(const char* host, std::uint16_t port, std::shared_ptr<Sink> output) noexcept { return listenTcp(host, port, std::move(output), Options{}); }
+
+      //-----------------------------------------------------------------------
+      // port 0 picks any free port, see port()
+      [[nodiscard]] static std::unique_ptr<SocketCollector> listenTcp(const char* host, std::uint16_t port, std::shared_ptr<Sink> output, const Options& options) noexcept
+      {
+        SocketAddress address;
+        if (!SocketAddress::tcp(host, port, address))
+          return {};
+        return listen(address, std::move(output), options);
+      }
+
+      SocketCollector(const SocketCollector&) noexcept = delete;
+      SocketCollector& operator=(const SocketCollector&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      ~SocketCollector() noexcept
+      {
+        for (auto& connection : connections_) {
+          ::close(connection->fd_);
+        }
+        if (listen_ >= 0)
+          ::close(listen_);
+        if (!path_.empty())
+          ::unlink(path_.c_str());
+        output_->flush();
+      }
+
+      [[nodiscard]] size_type connections() const noexcept { return connections_.size(); }
+      [[nodiscard]] size_type unknown() const noexcept { return unknown_; }
+      [[nodiscard]] const std::vector<SchemaEntry>& schema() const noexcept { return merger_->entries(); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] std::uint16_t port() const noexcept
+      {
+        ::sockaddr_storage address{};
+        ::socklen_t length{ sizeof(address) };
+        if (0 != ::getsockname(listen_, reinterpret_cast<::sockaddr*>(&address), &length))
+          return 0;
+        if (AF_INET == address.ss_family)
+          return ntohs(reinterpret_cast<const ::sockaddr_in*>(&address)->sin_port);
+        if (AF_INET6 == address.ss_family)
+          return ntohs(reinterpret_cast<const ::sockaddr_in6*>(&address)->sin6_port);
+        return 0;
+      }
+
+      //-----------------------------------------------------------------------
+      // waits at most timeout for activity, then handles everything that is
+      // readable; returns true if anything was written
+      bool collectOnce(std::chrono::milliseconds timeout = std::chrono::milliseconds{}) noexcept
+      {
+        polls_.clear();
+        polls_.push_back(::pollfd{ listen_, POLLIN, 0 });
+        for (auto& connection : connections_) {
+          polls_.push_back(::pollfd{ connection->fd_, static_cast<short>(POLLIN | (connection->output_.empty() ? 0 : POLLOUT)), 0 });
+        }
+        if (::poll(polls_.data(), static_cast<::nfds_t>(polls_.size()), static_cast<int>(timeout.count())) <= 0)
+          return false;
+
+        staging_.clear();
+        offsets_.clear();
+        schema_.clear();
+
+        for (size_type index{}; index < connections_.size(); ++index) {
+          auto& connection{ *connections_[index] };
+          if (0 != (polls_[index + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+            connection.closed_ = !receive(connection);
+        }
+        if (0 != (polls_.front().revents & POLLIN))
+          accept();
+
+        const bool result{ !offsets_.empty() };
+        if (result) {
+          merger_->describe(schema_);
+          batch_.clear();
+          if (!schema_.empty())
+            batch_.add(*reinterpret_cast<const RecordHeader*>(schema_.data()));
+          for (auto offset : offsets_) {
+            batch_.add(*reinterpret_cast<const RecordHeader*>(staging_.data() + offset));
+          }
+          output_->write(batch_);
+        }
+
+        // acknowledge only what was handed to the output
+        for (auto& connection : connections_) {
+          credit(*connection);
+          if (!connection->closed_)
+            connection->closed_ = !send(*connection);
+        }
+        auto closed{ [](const std::unique_ptr<Connection>& connection) noexcept {
+          if (connection->closed_)
+            ::close(connection->fd_);
+          return connection->closed_;
+        } };
+        connections_.erase(std::remove_if(connections_.begin(), connections_.end(), closed), connections_.end());
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      void run(const std::atomic_bool& running, std::chrono::milliseconds idle = std::chrono::milliseconds{ 100 }) noexcept
+      {
+        while (running.load(std::memory_order_acquire)) {
+          collectOnce(idle);
+        }
+        output_->flush();
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Session
+      {
+        std::uint64_t written_{};                     // highest sequence written to the output
+        std::unordered_map<std::uint64_t, std::uint64_t> ids_;
+      };
+
+      //-----------------------------------------------------------------------
+      struct Connection
+      {
+        int fd_{ -1 };
+        Session* session_{ nullptr };
+        std::vector<std::byte> input_;
+        std::vector<std::byte> output_;
+        std::uint64_t consumed_{};                    // bytes to grant back
+        bool granted_{};
+        bool closed_{};
+      };
+
+      //-----------------------------------------------------------------------
+      SocketCollector(std::shared_ptr<Sink> output, const Options& options) noexcept :
+        options_{ options },
+        output_{ std::move(output) },
+        merger_{ options.merger_ ? options.merger_ : std::make_shared<SchemaMerger>() }
+      {}
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<SocketCollector> listen(const SocketAddress& address, std::shared_ptr<Sink> output, const Options& options) noexcept
+      {
+        std::unique_ptr<SocketCollector> result{ new SocketCollector(std::move(output), options) };
+        result->listen_ = ::socket(address.family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (result->listen_ < 0)
+          return {};
+        int yes{ 1 };
+        if (AF_UNIX != address.family())
+          ::setsockopt(result->listen_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if ((0 != ::bind(result->listen_, address.get(), address.length_)) || (0 != ::listen(result->listen_, options.backlog_)))
+          return {};
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      void accept() noexcept
+      {
+        while (true) {
+          const int fd{ ::accept4(listen_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) };
+          if (fd < 0)
+            return;
+          auto connection{ std::make_unique<Connection>() };
+          connection->fd_ = fd;
+          connections_.push_back(std::move(connection));
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // returns false once the peer is gone or misbehaves
+      [[nodiscard]] bool receive(Connection& connection) noexcept
+      {
+        std::byte buffer[64 * 1024];
+        bool open{ true };
+        while (true) {
+          const auto result{ ::recv(connection.fd_, buffer, sizeof(buffer), MSG_DONTWAIT) };
+          if (result > 0) {
+            connection.input_.insert(connection.input_.end(), buffer, buffer + result);
+            continue;
+          }
+          if ((result < 0) && (EINTR == errno))
+            continue;
+          open = (result < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno));
+          break;
+        }
+
+        size_type offset{};
+        auto& input{ connection.input_ };
+        while (input.size() - offset >= sizeof(FrameHeader)) {
+          FrameHeader header{};
+          memcpy(&header, input.data() + offset, sizeof(header));
+          if (header.size_ > maxFrameSize())
+            return false;
+          if (input.size() - offset < sizeof(header) + header.size_)
+            break;
+          if (!frame(connection, header, gsl::span<const std::byte>{ input.data() + offset + sizeof(header), header.size_ }))
+            return false;
+          offset += sizeof(header) + header.size_;
+        }
+        input.erase(input.begin(), input.begin() + static_cast<std::ptrdiff_t>(offset));
+        return open;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool frame(Connection& connection, const FrameHeader& header, gsl::span<const std::byte> payload) noexcept
+      {
+        if (FrameKind::Hello == header.kind_) {
+          connection.session_ = &(sessions_[header.sequence_]);
+          return true;
+        }
+        if ((FrameKind::Segment != header.kind_) || (!connection.session_))
+          return false;
+
+        auto& session{ *connection.session_ };
+        if (0 != header.sequence_) {
+          connection.consumed_ += sizeof(header) + payload.size();
+          if (header.sequence_ <= session.written_)
+            return true;      // resent after a reconnect but already written
+          session.written_ = header.sequence_;
+        }
+
+        size_type position{};
+        while (payload.size() - position >= sizeof(RecordHeader)) {
+          const RecordHeader& record{ *reinterpret_cast<const RecordHeader*>(payload.data() + position) };
+          if ((record.size_ < sizeof(RecordHeader)) || (record.size_ > payload.size() - position))
+            return false;
+          position += record.size_;
+
+          if (RecordKind::Schema == record.kind_) {
+            std::vector<SchemaEntry> entries;
+            if (!SchemaReader::decode(gsl::span<const std::byte>{ record.payload(), record.payloadSize() }, entries))
+              return false;
+            for (auto& entry : entries) {
+              const auto id{ entry.id_ };
+              session.ids_[id] = merger_->merge(std::move(entry));
+            }
+            continue;
+          }
+          if (RecordKind::Padding == record.kind_)
+            continue;
+
+          // only entries, repeats and batches carry the id of a call site
+          std::uint64_t entry{ record.entry_ };
+          if ((RecordKind::Entry == record.kind_) || (RecordKind::Repeat == record.kind_) || (RecordKind::Batch == record.kind_)) {
+            auto found{ session.ids_.find(record.entry_) };
+            if (found == session.ids_.end()) {
+              ++unknown_;
+              continue;
+            }
+            entry = found->second;
+          }
+          const size_type offset{ staging_.size() };
+          staging_.resize(offset + record.size_);
+          memcpy(staging_.data() + offset, &record, record.size_);
+          reinterpret_cast<RecordHeader*>(staging_.data() + offset)->entry_ = entry;
+          offsets_.push_back(offset);
+        }
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      void credit(Connection& connection) noexcept
+      {
+        if ((!connection.session_) || (connection.granted_ && (0 == connection.consumed_)))
+          return;
+
+        FrameHeader header{};
+        header.kind_ = FrameKind::Credit;
+        header.sequence_ = connection.session_->written_;
+        header.value_ = connection.granted_ ? connection.consumed_ : options_.window_;
+        connection.granted_ = true;
+        connection.consumed_ = {};
+
+        const size_type offset{ connection.output_.size() };
+        connection.output_.resize(offset + sizeof(header));
+        memcpy(connection.output_.data() + offset, &header, sizeof(header));
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static bool send(Connection& connection) noexcept
+      {
+        auto& output{ connection.output_ };
+        size_type sent{};
+        while (sent < output.size()) {
+          const auto result{ ::send(connection.fd_, output.data() + sent, output.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL) };
+          if (result >= 0) {
+            sent += static_cast<size_type>(result);
+            continue;
+          }
+          if (EINTR == errno)
+            continue;
+          if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+            break;
+          return false;
+        }
+        output.erase(output.begin(), output.begin() + static_cast<std::ptrdiff_t>(sent));
+        return true;
+      }
+
+    protected:
+      const Options options_;
+      std::shared_ptr<Sink> output_;
+      std::shared_ptr<SchemaMerger> merger_;
+
+      int listen_{ -1 };
+      std::string path_;
+      std::vector<std::unique_ptr<Connection>> connections_;
+      std::unordered_map<std::uint64_t, Session> sessions_;
+      std::vector<::pollfd> polls_;
+
+      std::vector<std::byte> schema_;
+      std::vector<std::byte> staging_;
+      std::vector<size_type> offsets_;
+      Batch batch_;
+      size_type unknown_{};
+    };
+
+  } // namespace log
+} // namespace zs
+
+#endif //_WIN32
@@ -0,0 +1,506 @@
+#pragma once
+
+#include "LogFileSink.h"
+#include "LogFormat.h"
+#include "LogReader.h"
+#include "LogSchema.h"
+#include "LogTransport.h"
+
+#ifndef _WIN32
+
+#include <bit>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace zs
+{
+  namespace log
+  {
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Renders drained records as one line of text each, for places that
+    // cannot take the binary format:
+    //
+    //   2024-05-01 12:00:00.123456789 info zs::log name file.cpp:42 value=1 name="x"
+    //
+    // Everything that only depends on the call site (severity, component,
+    // name, file:line and the " param=" of every parameter) is rendered once
+    // per site from its schema; a site with a format (see MessageFormat)
+    // shows its message instead of the param=value list. Integers are
+    // written two digits at a time, floating point values as the shortest
+    // text that reads back the same, timestamps in UTC with the date part
+    // kept from the previous record of the same second. Lines go into one
+    // buffer of bufferSize_ bytes that is written whenever it fills up and
+    // at the end of every batch; nothing is allocated per record once the
+    // buffers have grown to size.
+    class TextSink : public WritevSink
+    {
+    public:
+      struct Options : public WritevSink::Options
+      {
+        size_type bufferSize_{ 1024 * 1024 };
+      };
+
+      //-----------------------------------------------------------------------
+      TextSink(int fd) noexcept : TextSink(fd, Options{}) {}
+
+      //-----------------------------------------------------------------------
+      TextSink(int fd, const Options& options) noexcept :
+        WritevSink{ fd, options },
+        text_(std::max<size_type>(options.bufferSize_, 4 * maxScalarText()))
+      {}
+
+      [[nodiscard]] size_type lines() const noexcept { return lines_; }
+
+      //-----------------------------------------------------------------------
+      void write(const Batch& batch) noexcept override
+      {
+        staging_.clear();
+        for (size_type index{}; index < batch.records_.size(); ++index) {
+          auto& record{ batch.records_[index] };
+          if ((!batch.continued_[index]) && (RecordKind::Schema == reinterpret_cast<const RecordHeader*>(record.data())->kind_))
+            forget();
+          staging_.insert(staging_.end(), record.begin(), record.end());
+        }
+
+        decoder_.decode(staging_, [this](const RecordDecoder::Record& record) noexcept { render(record); });
+        emit();
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static size_type maxScalarText() noexcept { return 64; }
+
+      //-----------------------------------------------------------------------
+      enum class Format : std::uint8_t
+      {
+        Unknown,
+        Text,
+        Signed8,
+        Signed16,
+        Signed32,
+        Signed64,
+        Unsigned8,
+        Unsigned16,
+        Unsigned32,
+        Unsigned64,
+        Float,
+        Double,
+        LongDouble,
+      };
+
+      //-----------------------------------------------------------------------
+      struct Field
+      {
+        std::string name_;                      // " param="
+        Format format_{};
+        bool array_{};
+      };
+
+      //-----------------------------------------------------------------------
+      // literal text of the message followed by a parameter, if any
+      struct Piece
+      {
+        std::string text_;
+        size_type param_{ SIZE_MAX };
+      };
+
+      //-----------------------------------------------------------------------
+      struct Site
+      {
+        const SchemaEntry* entry_{ nullptr };
+        std::string prefix_;                    // " severity component name file:line"
+        std::vector<Field> fields_;
+        std::vector<Piece> message_;            // empty unless the site has a format
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static const char* digitPairs() noexcept
+      {
+        return
+          "00010203040506070809"
+          "10111213141516171819"
+          "20212223242526272829"
+          "30313233343536373839"
+          "40414243444546474849"
+          "50515253545556575859"
+          "60616263646566676869"
+          "70717273747576777879"
+          "80818283848586878889"
+          "90919293949596979899";
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static size_type digits(std::uint64_t value) noexcept
+      {
+        static constexpr std::uint64_t powers[]{
+          1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull,
+          10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull, 100000000000000ull, 1000000000000000ull,
+          10000000000000000ull, 100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull };
+
+        // log10 from log2, off by at most one which the table settles
+        const auto estimate{ (static_cast<size_type>(std::bit_width(value | 1)) * 1233) >> 12 };
+        return estimate + 1 - ((value | 1) < powers[estimate] ? 1 : 0);
+      }
+
+      //-----------------------------------------------------------------------
+      // writes exactly width digits, the pairs from the back
+      static void writeDigits(char* out, std::uint64_t value, size_type width) noexcept
+      {
+        char* pos{ out + width };
+        while (pos - out >= 2) {
+          pos -= 2;
+          memcpy(pos, digitPairs() + ((value % 100) * 2), 2);
+          value /= 100;
+        }
+        if (pos != out)
+          *out = static_cast<char>('0' + (value % 10));
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static char* writeUnsigned(char* out, std::uint64_t value) noexcept
+      {
+        const size_type width{ digits(value) };
+        writeDigits(out, value, width);
+        return out + width;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static char* writeSigned(char* out, std::int64_t value) noexcept
+      {
+        *out = '-';
+        const auto magnitude{ value < 0 ? (0 - static_cast<std::uint64_t>(value)) : static_cast<std::uint64_t>(value) };
+        return writeUnsigned(out + (value < 0 ? 1 : 0), magnitude);
+      }
+
+      //-----------------------------------------------------------------------
+      // runs of the same site skip the lookup
+      [[nodiscard]] const Site& site(const SchemaEntry& entry) noexcept
+      {
+        if ((last_) && (last_->entry_ == &entry))
+          return *last_;
+
+        auto found{ sites_.find(entry.id_) };
+        if ((found != sites_.end()) && (found->second.entry_ == &entry)) {
+          last_ = &found->second;
+          return *last_;
+        }
+
+        Site site;
+        site.entry_ = &entry;
+        site.prefix_ = " ";
+        site.prefix_ += SeverityTraits::toString(entry.severity_);
+        site.prefix_ += " " + entry.component_ + " " + entry.name_ + " " + entry.file_ + ":" + std::to_string(entry.line_);
+        for (auto& type : entry.types_) {
+          site.fields_.push_back(Field{ " " + type.paramName_ + "=", format(type), type.isArray() });
+        }
+
+        std::string text{ " " };
+        const bool parsed{ MessageFormat::parse(entry.format_, [&](std::string_view literal) noexcept { text += literal; }, [&](std::string_view name) noexcept {
+          size_type param{};
+          while ((param < entry.types_.size()) && (entry.types_[param].paramName_ != name)) {
+            ++param;
+          }
+          site.message_.push_back(Piece{ std::exchange(text, std::string{}), param });
+        }) };
+        if (parsed && (!entry.format_.empty()))
+          site.message_.push_back(Piece{ std::move(text) });
+        else
+          site.message_.clear();
+        last_ = &sites_.insert_or_assign(entry.id_, std::move(site)).first->second;
+        return *last_;
+      }
+
+      //-----------------------------------------------------------------------
+      void forget() noexcept
+      {
+        sites_.clear();
+        last_ = nullptr;
+      }
+
+      //-----------------------------------------------------------------------
+      void render(const RecordDecoder::Record& record) noexcept
+      {
+        if (!record.entry_) {
+          reserve(maxScalarText() * 2);
+          writeTimestamp(record.header_.timestamp_);
+          append(" <unknown entry ");
+          used_ = static_cast<size_type>(writeUnsigned(text_.data() + used_, record.header_.entry_) - text_.data());
+          append(">\n");
+          ++lines_;
+          return;
+        }
+
+        const Site& site{ this->site(*record.entry_) };
+        reserve(maxScalarText());
+        writeTimestamp(record.header_.timestamp_);
+        append(site.prefix_);
+
+        if (const auto repeats{ record.repeats() }; 0 != repeats) {
+          reserve(maxScalarText());
+          append(" repeated ");
+          used_ = static_cast<size_type>(writeUnsigned(text_.data() + used_, repeats) - text_.data());
+          append(" times\n");
+          ++lines_;
+          return;
+        }
+
+        ParamReader reader{ *site.entry_, record.payload_ };
+        if (site.message_.empty()) {
+          ParamReader::Param param;
+          size_type index{};
+          while (reader.next(param)) {
+            const Field& field{ site.fields_[index++] };
+            renderParam(field.name_, field, param, true);
+          }
+          if (index != site.fields_.size())
+            append(" ...");
+        }
+        else
+          renderMessage(site, reader);
+
+        if (record.context_) {
+          for (auto& field : *record.context_) {
+            append(" ");
+            append(field.key_);
+            append("=\"");
+            append(field.value_);
+            append("\"");
+          }
+        }
+        if (!record.backtrace_.empty()) {
+          append(" stack=");
+          for (size_type frame{}; frame < record.backtrace_.size(); ++frame) {
+            reserve(maxScalarText());
+            char* pos{ text_.data() + used_ };
+            if (0 != frame)
+              *pos++ = ',';
+            memcpy(pos, "0x", 2);
+            pos = std::to_chars(pos + 2, text_.data() + used_ + maxScalarText(), record.backtrace_[frame], 16).ptr;
+            used_ = static_cast<size_type>(pos - text_.data());
+          }
+        }
+        append("\n");
+        ++lines_;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static Format format(const SchemaType& type) noexcept
+      {
+        // variable sized arrays of bytes are strings
+        if (type.isArrayVariableSized() && type.isIntegral_ && (1 == type.elementWidth_))
+          return Format::Text;
+
+        if (type.isFloatingPoint_) {
+          switch (type.elementWidth_) {
+            case sizeof(float):   return Format::Float;
+            case sizeof(double):  return Format::Double;
+            default:              break;
+          }
+          return sizeof(long double) == type.elementWidth_ ? Format::LongDouble : Format::Unknown;
+        }
+
+        switch (type.elementWidth_) {
+          case 1:   return type.isSigned_ ? Format::Signed8 : Format::Unsigned8;
+          case 2:   return type.isSigned_ ? Format::Signed16 : Format::Unsigned16;
+          case 4:   return type.isSigned_ ? Format::Signed32 : Format::Unsigned32;
+          case 8:   return type.isSigned_ ? Format::Signed64 : Format::Unsigned64;
+          default:  break;
+        }
+        return Format::Unknown;
+      }
+
+      //-----------------------------------------------------------------------
+      // the parameters in the order of the format's placeholders, strings
+      // without quotes; parameters the walk did not get to show as "..."
+      void renderMessage(const Site& site, ParamReader& reader) noexcept
+      {
+        params_.clear();
+        ParamReader::Param param;
+        while (reader.next(param)) {
+          params_.push_back(param);
+        }
+        for (auto& piece : site.message_) {
+          if (piece.param_ < params_.size()) {
+            renderParam(piece.text_, site.fields_[piece.param_], params_[piece.param_], false);
+            continue;
+          }
+          append(piece.text_);
+          if (SIZE_MAX != piece.param_)
+            append("...");
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // before is the text ahead of the value, the " param=" or a piece of
+      // the message
+      void renderParam(std::string_view before, const Field& field, const ParamReader::Param& param, bool quoted) noexcept
+      {
+        if (Format::Text == field.format_) {
+          append(before);
+          if (quoted)
+            append("\"");
+          append(reinterpret_cast<const char*>(param.data_.data()), param.count_);
+          if (quoted)
+            append("\"");
+          return;
+        }
+
+        // the text and a scalar in one go, the common case
+        if ((!field.array_) && (before.size() <= text_.size() - maxScalarText())) {
+          reserve(before.size() + maxScalarText());
+          char* pos{ text_.data() + used_ };
+          memcpy(pos, before.data(), before.size());
+          pos = renderElement(field.format_, param.data_.data(), pos + before.size());
+          used_ = static_cast<size_type>(pos - text_.data());
+          return;
+        }
+
+        append(before);
+        if (!field.array_) {
+          reserve(maxScalarText());
+          used_ = static_cast<size_type>(renderElement(field.format_, param.data_.data(), text_.data() + used_) - text_.data());
+          return;
+        }
+        append("[");
+        const size_type width{ param.count_ ? param.data_.size() / param.count_ : 0 };
+        for (size_type index{}; index < param.count_; ++index) {
+          reserve(maxScalarText() + 1);
+          char* pos{ text_.data() + used_ };
+          if (0 != index)
+            *pos++ = ',';
+          pos = renderElement(field.format_, param.data_.data() + (index * width), pos);
+          used_ = static_cast<size_type>(pos - text_.data());
+        }
+        append("]");
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static char* renderElement(Format format, const std::byte* data, char* out) noexcept
+      {
+        auto load{ [&](auto value) noexcept {
+          memcpy(&value, data, sizeof(value));
+          return value;
+        } };
+
+        char* const end{ out + maxScalarText() };
+        switch (format) {
+          case Format::Signed8:     return writeSigned(out, load(std::int8_t{}));
+          case Format::Signed16:    return writeSigned(out, load(std::int16_t{}));
+          case Format::Signed32:    return writeSigned(out, load(std::int32_t{}));
+          case Format::Signed64:    return writeSigned(out, load(std::int64_t{}));
+          case Format::Unsigned8:   return writeUnsigned(out, load(std::uint8_t{}));
+          case Format::Unsigned16:  return writeUnsigned(out, load(std::uint16_t{}));
+          case Format::Unsigned32:  return writeUnsigned(out, load(std::uint32_t{}));
+          case Format::Unsigned64:  return writeUnsigned(out, load(std::uint64_t{}));
+          case Format::Float:       return std::to_chars(out, end, load(float{})).ptr;
+          case Format::Double:      return std::to_chars(out, end, load(double{})).ptr;
+          case Format::LongDouble:  return std::to_chars(out, end, load(0.0L)).ptr;
+          default:                  break;
+        }
+        *out = '?';
+        return out + 1;
+      }
+
+      //-----------------------------------------------------------------------
+      // "YYYY-MM-DD hh:mm:ss.nnnnnnnnn"; the caller reserved the room
+      void writeTimestamp(std::uint64_t timestamp) noexcept
+      {
+        const std::uint64_t seconds{ timestamp / 1000000000 };
+        if (seconds != second_) {
+          second_ = seconds;
+          writeDate(seconds);
+        }
+        char* pos{ text_.data() + used_ };
+        memcpy(pos, date_, sizeof(date_));
+        pos[sizeof(date_)] = '.';
+        writeDigits(pos + sizeof(date_) + 1, timestamp % 1000000000, 9);
+        used_ += sizeof(date_) + 10;
+      }
+
+      //-----------------------------------------------------------------------
+      // civil date from days since the epoch, see
+      // http://howardhinnant.github.io/date_algorithms.html#civil_from_days
+      void writeDate(std::uint64_t seconds) noexcept
+      {
+        const auto days{ static_cast<std::int64_t>(seconds / 86400) + 719468 };
+        const auto era{ days / 146097 };
+        const auto dayOfEra{ static_cast<std::uint64_t>(days - (era * 146097)) };
+        const auto yearOfEra{ (dayOfEra - (dayOfEra / 1460) + (dayOfEra / 36524) - (dayOfEra / 146096)) / 365 };
+        const auto dayOfYear{ dayOfEra - ((365 * yearOfEra) + (yearOfEra / 4) - (yearOfEra / 100)) };
+        const auto shiftedMonth{ ((5 * dayOfYear) + 2) / 153 };
+        const auto day{ dayOfYear - (((153 * shiftedMonth) + 2) / 5) + 1 };
+        const auto month{ shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9 };
+        const auto year{ static_cast<std::uint64_t>(static_cast<std::int64_t>(yearOfEra) + (era * 400)) + (month <= 2 ? 1 : 0) };
+        const auto secondOfDay{ seconds % 86400 };
+
+        writeDigits(date_, year, 4);
+        date_[4] = '-';
+        writeDigits(date_ + 5, month, 2);
+        date_[7] = '-';
+        writeDigits(date_ + 8, day, 2);
+        date_[10] = ' ';
+        writeDigits(date_ + 11, secondOfDay / 3600, 2);
+        date_[13] = ':';
+        writeDigits(date_ + 14, (secondOfDay / 60) % 60, 2);
+        date_[16] = ':';
+        writeDigits(date_ + 17, secondOfDay % 60, 2);
+      }
+
+      //-----------------------------------------------------------------------
+      void reserve(size_type size) noexcept
+      {
+        if (used_ + size > text_.size())
+          emit();
+      }
+
+      //-----------------------------------------------------------------------
+      void append(std::string_view text) noexcept { append(text.data(), text.size()); }
+
+      //-----------------------------------------------------------------------
+      // text too long for the buffer is written straight from where it is
+      void append(const char* data, size_type size) noexcept
+      {
+        reserve(size);
+        if (size > text_.size()) {
+          add(reinterpret_cast<const std::byte*>(data), size);
+          writeAll();
+          return;
+        }
+        memcpy(text_.data() + used_, data, size);
+        used_ += size;
+      }
+
+      //-----------------------------------------------------------------------
+      void emit() noexcept
+      {
+        if (0 == used_)
+          return;
+        add(reinterpret_cast<const std::byte*>(text_.data()), used_);
+        writeAll();
+        used_ = 0;
+      }
+
+    protected:
+      RecordDecoder decoder_;
+      std::unordered_map<std::uint64_t, Site> sites_;
+      std::vector<ParamReader::Param> params_;
+      const Site* last_{ nullptr };
+      std::vector<std::byte> staging_;        // the batch made contiguous for the decoder
+      std::vector<char> text_;
+      size_type used_{};
+      size_type lines_{};
+      std::uint64_t second_{ UINT64_MAX };
+      char date_[19]{};
+    };
+
+  } // namespace log
+} // namespace zs
+
+#endif //_WIN32
@@ -0,0 +1,1617 @@
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "enum.h"
+#include "traits.h"
+#include "MoveSharedPtr.h"
+#include "dependency/gsl.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif //__linux__
+
+namespace zs
+{
+  namespace log
+  {
+    class MetaDataLogEntry;
+
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(8)> recordAlignment;
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(1024 * 1024)> defaultRingCapacity;
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(256 * 1024)> urgentRingCapacity;    // per thread, for Severity::Critical and above; holds the largest entry (see LogEntry)
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(64 * 1024)> maxFragmentSize;
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(2 * 1024 * 1024)> hugePageSize;
+
+    //-------------------------------------------------------------------------
+    enum class RecordKind : std::uint16_t
+    {
+      Padding,
+      Entry,
+      Schema,
+      Fragment,
+      Context,
+      Metrics,
+      Modules,
+      Repeat,
+      Batch,
+      Checksum,
+    };
+
+    //-------------------------------------------------------------------------
+    struct RecordKindDeclare : public EnumDeclare<RecordKind, 10>
+    {
+      constexpr const Entries operator()() const noexcept {
+        return { {
+          {RecordKind::Padding, "padding"},
+          {RecordKind::Entry, "entry"},
+          {RecordKind::Schema, "schema"},
+          {RecordKind::Fragment, "fragment"},
+          {RecordKind::Context, "context"},
+          {RecordKind::Metrics, "metrics"},
+          {RecordKind::Modules, "modules"},
+          {RecordKind::Repeat, "repeat"},
+          {RecordKind::Batch, "batch"},
+          {RecordKind::Checksum, "checksum"},
+        } };
+      }
+    };
+
+    using RecordKindTraits = EnumTraits<RecordKind, RecordKindDeclare>;
+
+    // set on every record of a fragment chain except the last one; an entry
+    // record with this flag starts a chain and its payload begins with the
+    // chain id, the fragment records that follow carry it in entry_
+    inline constexpr std::integral_constant<std::uint16_t, static_cast<std::uint16_t>(0x1)> recordFlagContinued;
+
+    // only ever seen inside a ring: the entry refers to bytes it does not hold
+    // (see RecordReference), the drain hands them to the sinks in their place
+    inline constexpr std::integral_constant<std::uint16_t, static_cast<std::uint16_t>(0x2)> recordFlagReferences;
+
+    // the entry was logged within a thread context (see LogContext): its
+    // payload begins with the id of the context record describing it, ahead
+    // of a chain id if it also starts a chain
+    inline constexpr std::integral_constant<std::uint16_t, static_cast<std::uint16_t>(0x4)> recordFlagContext;
+
+    // the entry carries the return addresses of the stack that logged it
+    // (see Backtrace): a u32 depth, 4 bytes of padding and that many u64
+    // addresses, following the context id if there is one
+    inline constexpr std::integral_constant<std::uint16_t, static_cast<std::uint16_t>(0x8)> recordFlagBacktrace;
+
+    // the entry carries its sequence number (see Sequence): a u64 following
+    // the context id and the backtrace, ahead of a chain id
+    inline constexpr std::integral_constant<std::uint16_t, static_cast<std::uint16_t>(0x10)> recordFlagSequence;
+
+    // a context record without payload: the thread's context stack emptied
+    // and nothing is logged with the id in entry_ any more
+    inline constexpr std::integral_constant<std::uint16_t, static_cast<std::uint16_t>(0x20)> recordFlagEnded;
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    struct RecordHeader
+    {
+      using size_type = zs::size_type;
+
+      std::uint32_t size_{};        // total record size including this header, padded to recordAlignment
+      RecordKind kind_{};
+      std::uint16_t flags_{};
+      std::uint64_t entry_{};       // MetaDataLogEntry::id() of the call site for entries, repeats and batches (chain id for fragments, context id for contexts, 0 for padding, schema, metrics, modules and checksum records)
+      std::uint64_t timestamp_{};   // nanoseconds since the system clock epoch
+
+      [[nodiscard]] constexpr static size_type align(size_type size) noexcept { return (size + (recordAlignment() - 1)) & ~(recordAlignment() - 1); }
+      [[nodiscard]] constexpr static size_type recordSize(size_type payloadSize) noexcept { return align(sizeof(RecordHeader) + payloadSize); }
+
+      [[nodiscard]] constexpr size_type payloadSize() const noexcept { return size_ - sizeof(RecordHeader); }
+      [[nodiscard]] const std::byte* payload() const noexcept { return reinterpret_cast<const std::byte*>(this) + sizeof(RecordHeader); }
+      [[nodiscard]] constexpr size_type contextSize() const noexcept { return 0 != (flags_ & recordFlagContext()) ? sizeof(std::uint64_t) : 0; }
+      [[nodiscard]] constexpr size_type sequenceSize() const noexcept { return 0 != (flags_ & recordFlagSequence()) ? sizeof(std::uint64_t) : 0; }
+
+      //-----------------------------------------------------------------------
+      // the bytes of an entry payload ahead of the parameters (or chain id);
+      // only valid once the whole record is readable
+      [[nodiscard]] size_type prefixSize() const noexcept
+      {
+        size_type result{ contextSize() };
+        if (0 != (flags_ & recordFlagBacktrace())) {
+          std::uint32_t depth{};
+          if (payloadSize() >= result + sizeof(depth))
+            memcpy(&depth, payload() + result, sizeof(depth));
+          result += sizeof(std::uint64_t) * (1 + static_cast<size_type>(depth));
+        }
+        return result + sequenceSize();
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::uint64_t now() noexcept
+      {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+      }
+    };
+
+    static_assert(sizeof(RecordHeader) == 24);
+    static_assert(0 == (sizeof(RecordHeader) % recordAlignment()));
+
+    //-------------------------------------------------------------------------
+    // A record flagged with recordFlagReferences ends with the references it
+    // makes followed by a RecordReferences; the references start at the
+    // first aligned offset after the parameters. Whoever releases the record
+    // from the ring destroys the references, letting go of their owners.
+    struct RecordReference
+    {
+      std::uint64_t offset_{};                // within the payload, where the bytes belong
+      std::uint64_t size_{};
+      const std::byte* data_{ nullptr };
+      move_shared_ptr<const void> owner_;
+    };
+
+    //-------------------------------------------------------------------------
+    struct RecordReferences
+    {
+      std::uint32_t count_{};
+      std::uint32_t payloadSize_{};           // parameter bytes before the references
+    };
+
+    static_assert(0 == (sizeof(RecordReference) % recordAlignment()));
+    static_assert(sizeof(RecordReferences) == recordAlignment());
+
+    //-------------------------------------------------------------------------
+    // A batch record holds count_ entries of one call site, logged by one
+    // call and sharing its header, prefix and timestamp. The payload is the
+    // entry prefix, a BatchRecord and the parameters of each entry back to
+    // back, elementSize_ bytes apiece.
+    struct BatchRecord
+    {
+      std::uint32_t count_{};
+      std::uint32_t elementSize_{};
+    };
+
+    static_assert(sizeof(BatchRecord) == recordAlignment());
+
+    //-------------------------------------------------------------------------
+    enum class RingState : std::uint32_t
+    {
+      Unused,
+      Active,
+      Orphaned,
+    };
+
+    //-------------------------------------------------------------------------
+    // The shared part of a ring. It only holds plain atomics (no pointers) so
+    // it can also live in memory mapped by more than one process.
+    struct RingControl
+    {
+      using position_type = std::uint64_t;
+
+      alignas(64) std::atomic<position_type> head_{};
+      std::atomic<std::uint64_t> dropped_{};
+
+      alignas(64) std::atomic<position_type> tail_{};
+      std::atomic<RingState> state_{};
+    };
+
+    //-------------------------------------------------------------------------
+    enum class RingPages
+    {
+      Normal,
+      Huge,
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Owner of a ring's buffer. Huge buffers come from hugePageSize pages,
+    // reserved ones (MAP_HUGETLB) if the system has any left, transparent
+    // ones otherwise, and plain memory where neither is available. Every
+    // buffer is written once by the allocating thread, which is the thread
+    // that produces into the ring, so the kernel places its pages on that
+    // thread's NUMA node.
+    class RingMemory final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<std::byte[], RingMemory> allocate(size_type size, RingPages pages) noexcept
+      {
+#ifdef __linux__
+        if (RingPages::Huge == pages) {
+          if (auto result{ map(size) })
+            return result;
+        }
+#endif //__linux__
+        return std::unique_ptr<std::byte[], RingMemory>{ new std::byte[size]{}, RingMemory{} };
+      }
+
+      //-----------------------------------------------------------------------
+      void operator()(std::byte* buffer) const noexcept
+      {
+#ifdef __linux__
+        if (0 != mapped_) {
+          ::munmap(buffer, mapped_);
+          return;
+        }
+#endif //__linux__
+        delete[] buffer;
+      }
+
+      // bytes mapped, 0 if the buffer came from new[]
+      [[nodiscard]] size_type mapped() const noexcept { return mapped_; }
+      [[nodiscard]] bool huge() const noexcept { return huge_; }
+
+    protected:
+#ifdef __linux__
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<std::byte[], RingMemory> map(size_type size) noexcept
+      {
+        const size_type length{ ((size + hugePageSize() - 1) / hugePageSize()) * hugePageSize() };
+        void* mapped{ ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0) };
+        if (MAP_FAILED != mapped)
+          return touch(mapped, length, true);
+
+        // transparent huge pages need a hugePageSize aligned range, so map
+        // one page more than needed and give back what is off either end
+        const size_type padded{ length + hugePageSize() };
+        mapped = ::mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == mapped)
+          return {};
+        const auto start{ reinterpret_cast<std::uintptr_t>(mapped) };
+        const auto aligned{ (start + hugePageSize() - 1) & ~static_cast<std::uintptr_t>(hugePageSize() - 1) };
+        if (aligned != start)
+          ::munmap(mapped, aligned - start);
+        if (const size_type after{ padded - length - (aligned - start) }; 0 != after)
+          ::munmap(reinterpret_cast<void*>(aligned + length), after);
+        ::madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE);
+        return touch(reinterpret_cast<void*>(aligned), length, false);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unique_ptr<std::byte[], RingMemory> touch(void* mapped, size_type length, bool huge) noexcept
+      {
+        memset(mapped, 0, length);
+        RingMemory memory;
+        memory.mapped_ = length;
+        memory.huge_ = huge;
+        return std::unique_ptr<std::byte[], RingMemory>{ static_cast<std::byte*>(mapped), memory };
+      }
+#endif //__linux__
+
+    protected:
+      size_type mapped_{};
+      bool huge_{};                           // reserved huge pages rather than transparent ones
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Single producer / single consumer byte ring. The owning thread reserves
+    // and commits whole records; the drain reads committed records in place
+    // and releases them once every sink is done with the bytes. A record never
+    // straddles the end of the buffer, a padding record fills the gap instead.
+    class Ring final
+    {
+    public:
+      using size_type = zs::size_type;
+      using position_type = RingControl::position_type;
+
+      //-----------------------------------------------------------------------
+      Ring(size_type capacity = defaultRingCapacity()) noexcept : Ring(capacity, RingPages::Normal) {}
+
+      //-----------------------------------------------------------------------
+      // a ring on huge pages holds at least one of them
+      Ring(size_type capacity, RingPages pages) noexcept :
+        capacity_{ roundCapacity(RingPages::Huge == pages ? std::max<size_type>(capacity, hugePageSize()) : capacity) },
+        mask_{ capacity_ - 1 },
+        ownedControl_{ std::make_unique<RingControl>() },
+        ownedBuffer_{ RingMemory::allocate(capacity_, pages) },
+        control_{ *ownedControl_ },
+        buffer_{ ownedBuffer_.get() }
+      {
+        control_.state_.store(RingState::Active, std::memory_order_release);
+      }
+
+      //-----------------------------------------------------------------------
+      // attach to a control block and buffer owned by someone else (e.g. a
+      // shared memory region); capacity must be a power of two
+      Ring(RingControl& control, std::byte* buffer, size_type capacity) noexcept :
+        capacity_{ capacity },
+        mask_{ capacity_ - 1 },
+        control_{ control },
+        buffer_{ buffer },
+        head_{ control.head_.load(std::memory_order_acquire) },
+        cachedTail_{ control.tail_.load(std::memory_order_acquire) }
+      {
+        assert(roundCapacity(capacity) == capacity);
+      }
+
+      Ring(const Ring&) noexcept = delete;
+      Ring(Ring&&) noexcept = delete;
+
+      Ring& operator=(const Ring&) noexcept = delete;
+      Ring& operator=(Ring&&) noexcept = delete;
+
+      [[nodiscard]] size_type capacity() const noexcept { return capacity_; }
+      [[nodiscard]] size_type maxRecordSize() const noexcept { return capacity_ / 2; }
+      [[nodiscard]] size_type dropped() const noexcept { return static_cast<size_type>(control_.dropped_.load(std::memory_order_relaxed)); }
+
+      // a ring in memory owned by someone else may be read by another process
+      [[nodiscard]] bool shared() const noexcept { return !ownedBuffer_; }
+
+      // how the buffer was allocated, see RingMemory
+      [[nodiscard]] const RingMemory& memory() const noexcept { return ownedBuffer_.get_deleter(); }
+
+      [[nodiscard]] bool orphaned() const noexcept { return RingState::Orphaned == control_.state_.load(std::memory_order_acquire); }
+      void orphan() noexcept { control_.state_.store(RingState::Orphaned, std::memory_order_release); }
+
+      //-----------------------------------------------------------------------
+      // producer side: returns nullptr (and counts a drop) if the ring is full
+      [[nodiscard]] std::byte* reserve(size_type size) noexcept
+      {
+        std::byte* result{ tryReserve(size) };
+        if (!result)
+          control_.dropped_.fetch_add(1, std::memory_order_relaxed);
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      // producer side: as reserve but a full ring is not counted as a drop,
+      // for callers that wait for the drain and try again
+      [[nodiscard]] std::byte* tryReserve(size_type size) noexcept
+      {
+        assert(0 == (size % recordAlignment()));
+
+        if (size > maxRecordSize())
+          return nullptr;
+
+        const size_type offset{ static_cast<size_type>(head_ & mask_) };
+        const size_type contiguous{ capacity_ - offset };
+        const size_type padding{ contiguous < size ? contiguous : 0 };
+
+        if (!hasSpace(padding + size))
+          return nullptr;
+
+        if (0 != padding) {
+          RecordHeader* pad{ reinterpret_cast<RecordHeader*>(buffer_ + offset) };
+          pad->size_ = static_cast<std::uint32_t>(padding);
+          pad->kind_ = RecordKind::Padding;
+        }
+        pendingPadding_ = padding;
+        return buffer_ + ((head_ + padding) & mask_);
+      }
+
+      //-----------------------------------------------------------------------
+      // producer side: size may be smaller than what was reserved
+      void commit(size_type size) noexcept
+      {
+        assert(0 == (size % recordAlignment()));
+        head_ += pendingPadding_ + size;
+        pendingPadding_ = 0;
+        control_.head_.store(head_, std::memory_order_release);
+      }
+
+      //-----------------------------------------------------------------------
+      // consumer side
+      [[nodiscard]] position_type head() const noexcept { return control_.head_.load(std::memory_order_acquire); }
+      [[nodiscard]] position_type tail() const noexcept { return control_.tail_.load(std::memory_order_relaxed); }
+      [[nodiscard]] size_type used() const noexcept { return static_cast<size_type>(head() - tail()); }
+
+      [[nodiscard]] const RecordHeader& at(position_type position) const noexcept { return *reinterpret_cast<const RecordHeader*>(buffer_ + (position & mask_)); }
+      [[nodiscard]] RecordHeader& at(position_type position) noexcept { return *reinterpret_cast<RecordHeader*>(buffer_ + (position & mask_)); }
+      [[nodiscard]] const std::byte* data(position_type position) const noexcept { return buffer_ + (position & mask_); }
+
+      void release(position_type position) noexcept { control_.tail_.store(position, std::memory_order_release); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static size_type roundCapacity(size_type capacity) noexcept
+      {
+        size_type result{ recordAlignment() * 2 };
+        while (result < capacity)
+          result <<= 1;
+        return result;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool hasSpace(size_type size) noexcept
+      {
+        if ((head_ + size) - cachedTail_ <= capacity_)
+          return true;
+        cachedTail_ = control_.tail_.load(std::memory_order_acquire);
+        return (head_ + size) - cachedTail_ <= capacity_;
+      }
+
+    protected:
+      const size_type capacity_{};
+      const size_type mask_{};
+      std::unique_ptr<RingControl> ownedControl_;
+      std::unique_ptr<std::byte[], RingMemory> ownedBuffer_;
+
+      RingControl& control_;
+      std::byte* const buffer_{ nullptr };
+
+      // producer only
+      position_type head_{};
+      position_type cachedTail_{};
+      size_type pendingPadding_{};
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Writes one entry whose payload may be larger than a single record as a
+    // chain of records straight into the ring. While a writer is alive on a
+    // thread, MetaDataTypeCommon::packData() hands it whatever does not fit
+    // the current record and it moves on to the next one, waiting a little
+    // for the drain to make room; if none is made the chain is abandoned and
+    // the reader discards the part it has seen.
+    class FragmentWriter final
+    {
+    public:
+      using size_type = zs::size_type;
+      using id_type = std::uint64_t;
+
+      //-----------------------------------------------------------------------
+      FragmentWriter(Ring& ring, std::chrono::microseconds wait = std::chrono::microseconds{ 50000 }) noexcept :
+        ring_{ ring },
+        fragmentSize_{ std::min<size_type>(maxFragmentSize(), ring.maxRecordSize() - sizeof(RecordHeader)) },
+        wait_{ wait },
+        previous_{ std::exchange(current(), this) }
+      {}
+
+      FragmentWriter(const FragmentWriter&) noexcept = delete;
+      FragmentWriter& operator=(const FragmentWriter&) noexcept = delete;
+
+      ~FragmentWriter() noexcept { current() = previous_; }
+
+      [[nodiscard]] static FragmentWriter* active() noexcept { return current(); }
+
+      [[nodiscard]] bool failed() const noexcept { return failed_; }
+      [[nodiscard]] std::byte* pos() const noexcept { return pos_; }
+      [[nodiscard]] size_type remaining() const noexcept { return remaining_; }
+
+      //-----------------------------------------------------------------------
+      // reserves the first record for a payload of total bytes; a payload that
+      // fits one record is written as an ordinary entry record
+      [[nodiscard]] bool begin(id_type entry, size_type total) noexcept { return begin(entry, total, {}, {}); }
+
+      //-----------------------------------------------------------------------
+      // prefix is copied ahead of the payload (and chain id) of the first
+      // record, which gets flags; see recordFlagContext and recordFlagBacktrace
+      [[nodiscard]] bool begin(id_type entry, size_type total, std::uint16_t flags, gsl::span<const std::byte> prefix) noexcept
+      {
+        total_ = total;
+        chained_ = total + prefix.size() > fragmentSize_;
+
+        const size_type payload{ chained_ ? fragmentSize_ : total + prefix.size() };
+        record_ = ring_.reserve(RecordHeader::recordSize(payload));
+        if (!record_) {
+          failed_ = true;
+          return false;
+        }
+
+        timestamp_ = RecordHeader::now();
+        RecordHeader& header{ start(RecordKind::Entry, entry) };
+        pos_ = record_ + sizeof(RecordHeader);
+        remaining_ = payload;
+
+        header.flags_ = flags;
+        if (!prefix.empty()) {
+          memcpy(pos_, prefix.data(), prefix.size());
+          pos_ += prefix.size();
+          remaining_ -= prefix.size();
+        }
+        if (chained_) {
+          id_ = nextId();
+          header.flags_ |= recordFlagContinued();
+          memcpy(pos_, &id_, sizeof(id_));
+          pos_ += sizeof(id_);
+          remaining_ -= sizeof(id_);
+        }
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      // copies size bytes, continuing in a new record whenever the current one
+      // is full and more of the payload is still to come
+      void write(std::byte*& buffer, const void* source, size_type size, size_type& remaining) noexcept
+      {
+        const std::byte* from{ static_cast<const std::byte*>(source) };
+        while (true) {
+          const size_type part{ std::min(size, remaining) };
+          if (0 != part)
+            memcpy(buffer, from, part);
+          buffer += part;
+          from += part;
+          size -= part;
+          remaining -= part;
+
+          if ((0 != remaining) || (written(buffer) >= total_) || !spill(buffer, remaining))
+            return;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void finish(const std::byte* end) noexcept
+      {
+        if (failed_)
+          return;
+
+        const bool first{ chained_ && (1 == fragments_) };
+        if (!first)
+          reinterpret_cast<RecordHeader*>(record_)->flags_ &= static_cast<std::uint16_t>(~recordFlagContinued());
+        ring_.commit(seal(end));
+        if (!first)
+          return;
+
+        // the payload turned out smaller than announced, the chain still needs its end
+        record_ = ring_.reserve(RecordHeader::recordSize(0));
+        if (!record_)
+          return;
+        start(RecordKind::Fragment, id_);
+        ++fragments_;
+        ring_.commit(seal(record_ + sizeof(RecordHeader)));
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static FragmentWriter*& current() noexcept
+      {
+        thread_local FragmentWriter* current{ nullptr };
+        return current;
+      }
+
+      //-----------------------------------------------------------------------
+      // chain ids only have to be unique among the chains a reader may see
+      // interleaved, including those of other processes sharing a collector
+      [[nodiscard]] static id_type nextId() noexcept
+      {
+        static std::atomic<id_type> next{ (RecordHeader::now() ^ reinterpret_cast<std::uintptr_t>(&next)) * 0x9E3779B97F4A7C15ull };
+        return next.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      //-----------------------------------------------------------------------
+      RecordHeader& start(RecordKind kind, id_type entry) noexcept
+      {
+        RecordHeader& header{ *reinterpret_cast<RecordHeader*>(record_) };
+        header.kind_ = kind;
+        header.flags_ = {};
+        header.entry_ = entry;
+        header.timestamp_ = timestamp_;
+        ++fragments_;
+        return header;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] size_type seal(const std::byte* end) noexcept
+      {
+        RecordHeader& header{ *reinterpret_cast<RecordHeader*>(record_) };
+        header.size_ = static_cast<std::uint32_t>(RecordHeader::align(static_cast<size_type>(end - record_)));
+        return header.size_;
+      }
+
+      //-----------------------------------------------------------------------
+      // payload bytes packed so far, buffer being the current pack position
+      [[nodiscard]] size_type written(const std::byte* buffer) const noexcept
+      {
+        return written_ + static_cast<size_type>(buffer - pos_);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool spill(std::byte*& buffer, size_type& remaining) noexcept
+      {
+        if (failed_)
+          return false;
+
+        reinterpret_cast<RecordHeader*>(record_)->flags_ |= recordFlagContinued();
+        ring_.commit(seal(buffer));
+        written_ = written(buffer);
+
+        const size_type left{ total_ - written_ };
+        const size_type payload{ std::min(left, fragmentSize_) };
+        const size_type size{ RecordHeader::recordSize(payload) };
+        const auto deadline{ std::chrono::steady_clock::now() + wait_ };
+        while (!(record_ = ring_.tryReserve(size))) {
+          if (std::chrono::steady_clock::now() >= deadline) {
+            record_ = ring_.reserve(size);
+            if (record_)
+              break;
+            failed_ = true;
+            return false;
+          }
+          std::this_thread::yield();
+        }
+
+        RecordHeader& header{ start(RecordKind::Fragment, id_) };
+        if (payload < left)
+          header.flags_ = recordFlagContinued();
+        buffer = pos_ = record_ + sizeof(RecordHeader);
+        remaining = payload;
+        return true;
+      }
+
+    protected:
+      Ring& ring_;
+      const size_type fragmentSize_{};
+      const std::chrono::microseconds wait_{};
+      FragmentWriter* const previous_{ nullptr };
+
+      std::byte* record_{ nullptr };
+      std::byte* pos_{ nullptr };           // where the payload of the current record starts
+      size_type remaining_{};
+      size_type total_{};
+      size_type written_{};                 // payload bytes in the records before the current one
+      size_type fragments_{};
+      id_type id_{};
+      std::uint64_t timestamp_{};
+      bool chained_{};
+      bool failed_{};
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Records gathered by one drain pass. The spans point directly into the
+    // producer rings and stay valid until the drain releases them after every
+    // sink has written the batch. A record with references is made up of
+    // several spans; only the first of them starts with its header, the
+    // others are marked as continuing the record before them.
+    struct Batch
+    {
+      using size_type = zs::size_type;
+      using record_type = gsl::span<const std::byte>;
+
+      std::vector<record_type> records_;
+      std::vector<bool> continued_;
+      size_type bytes_{};
+
+      [[nodiscard]] bool empty() const noexcept { return records_.empty(); }
+
+      //-----------------------------------------------------------------------
+      void add(const RecordHeader& header) noexcept
+      {
+        add(record_type{ reinterpret_cast<const std::byte*>(&header), static_cast<size_type>(header.size_) }, false);
+      }
+
+      //-----------------------------------------------------------------------
+      void add(record_type bytes, bool continued) noexcept
+      {
+        records_.push_back(bytes);
+        continued_.push_back(continued);
+        bytes_ += bytes.size();
+      }
+
+      //-----------------------------------------------------------------------
+      void clear() noexcept
+      {
+        records_.clear();
+        continued_.clear();
+        bytes_ = 0;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    class Sink
+    {
+    public:
+      using size_type = zs::size_type;
+      using clock_type = std::chrono::steady_clock;
+
+      virtual ~Sink() noexcept = default;
+
+      // called with the records pending so far and how long the oldest one
+      // has been waiting; returning false lets the drain keep batching
+      [[nodiscard]] virtual bool ready([[maybe_unused]] const Batch& pending, [[maybe_unused]] clock_type::duration age) const noexcept { return true; }
+
+      virtual void write(const Batch& batch) noexcept = 0;
+      virtual void flush() noexcept {}
+    };
+
+    //-------------------------------------------------------------------------
+    // Decides which entry records a sink gets to see from the record header
+    // and the call site it came from (nullptr if the site is not known to
+    // this process). Schema records always pass and fragments follow the
+    // record that started their chain.
+    using RecordFilter = std::function<bool(const RecordHeader&, const MetaDataLogEntry*)>;
+
+    //-------------------------------------------------------------------------
+    struct SinkOptions
+    {
+      using size_type = zs::size_type;
+
+      RecordFilter filter_;
+      bool queued_{};                                   // written from a thread of its own, lagging behind without holding up the drain
+      size_type maxQueuedBytes_{ 64 * 1024 * 1024 };    // a queued sink further behind than this loses whole batches
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // A drained batch copied out of the rings once so that it can outlive
+    // them, shared by every queued sink. The records are stored back to back
+    // in bytes_ and batch_ holds one span per record into them.
+    struct SharedBatch
+    {
+      using size_type = zs::size_type;
+
+      std::vector<std::byte> bytes_;
+      Batch batch_;
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::shared_ptr<const SharedBatch> copy(const Batch& batch) noexcept
+      {
+        auto result{ std::make_shared<SharedBatch>() };
+        result->bytes_.resize(batch.bytes_);
+
+        std::byte* pos{ result->bytes_.data() };
+        const std::byte* start{ pos };
+        for (size_type index{}; index < batch.records_.size(); ++index) {
+          auto& record{ batch.records_[index] };
+          if ((!batch.continued_[index]) && (pos != start)) {
+            result->batch_.add(Batch::record_type{ start, static_cast<size_type>(pos - start) }, false);
+            start = pos;
+          }
+          memcpy(pos, record.data(), record.size());
+          pos += record.size();
+        }
+        if (pos != start)
+          result->batch_.add(Batch::record_type{ start, static_cast<size_type>(pos - start) }, false);
+        return result;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // The queue and thread of a sink registered with SinkOptions::queued_.
+    // Batches are written in order; a sink too far behind loses the batches
+    // that would take it past maxBytes.
+    class SinkQueue final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      //-----------------------------------------------------------------------
+      SinkQueue(std::shared_ptr<Sink> sink, size_type maxBytes) noexcept :
+        sink_{ std::move(sink) },
+        maxBytes_{ maxBytes }
+      {
+        thread_ = std::thread{ [this]() noexcept { run(); } };
+      }
+
+      SinkQueue(const SinkQueue&) noexcept = delete;
+      SinkQueue& operator=(const SinkQueue&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      // whatever is queued is still written
+      ~SinkQueue() noexcept
+      {
+        {
+          std::lock_guard lock{ mutex_ };
+          stopping_ = true;
+        }
+        wake_.notify_all();
+        thread_.join();
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] size_type dropped() const noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        return dropped_;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] size_type queuedBytes() const noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        return bytes_;
+      }
+
+      //-----------------------------------------------------------------------
+      // view is the part of the shared batch this sink wants; urgent batches
+      // are written before anything else still queued and never dropped
+      void push(std::shared_ptr<const SharedBatch> shared, Batch&& view) noexcept { push(std::move(shared), std::move(view), false); }
+
+      //-----------------------------------------------------------------------
+      void push(std::shared_ptr<const SharedBatch> shared, Batch&& view, bool urgent) noexcept
+      {
+        {
+          std::lock_guard lock{ mutex_ };
+          if (urgent) {
+            items_.insert(items_.begin() + static_cast<std::ptrdiff_t>(urgent_), Item{ std::move(shared), std::move(view), true });
+            ++urgent_;
+            wake_.notify_all();
+            return;
+          }
+          if ((0 != bytes_) && (bytes_ + view.bytes_ > maxBytes_)) {
+            dropped_ += view.records_.size();
+            return;
+          }
+          bytes_ += view.bytes_;
+          items_.push_back(Item{ std::move(shared), std::move(view) });
+        }
+        wake_.notify_all();
+      }
+
+      //-----------------------------------------------------------------------
+      // waits for everything queued so far to be written, then flushes the sink
+      void flush() noexcept
+      {
+        std::unique_lock lock{ mutex_ };
+        const size_type ticket{ ++flushRequested_ };
+        wake_.notify_all();
+        idle_.wait(lock, [&]() noexcept { return flushed_ >= ticket; });
+      }
+
+      //-----------------------------------------------------------------------
+      // waits for the urgent batches queued so far only, not the backlog
+      void flushUrgent() noexcept
+      {
+        std::unique_lock lock{ mutex_ };
+        const size_type ticket{ ++urgentRequested_ };
+        wake_.notify_all();
+        idle_.wait(lock, [&]() noexcept { return urgentFlushed_ >= ticket; });
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Item
+      {
+        std::shared_ptr<const SharedBatch> shared_;     // keeps the bytes of view_ alive
+        Batch view_;
+        bool urgent_{};
+      };
+
+      //-----------------------------------------------------------------------
+      void run() noexcept
+      {
+        std::unique_lock lock{ mutex_ };
+        while (true) {
+          wake_.wait(lock, [&]() noexcept { return stopping_ || (!items_.empty()) || (flushRequested_ != flushed_) || (urgentRequested_ != urgentFlushed_); });
+
+          if ((0 == urgent_) && (urgentRequested_ != urgentFlushed_)) {
+            const size_type ticket{ urgentRequested_ };
+            lock.unlock();
+            sink_->flush();
+            lock.lock();
+            urgentFlushed_ = ticket;
+            idle_.notify_all();
+            continue;
+          }
+
+          if (!items_.empty()) {
+            Item item{ std::move(items_.front()) };
+            items_.pop_front();
+            lock.unlock();
+            sink_->write(item.view_);
+            lock.lock();
+            if (item.urgent_)
+              --urgent_;
+            else
+              bytes_ -= item.view_.bytes_;
+            continue;
+          }
+
+          if (flushRequested_ != flushed_) {
+            const size_type ticket{ flushRequested_ };
+            lock.unlock();
+            sink_->flush();
+            lock.lock();
+            flushed_ = ticket;
+            idle_.notify_all();
+            continue;
+          }
+
+          if (stopping_)
+            return;
+        }
+      }
+
+    protected:
+      const std::shared_ptr<Sink> sink_;
+      const size_type maxBytes_{};
+
+      mutable std::mutex mutex_;
+      std::condition_variable wake_;
+      std::condition_variable idle_;
+      std::deque<Item> items_;                          // the urgent ones first
+      size_type urgent_{};
+      size_type bytes_{};
+      size_type dropped_{};
+      size_type flushRequested_{};
+      size_type flushed_{};
+      size_type urgentRequested_{};
+      size_type urgentFlushed_{};
+      bool stopping_{};
+
+      std::thread thread_;
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Where threads run on a NUMA host, as far as the drain cares: the node
+    // of the calling thread, the CPUs of a node and pinning a thread to some
+    // of them. Hosts without NUMA (or without Linux) have a single node 0.
+    class Numa final
+    {
+    public:
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static int node() noexcept
+      {
+#ifdef __linux__
+        unsigned cpu{};
+        unsigned node{};
+        if (0 == ::getcpu(&cpu, &node))
+          return static_cast<int>(node);
+#endif //__linux__
+        return 0;
+      }
+
+      //-----------------------------------------------------------------------
+      // e.g. "0-7,16-23" in /sys/devices/system/node/node0/cpulist; empty if
+      // the node is unknown
+      [[nodiscard]] static std::vector<int> cpus(int node) noexcept
+      {
+        std::vector<int> result;
+#ifdef __linux__
+        const std::string path{ "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist" };
+        FILE* file{ std::fopen(path.c_str(), "r") };
+        if (!file)
+          return result;
+        int first{};
+        while (1 == std::fscanf(file, "%d", &first)) {
+          int last{ first };
+          int separator{ std::fgetc(file) };
+          if ('-' == separator) {
+            if (1 != std::fscanf(file, "%d", &last))
+              break;
+            separator = std::fgetc(file);
+          }
+          for (int cpu{ first }; cpu <= last; ++cpu) {
+            result.push_back(cpu);
+          }
+          if (',' != separator)
+            break;
+        }
+        std::fclose(file);
+#else
+        (void)node;
+#endif //__linux__
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      // limits the calling thread to cpus; returns false if that failed or
+      // cpus is empty
+      static bool bind(const std::vector<int>& cpus) noexcept
+      {
+#ifdef __linux__
+        if (cpus.empty())
+          return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : cpus) {
+          if ((cpu >= 0) && (cpu < CPU_SETSIZE))
+            CPU_SET(cpu, &set);
+        }
+        return 0 == ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#else
+        (void)cpus;
+        return false;
+#endif //__linux__
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    class Drain final
+    {
+    public:
+      using size_type = zs::size_type;
+      using position_type = Ring::position_type;
+      using clock_type = Sink::clock_type;
+
+      struct Options
+      {
+        std::chrono::microseconds idle_{ 100 };   // sleep when there was nothing to drain
+        std::vector<int> cpus_;                   // the drain thread's affinity, e.g. Numa::cpus(node), any if empty
+      };
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static Drain& singleton() noexcept
+      {
+        static Drain singleton;
+        return singleton;
+      }
+
+      //-----------------------------------------------------------------------
+      // the calling thread's ring, registered with the drain on first use
+      [[nodiscard]] static Ring& local() noexcept
+      {
+        struct LocalRing final
+        {
+          std::shared_ptr<Ring> ring_{ singleton().attach() };
+          ~LocalRing() noexcept { ring_->orphan(); }
+        };
+        thread_local LocalRing local;
+        return *local.ring_;
+      }
+
+      //-----------------------------------------------------------------------
+      // the calling thread's ring for Severity::Critical and above; threads
+      // whose rings come from a ring factory are drained elsewhere and so use
+      // their ordinary ring
+      [[nodiscard]] static Ring& urgent() noexcept
+      {
+        struct UrgentRing final
+        {
+          std::shared_ptr<Ring> ring_{ singleton().attachUrgent() };
+          ~UrgentRing() noexcept { if (ring_) ring_->orphan(); }
+        };
+        thread_local UrgentRing urgent;
+        return urgent.ring_ ? *urgent.ring_ : local();
+      }
+
+      //-----------------------------------------------------------------------
+      void add(std::shared_ptr<Sink> sink) noexcept { add(std::move(sink), SinkOptions{}); }
+
+      //-----------------------------------------------------------------------
+      // a new sink is first told about every registered call site so that
+      // whatever it writes can be decoded on its own
+      void add(std::shared_ptr<Sink> sink, const SinkOptions& options) noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        describe();
+        describeAll(*sink);
+
+        Slot slot;
+        slot.sink_ = std::move(sink);
+        slot.filter_ = options.filter_;
+        if (options.queued_)
+          slot.queue_ = std::make_unique<SinkQueue>(slot.sink_, options.maxQueuedBytes_);
+        sinks_.push_back(std::move(slot));
+      }
+
+      //-----------------------------------------------------------------------
+      // a queued sink is removed once everything queued for it is written
+      void remove(const std::shared_ptr<Sink>& sink) noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        sinks_.erase(std::remove_if(sinks_.begin(), sinks_.end(), [&](const Slot& slot) noexcept { return slot.sink_ == sink; }), sinks_.end());
+      }
+
+      //-----------------------------------------------------------------------
+      // gathers newly committed records and hands them to the sinks once any
+      // sink is ready (or force is set); returns true if a batch was written.
+      // The counts Repeats holds back for maxRepeatRunAge go along, all of
+      // them if settle is set, threads that have not logged since included.
+      bool drainOnce(bool force = false, bool settle = false) noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        Draining draining;
+
+        describe();
+        const bool urgent{ drainUrgent() };
+
+        bool pressure{ force };
+        for (auto& source : sources_) {
+          if (source.urgent_)
+            continue;
+          scan(source);
+          pressure = pressure || (source.ring_->used() > (source.ring_->capacity() / 2));
+        }
+        settleRepeats(settle);
+
+        if (pending_.empty()) {
+          releaseAll();
+          return urgent;
+        }
+
+        const auto age{ clock_type::now() - pendingSince_ };
+        bool ready{ pressure || sinks_.empty() };
+        for (auto& slot : sinks_) {
+          ready = ready || slot.sink_->ready(pending_, age);
+        }
+        if (!ready)
+          return urgent;
+
+        // the queued sinks all share one copy, the others read the rings in place
+        std::shared_ptr<const SharedBatch> shared;
+        for (auto& slot : sinks_) {
+          if (!slot.queue_) {
+            if (!slot.filter_) {
+              slot.sink_->write(pending_);
+              continue;
+            }
+            Batch view;
+            select(slot, pending_, view);
+            if (!view.empty())
+              slot.sink_->write(view);
+            continue;
+          }
+
+          if (!shared)
+            shared = SharedBatch::copy(pending_);
+          Batch view;
+          if (slot.filter_)
+            select(slot, shared->batch_, view);
+          else
+            view = shared->batch_;
+          if (!view.empty())
+            slot.queue_->push(shared, std::move(view));
+        }
+        pending_.clear();
+        schemas_.clear();
+        repeats_.clear();
+        releaseReferences();
+        releaseAll();
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      void flush() noexcept
+      {
+        drainOnce(true, true);
+
+        std::lock_guard lock{ mutex_ };
+        for (auto& slot : sinks_) {
+          if (slot.queue_)
+            slot.queue_->flush();
+          else
+            slot.sink_->flush();
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // what a Fatal entry waits for: the urgent records reach every sink
+      // and are flushed, whatever backlog the ordinary rings hold; a thread
+      // logging from within the drain does not wait for itself
+      void flushUrgent() noexcept
+      {
+        if (Draining::active())
+          return;
+
+        std::lock_guard lock{ mutex_ };
+        Draining draining;
+        describe();
+        drainUrgent();
+        for (auto& slot : sinks_) {
+          if (slot.queue_)
+            slot.queue_->flushUrgent();
+          else
+            slot.sink_->flush();
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void start() noexcept { start(Options{}); }
+
+      //-----------------------------------------------------------------------
+      void start(std::chrono::microseconds idle) noexcept
+      {
+        Options options;
+        options.idle_ = idle;
+        start(options);
+      }
+
+      //-----------------------------------------------------------------------
+      void start(const Options& options) noexcept
+      {
+        if (running_.exchange(true))
+          return;
+        thread_ = std::thread{ [this, options]() noexcept {
+          Numa::bind(options.cpus_);
+          while (running_.load(std::memory_order_acquire)) {
+            if (!drainOnce())
+              std::this_thread::sleep_for(options.idle_);
+          }
+        } };
+      }
+
+      //-----------------------------------------------------------------------
+      void stop() noexcept
+      {
+        if (!running_.exchange(false))
+          return;
+        thread_.join();
+        flush();
+      }
+
+      //-----------------------------------------------------------------------
+      // threads that log for the first time get their ring from the factory
+      // instead; such rings are not drained here but by whoever provided them
+      // (a factory returning nullptr falls back to a locally drained ring)
+      void ringFactory(std::function<std::shared_ptr<Ring>()> factory) noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        ringFactory_ = std::move(factory);
+      }
+
+      //-----------------------------------------------------------------------
+      // the pages of the rings given to threads that log for the first time
+      // from now on; huge pages take TLB misses off the drain when it walks
+      // many rings
+      void ringPages(RingPages pages) noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        ringPages_ = pages;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] size_type dropped() const noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        size_type result{ dropped_ };
+        for (auto& source : sources_) {
+          result += source.ring_->dropped();
+        }
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      // records a queued sink lost by falling too far behind
+      [[nodiscard]] size_type lagDropped(const std::shared_ptr<Sink>& sink) const noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        for (auto& slot : sinks_) {
+          if ((slot.sink_ == sink) && slot.queue_)
+            return slot.queue_->dropped();
+        }
+        return 0;
+      }
+
+      ~Drain() noexcept { stop(); }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Source
+      {
+        std::shared_ptr<Ring> ring_;
+        position_type scan_{};
+        bool urgent_{};
+      };
+
+      //-----------------------------------------------------------------------
+      // marks the thread currently working for the drain
+      struct Draining final
+      {
+        Draining() noexcept { active() = true; }
+        ~Draining() noexcept { active() = false; }
+
+        [[nodiscard]] static bool& active() noexcept
+        {
+          thread_local bool active{};
+          return active;
+        }
+      };
+
+      //-----------------------------------------------------------------------
+      struct Slot
+      {
+        std::shared_ptr<Sink> sink_;
+        RecordFilter filter_;
+        std::unordered_set<std::uint64_t> chains_;      // fragment chains the filter let through
+        std::unique_ptr<SinkQueue> queue_;
+      };
+
+      Drain() noexcept = default;
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] std::shared_ptr<Ring> attach() noexcept
+      {
+        std::function<std::shared_ptr<Ring>()> factory;
+        RingPages pages{};
+        {
+          std::lock_guard lock{ mutex_ };
+          factory = ringFactory_;
+          pages = ringPages_;
+        }
+        if (factory) {
+          if (auto ring{ factory() })
+            return ring;
+        }
+
+        // allocated by the logging thread, which places the buffer on its node
+        auto ring{ std::make_shared<Ring>(defaultRingCapacity(), pages) };
+        std::lock_guard lock{ mutex_ };
+        sources_.push_back(Source{ ring });
+        return ring;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] std::shared_ptr<Ring> attachUrgent() noexcept
+      {
+        std::lock_guard lock{ mutex_ };
+        if (ringFactory_)
+          return {};
+        auto ring{ std::make_shared<Ring>(urgentRingCapacity()) };
+        sources_.push_back(Source{ ring, {}, true });
+        return ring;
+      }
+
+      //-----------------------------------------------------------------------
+      // writes whatever the urgent rings hold straight away, in a batch of
+      // its own ahead of anything pending; the call sites described but not
+      // written yet go along so the batch can be decoded on its own
+      bool drainUrgent() noexcept
+      {
+        const size_type referenced{ references_.size() };
+        Batch batch;
+        for (auto& source : sources_) {
+          if (!source.urgent_)
+            continue;
+          const position_type head{ source.ring_->head() };
+          while (source.scan_ != head) {
+            RecordHeader& header{ source.ring_->at(source.scan_) };
+            source.scan_ += header.size_;
+            if (RecordKind::Padding == header.kind_)
+              continue;
+            if (0 != (header.flags_ & recordFlagReferences()))
+              expand(header, batch);
+            else
+              batch.add(header);
+          }
+        }
+        if (batch.empty())
+          return false;
+
+        if (!schemas_.empty()) {
+          Batch described;
+          for (auto& schema : schemas_) {
+            described.add(*reinterpret_cast<const RecordHeader*>(schema.data()));
+          }
+          for (size_type index{}; index < batch.records_.size(); ++index) {
+            described.add(batch.records_[index], batch.continued_[index]);
+          }
+          batch = std::move(described);
+        }
+
+        std::shared_ptr<const SharedBatch> shared;
+        for (auto& slot : sinks_) {
+          Batch view;
+          if (!slot.queue_) {
+            if (!slot.filter_) {
+              slot.sink_->write(batch);
+              continue;
+            }
+            select(slot, batch, view);
+            if (!view.empty())
+              slot.sink_->write(view);
+            continue;
+          }
+          if (!shared)
+            shared = SharedBatch::copy(batch);
+          if (slot.filter_)
+            select(slot, shared->batch_, view);
+          else
+            view = shared->batch_;
+          if (!view.empty())
+            slot.queue_->push(shared, std::move(view), true);
+        }
+
+        for (auto it{ references_.begin() + static_cast<std::ptrdiff_t>(referenced) }; it != references_.end(); ++it) {
+          std::destroy(it->begin(), it->end());
+        }
+        references_.resize(referenced);
+        for (auto& source : sources_) {
+          if (source.urgent_)
+            source.ring_->release(source.scan_);
+        }
+
+        // the schemas went out ahead of the urgent records and are not
+        // written again with the pending batch
+        if (!schemas_.empty()) {
+          Batch rest;
+          size_type next{};
+          for (size_type index{}; index < pending_.records_.size(); ++index) {
+            if ((next < schemas_.size()) && (pending_.records_[index].data() == schemas_[next].data())) {
+              ++next;
+              continue;
+            }
+            rest.add(pending_.records_[index], pending_.continued_[index]);
+          }
+          pending_ = std::move(rest);
+          schemas_.clear();
+        }
+        return true;
+      }
+
+      // both are defined in LogSchema.h
+      void describe() noexcept;
+      void describeModules() noexcept;
+      void describeAll(Sink& sink) noexcept;
+
+      // defined in LogRepeat.h
+      void settleRepeats(bool all) noexcept;
+
+      //-----------------------------------------------------------------------
+      void scan(Source& source) noexcept
+      {
+        const position_type head{ source.ring_->head() };
+        if (source.scan_ != head && pending_.empty())
+          pendingSince_ = clock_type::now();
+
+        while (source.scan_ != head) {
+          RecordHeader& header{ source.ring_->at(source.scan_) };
+          source.scan_ += header.size_;
+          if (RecordKind::Padding == header.kind_)
+            continue;
+          if (0 != (header.flags_ & recordFlagReferences()))
+            expand(header);
+          else
+            pending_.add(header);
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // hands the referenced bytes to the sinks where the record says they
+      // belong; the header is rewritten in place to describe the record the
+      // sinks see, the ring is no longer walked past it
+      void expand(RecordHeader& header) noexcept { expand(header, pending_); }
+
+      //-----------------------------------------------------------------------
+      void expand(RecordHeader& header, Batch& batch) noexcept
+      {
+        static constexpr std::byte zeroes[recordAlignment()]{};
+
+        std::byte* record{ reinterpret_cast<std::byte*>(&header) };
+        RecordReferences trailer;
+        memcpy(&trailer, record + header.size_ - sizeof(trailer), sizeof(trailer));
+        const gsl::span<RecordReference> references{ reinterpret_cast<RecordReference*>(record + RecordHeader::recordSize(trailer.payloadSize_)), trailer.count_ };
+
+        size_type size{ sizeof(RecordHeader) + trailer.payloadSize_ };
+        for (auto& reference : references) {
+          size += static_cast<size_type>(reference.size_);
+        }
+        header.size_ = static_cast<std::uint32_t>(RecordHeader::align(size));
+        header.flags_ = static_cast<std::uint16_t>(header.flags_ & ~recordFlagReferences());
+
+        const std::byte* payload{ header.payload() };
+        const std::byte* from{ record };
+        bool continued{};
+        auto piece{ [&](const std::byte* data, size_type length) noexcept {
+          if (0 == length)
+            return;
+          batch.add(Batch::record_type{ data, length }, continued);
+          continued = true;
+        } };
+        for (auto& reference : references) {
+          piece(from, static_cast<size_type>((payload + reference.offset_) - from));
+          piece(reference.data_, static_cast<size_type>(reference.size_));
+          from = payload + reference.offset_;
+        }
+        piece(from, static_cast<size_type>((payload + trailer.payloadSize_) - from));
+        piece(zeroes, header.size_ - size);
+
+        references_.push_back(references);
+      }
+
+      //-----------------------------------------------------------------------
+      // only the spans of the records the filter lets through go into view
+      void select(Slot& slot, const Batch& batch, Batch& view) noexcept
+      {
+        bool keep{};
+        for (size_type index{}; index < batch.records_.size(); ++index) {
+          auto& record{ batch.records_[index] };
+          if (!batch.continued_[index])
+            keep = accepts(slot, *reinterpret_cast<const RecordHeader*>(record.data()));
+          if (keep)
+            view.add(record, batch.continued_[index]);
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool accepts(Slot& slot, const RecordHeader& header) noexcept
+      {
+        switch (header.kind_) {
+          case RecordKind::Entry: {
+            auto found{ sites_.find(header.entry_) };
+            if (!slot.filter_(header, found == sites_.end() ? nullptr : found->second))
+              return false;
+            if (0 != (header.flags_ & recordFlagContinued())) {
+              std::uint64_t chain{};
+              memcpy(&chain, header.payload() + header.prefixSize(), sizeof(chain));
+              slot.chains_.insert(chain);
+            }
+            return true;
+          }
+          case RecordKind::Fragment: {
+            auto found{ slot.chains_.find(header.entry_) };
+            if (found == slot.chains_.end())
+              return false;
+            if (0 == (header.flags_ & recordFlagContinued()))
+              slot.chains_.erase(found);
+            return true;
+          }
+          case RecordKind::Repeat:
+          case RecordKind::Batch: {
+            auto found{ sites_.find(header.entry_) };
+            return slot.filter_(header, found == sites_.end() ? nullptr : found->second);
+          }
+          default:  break;
+        }
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      void releaseReferences() noexcept
+      {
+        for (auto& references : references_) {
+          std::destroy(references.begin(), references.end());
+        }
+        references_.clear();
+      }
+
+      //-----------------------------------------------------------------------
+      void releaseAll() noexcept
+      {
+        for (auto& source : sources_) {
+          source.ring_->release(source.scan_);
+        }
+
+        auto isFinished{ [](const Source& source) noexcept { return source.ring_->orphaned() && (source.ring_->head() == source.scan_); } };
+        for (auto& source : sources_) {
+          if (isFinished(source))
+            dropped_ += source.ring_->dropped();
+        }
+        sources_.erase(std::remove_if(sources_.begin(), sources_.end(), isFinished), sources_.end());
+      }
+
+    protected:
+      mutable std::mutex mutex_;
+      std::vector<Source> sources_;
+      std::vector<Slot> sinks_;
+      std::unordered_map<std::uint64_t, const MetaDataLogEntry*> sites_;   // every call site described so far
+
+      Batch pending_;
+      std::vector<gsl::span<RecordReference>> references_;    // in pending_, destroyed once it is written
+      std::vector<std::vector<std::byte>> schemas_;        // schema and modules records in pending_
+      std::vector<std::vector<std::byte>> repeats_;        // repeat records settled on behalf of their threads, in pending_
+      const MetaDataLogEntry* described_{ nullptr };
+      std::uint64_t modules_{ UINT64_MAX };                 // ModuleMap::generation() last described
+      clock_type::time_point pendingSince_{};
+      size_type dropped_{};
+
+      std::function<std::shared_ptr<Ring>()> ringFactory_;
+      RingPages ringPages_{ RingPages::Normal };
+
+      std::atomic_bool running_{};
+      std::thread thread_;
+    };
+
+  } // namespace log
+} // namespace zs
@@ -0,0 +1,478 @@
+
+#pragma once
+
+#include "LogFileSink.h"
+
+#ifndef _WIN32
+
+#include <memory>
+#include <vector>
+
+#include <fcntl.h>
+
+#if defined(__linux__) && defined(__has_include) && !defined(ZS_LOG_NO_IO_URING)
+# if __has_include(<linux/io_uring.h>)
+#   define ZS_LOG_HAS_IO_URING
+# endif //__has_include(<linux/io_uring.h>)
+#endif //defined(__linux__) && defined(__has_include) && !defined(ZS_LOG_NO_IO_URING)
+
+#ifdef ZS_LOG_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif //ZS_LOG_HAS_IO_URING
+
+namespace zs
+{
+  namespace log
+  {
+#ifdef ZS_LOG_HAS_IO_URING
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Asynchronous file sink on top of io_uring. Drained records are copied
+    // into a set of segment buffers registered with the kernel; a full (or
+    // flushed) segment is submitted as a WRITE_FIXED, optionally linked to an
+    // fdatasync, and the drain moves on while the kernel writes. Up to
+    // segments_ writes are in flight at once, the drain only blocks when all
+    // of them are still busy.
+    class UringSink : public Sink
+    {
+    public:
+      struct Options
+      {
+        size_type segments_{ 4 };
+        size_type segmentSize_{ 1024 * 1024 };
+        bool closeOnDestroy_{};
+        bool sync_{};                   // link an fdatasync to every segment write
+        size_type checksumBytes_{};     // 0 for no checksum records, see WritevSink
+      };
+
+      //-----------------------------------------------------------------------
+      // returns nullptr if io_uring is not available on this kernel (or is
+      // disallowed by the sandbox), the caller should fall back to PwriteSink
+      [[nodiscard]] static std::shared_ptr<UringSink> create(int fd, const Options& options, ::off_t offset = 0) noexcept
+      {
+        std::shared_ptr<UringSink> result{ new UringSink(fd, options, offset) };
+        if (!result->setup()) {
+          result->options_.closeOnDestroy_ = false;
+          return {};
+        }
+        return result;
+      }
+
+      UringSink(const UringSink&) noexcept = delete;
+      UringSink(UringSink&&) noexcept = delete;
+
+      UringSink& operator=(const UringSink&) noexcept = delete;
+      UringSink& operator=(UringSink&&) noexcept = delete;
+
+      //-----------------------------------------------------------------------
+      ~UringSink() noexcept override
+      {
+        if (ringFd_ >= 0) {
+          if (!segments_.empty())
+            flush();
+          ::syscall(__NR_io_uring_register, ringFd_, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        }
+        if (sqes_)
+          ::munmap(sqes_, sqesSize_);
+        if (cqRing_ && (cqRing_ != sqRing_))
+          ::munmap(cqRing_, cqRingSize_);
+        if (sqRing_)
+          ::munmap(sqRing_, sqRingSize_);
+        if (ringFd_ >= 0)
+          ::close(ringFd_);
+        if (options_.closeOnDestroy_ && (fd_ >= 0))
+          ::close(fd_);
+      }
+
+      [[nodiscard]] int fd() const noexcept { return fd_; }
+      [[nodiscard]] ::off_t offset() const noexcept { return offset_; }
+      [[nodiscard]] size_type errors() const noexcept { return errors_; }
+      [[nodiscard]] size_type inFlight() const noexcept { return inFlight_; }
+
+      //-----------------------------------------------------------------------
+      void write(const Batch& batch) noexcept override
+      {
+        reap(false);
+
+        if ((0 != options_.checksumBytes_) && (!checksummed_)) {
+          checksummed_ = true;
+          addChecksum(acquireCurrent());
+        }
+
+        // room is kept at the end of every segment for a checksum record
+        const size_type segmentSize{ options_.segmentSize_ - (0 != options_.checksumBytes_ ? sizeof(Checksum) : 0) };
+        for (auto& record : batch.records_) {
+          if (record.size() > segmentSize) {
+            submitCurrent();
+            if (0 != options_.checksumBytes_) {
+              crc_ = Crc32c::update(crc_, record.data(), record.size());
+              blockBytes_ += record.size();
+            }
+            writeDirect(record.data(), record.size());
+            continue;
+          }
+          Segment* segment{ &acquireCurrent() };
+          if (segment->used_ + record.size() > segmentSize) {
+            submitCurrent();
+            segment = &acquireCurrent();
+          }
+          memcpy(segment->buffer_.get() + segment->used_, record.data(), record.size());
+          segment->used_ += record.size();
+        }
+
+        // hand whatever was gathered to the kernel, the drain keeps going
+        submitCurrent();
+      }
+
+      //-----------------------------------------------------------------------
+      void flush() noexcept override
+      {
+        if ((0 != options_.checksumBytes_) && ((0 != blockBytes_) || (segments_[current_].used_ > segments_[current_].summed_))) {
+          // whatever the block has so far, written or not, ends here
+          Segment& segment{ acquireCurrent() };
+          sum(segment);
+          addChecksum(segment);
+        }
+        submitCurrent();
+        while (inFlight_ > 0) {
+          reap(true);
+        }
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      struct Segment
+      {
+        std::unique_ptr<std::byte[]> buffer_;
+        size_type used_{};
+        size_type summed_{};            // bytes taken into the block's checksum
+        size_type pending_{};           // outstanding completions (write and linked fsync)
+        ::off_t offset_{};
+      };
+
+      constexpr static std::uint64_t fsyncFlag{ static_cast<std::uint64_t>(1) << 63 };
+
+      //-----------------------------------------------------------------------
+      UringSink(int fd, const Options& options, ::off_t offset) noexcept :
+        fd_{ fd },
+        options_{ options },
+        offset_{ offset }
+      {
+        if (options_.segments_ < 1)
+          options_.segments_ = 1;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool setup() noexcept
+      {
+        ::io_uring_params params{};
+        const unsigned entries{ static_cast<unsigned>(options_.segments_ * 2) };
+
+        ringFd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (ringFd_ < 0)
+          return false;
+
+        sqRingSize_ = params.sq_off.array + (params.sq_entries * sizeof(std::uint32_t));
+        cqRingSize_ = params.cq_off.cqes + (params.cq_entries * sizeof(::io_uring_cqe));
+        const bool singleMap{ 0 != (params.features & IORING_FEAT_SINGLE_MMAP) };
+        if (singleMap)
+          sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+        sqRing_ = map(sqRingSize_, IORING_OFF_SQ_RING);
+        if (!sqRing_)
+          return false;
+        cqRing_ = singleMap ? sqRing_ : map(cqRingSize_, IORING_OFF_CQ_RING);
+        if (!cqRing_)
+          return false;
+        sqesSize_ = params.sq_entries * sizeof(::io_uring_sqe);
+        sqes_ = static_cast<::io_uring_sqe*>(map(sqesSize_, IORING_OFF_SQES));
+        if (!sqes_)
+          return false;
+
+        auto* sq{ static_cast<std::byte*>(sqRing_) };
+        sqHead_ = reinterpret_cast<std::atomic<std::uint32_t>*>(sq + params.sq_off.head);
+        sqTail_ = reinterpret_cast<std::atomic<std::uint32_t>*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<std::uint32_t*>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.array);
+        sqEntries_ = params.sq_entries;
+
+        auto* cq{ static_cast<std::byte*>(cqRing_) };
+        cqHead_ = reinterpret_cast<std::atomic<std::uint32_t>*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<std::atomic<std::uint32_t>*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<std::uint32_t*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<::io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        segments_.resize(options_.segments_);
+        std::vector<::iovec> buffers;
+        for (auto& segment : segments_) {
+          segment.buffer_ = std::make_unique<std::byte[]>(options_.segmentSize_);
+          buffers.push_back(::iovec{ segment.buffer_.get(), options_.segmentSize_ });
+        }
+        return 0 == ::syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_BUFFERS, buffers.data(), static_cast<unsigned>(buffers.size()));
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] void* map(size_type size, ::off_t offset) noexcept
+      {
+        void* result{ ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, offset) };
+        return MAP_FAILED == result ? nullptr : result;
+      }
+
+      //-----------------------------------------------------------------------
+      Segment& acquireCurrent() noexcept
+      {
+        while (0 != segments_[current_].pending_) {
+          reap(true);
+        }
+        return segments_[current_];
+      }
+
+      //-----------------------------------------------------------------------
+      void submitCurrent() noexcept
+      {
+        auto& segment{ segments_[current_] };
+        if ((0 == segment.used_) || (0 != segment.pending_))
+          return;
+
+        if (0 != options_.checksumBytes_) {
+          sum(segment);
+          if (blockBytes_ >= options_.checksumBytes_)
+            addChecksum(segment);
+        }
+
+        segment.offset_ = offset_;
+        offset_ += static_cast<::off_t>(segment.used_);
+
+        ::io_uring_sqe& write{ nextSqe() };
+        write.opcode = IORING_OP_WRITE_FIXED;
+        write.fd = fd_;
+        write.off = static_cast<std::uint64_t>(segment.offset_);
+        write.addr = reinterpret_cast<std::uint64_t>(segment.buffer_.get());
+        write.len = static_cast<std::uint32_t>(segment.used_);
+        write.buf_index = static_cast<std::uint16_t>(current_);
+        write.user_data = current_;
+        segment.pending_ = 1;
+
+        if (options_.sync_) {
+          write.flags |= IOSQE_IO_LINK;
+
+          ::io_uring_sqe& sync{ nextSqe() };
+          sync.opcode = IORING_OP_FSYNC;
+          sync.fd = fd_;
+          sync.fsync_flags = IORING_FSYNC_DATASYNC;
+          sync.user_data = current_ | fsyncFlag;
+          segment.pending_ = 2;
+        }
+
+        ++inFlight_;
+        enter(0);
+        current_ = (current_ + 1) % segments_.size();
+      }
+
+      //-----------------------------------------------------------------------
+      void sum(Segment& segment) noexcept
+      {
+        crc_ = Crc32c::update(crc_, segment.buffer_.get() + segment.summed_, segment.used_ - segment.summed_);
+        blockBytes_ += segment.used_ - segment.summed_;
+        segment.summed_ = segment.used_;
+      }
+
+      //-----------------------------------------------------------------------
+      // the segment has room for it, see write()
+      void addChecksum(Segment& segment) noexcept
+      {
+        const Checksum record{ Checksum::make(crc_, blockBytes_) };
+        memcpy(segment.buffer_.get() + segment.used_, &record, sizeof(record));
+        segment.used_ += sizeof(record);
+        segment.summed_ = segment.used_;
+        crc_ = 0;
+        blockBytes_ = 0;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] ::io_uring_sqe& nextSqe() noexcept
+      {
+        const std::uint32_t tail{ sqTail_->load(std::memory_order_relaxed) };
+        while (tail - sqHead_->load(std::memory_order_acquire) >= sqEntries_) {
+          enter(0);
+        }
+        ::io_uring_sqe& sqe{ sqes_[tail & sqMask_] };
+        memset(&sqe, 0, sizeof(sqe));
+        sqArray_[tail & sqMask_] = tail & sqMask_;
+        sqTail_->store(tail + 1, std::memory_order_release);
+        ++unsubmitted_;
+        return sqe;
+      }
+
+      //-----------------------------------------------------------------------
+      void enter(unsigned waitFor) noexcept
+      {
+        const unsigned flags{ waitFor > 0 ? static_cast<unsigned>(IORING_ENTER_GETEVENTS) : 0u };
+        while (true) {
+          auto result{ ::syscall(__NR_io_uring_enter, ringFd_, unsubmitted_, waitFor, flags, nullptr, 0) };
+          if (result >= 0) {
+            unsubmitted_ -= std::min(unsubmitted_, static_cast<unsigned>(result));
+            return;
+          }
+          if ((EINTR == errno) || (EAGAIN == errno) || (EBUSY == errno))
+            continue;
+          ++errors_;
+          return;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void reap(bool wait) noexcept
+      {
+        if (0 == inFlight_)
+          return;
+
+        std::uint32_t head{ cqHead_->load(std::memory_order_relaxed) };
+        if (wait && (head == cqTail_->load(std::memory_order_acquire)))
+          enter(1);
+
+        const std::uint32_t tail{ cqTail_->load(std::memory_order_acquire) };
+        for (; head != tail; ++head) {
+          const ::io_uring_cqe& cqe{ cqes_[head & cqMask_] };
+          const bool isSync{ 0 != (cqe.user_data & fsyncFlag) };
+          auto& segment{ segments_[static_cast<size_type>(cqe.user_data & ~fsyncFlag)] };
+
+          if (!isSync)
+            completeWrite(segment, cqe.res);
+          else if ((cqe.res < 0) && (-ECANCELED != cqe.res))
+            ++errors_;
+
+          if (0 == --segment.pending_) {
+            segment.used_ = 0;
+            segment.summed_ = 0;
+            --inFlight_;
+          }
+        }
+        cqHead_->store(head, std::memory_order_release);
+      }
+
+      //-----------------------------------------------------------------------
+      void completeWrite(const Segment& segment, std::int32_t result) noexcept
+      {
+        if (result < 0) {
+          ++errors_;
+          return;
+        }
+
+        // short write; finish it synchronously (the linked fsync is cancelled)
+        const size_type written{ static_cast<size_type>(result) };
+        if (written < segment.used_) {
+          writeDirect(segment.buffer_.get() + written, segment.used_ - written, segment.offset_ + static_cast<::off_t>(written));
+          if (options_.sync_)
+            ::fdatasync(fd_);
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      void writeDirect(const std::byte* data, size_type size) noexcept
+      {
+        writeDirect(data, size, offset_);
+        offset_ += static_cast<::off_t>(size);
+      }
+
+      //-----------------------------------------------------------------------
+      void writeDirect(const std::byte* data, size_type size, ::off_t offset) noexcept
+      {
+        while (size > 0) {
+          auto written{ ::pwrite(fd_, data, size, offset) };
+          if (written < 0) {
+            if (EINTR == errno)
+              continue;
+            ++errors_;
+            return;
+          }
+          data += written;
+          size -= static_cast<size_type>(written);
+          offset += written;
+        }
+      }
+
+    protected:
+      const int fd_{ -1 };
+      Options options_;
+      ::off_t offset_{};
+
+      int ringFd_{ -1 };
+      void* sqRing_{ nullptr };
+      void* cqRing_{ nullptr };
+      size_type sqRingSize_{};
+      size_type cqRingSize_{};
+      ::io_uring_sqe* sqes_{ nullptr };
+      size_type sqesSize_{};
+
+      std::atomic<std::uint32_t>* sqHead_{ nullptr };
+      std::atomic<std::uint32_t>* sqTail_{ nullptr };
+      std::uint32_t* sqArray_{ nullptr };
+      std::uint32_t sqMask_{};
+      std::uint32_t sqEntries_{};
+      unsigned unsubmitted_{};
+
+      std::atomic<std::uint32_t>* cqHead_{ nullptr };
+      std::atomic<std::uint32_t>* cqTail_{ nullptr };
+      ::io_uring_cqe* cqes_{ nullptr };
+      std::uint32_t cqMask_{};
+
+      std::vector<Segment> segments_;
+      size_type current_{};
+      std::uint32_t crc_{};
+      size_type blockBytes_{};
+      bool checksummed_{};
+      size_type inFlight_{};
+      size_type errors_{};
+    };
+
+#endif //ZS_LOG_HAS_IO_URING
+
+    //-------------------------------------------------------------------------
+    struct FileSinkOptions
+    {
+      bool preferUring_{ true };
+      bool sync_{};
+      bool append_{};
+      size_type checksumBytes_{};       // 0 for no checksum records, see WritevSink
+    };
+
+    //-------------------------------------------------------------------------
+    // Opens path for writing and returns the io_uring sink when the kernel
+    // supports it, otherwise the synchronous pwrite sink. Returns nullptr if
+    // the file cannot be opened.
+    [[nodiscard]] inline std::shared_ptr<Sink> openFileSink(const char* path, const FileSinkOptions& options = {}) noexcept
+    {
+      const int fd{ ::open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (options.append_ ? 0 : O_TRUNC), 0644) };
+      if (fd < 0)
+        return {};
+
+      const ::off_t offset{ options.append_ ? ::lseek(fd, 0, SEEK_END) : 0 };
+
+#ifdef ZS_LOG_HAS_IO_URING
+      if (options.preferUring_) {
+        UringSink::Options uringOptions;
+        uringOptions.closeOnDestroy_ = true;
+        uringOptions.sync_ = options.sync_;
+        uringOptions.checksumBytes_ = options.checksumBytes_;
+        if (auto sink{ UringSink::create(fd, uringOptions, offset) })
+          return sink;
+      }
+#endif //ZS_LOG_HAS_IO_URING
+
+      PwriteSink::Options pwriteOptions;
+      pwriteOptions.closeOnDestroy_ = true;
+      pwriteOptions.sync_ = options.sync_;
+      pwriteOptions.checksumBytes_ = options.checksumBytes_;
+      return std::make_shared<PwriteSink>(fd, pwriteOptions, offset);
+    }
+
+  } // namespace log
+} // namespace zs
+
+#endif //_WIN32
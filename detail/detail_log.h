@@ -40,14 +40,15 @@ namespace zs
       //-----------------------------------------------------------------------
       constexpr auto size(const type value) const noexcept
       {
-        return sizeCount() + (sizeof(element_type) * std::min(value.size(), maxLogStringLength()));
+        return sizeCount() + (sizeof(element_type) * stringLength(value.size()));
       }
 
       //-----------------------------------------------------------------------
       constexpr void pack(std::byte*& buffer, const type value, size_type& remaining) const noexcept
       {
-        size_type count{ std::min(value.size(), maxLogStringLength()) };
+        size_type count{ stringLength(value.size()) };
         size_type size = (sizeof(element_type) * count);
+        packCount(buffer, count, remaining);
         packData(buffer, value.data(), size, remaining);
       }
     };
@@ -71,19 +72,70 @@ namespace zs
       template <typename U>
       constexpr auto size(U &&value) const noexcept
       {
-        return sizeCount() + (sizeof(element_type) * std::min(value.size(), maxLogStringLength()));
+        return sizeCount() + (sizeof(element_type) * stringLength(value.size()));
       }
 
       //-----------------------------------------------------------------------
       template <typename U>
       constexpr void pack(std::byte*& buffer, U &&value, size_type& remaining) const noexcept
       {
-        size_type count{ std::min(value.size(), maxLogStringLength()) };
+        size_type count{ stringLength(value.size()) };
         size_type size = (sizeof(element_type) * count);
+        packCount(buffer, count, remaining);
         packData(buffer, value.c_str(), size, remaining);
       }
     };
 
+    //-------------------------------------------------------------------------
+    // packed like a variable sized byte array; the bytes of a blob taken by
+    // the active BlobReferences are left out and only their count is written
+    template <>
+    struct MetaDataType<Blob, void> final : public MetaDataTypeVariable
+    {
+      using type = Blob;
+      using element_type = std::uint8_t;
+
+      //-----------------------------------------------------------------------
+      constexpr static MetaDataTypeInfo info() noexcept
+      {
+        auto result{ MetaDataTypeInfo::simple<element_type>() };
+        result.totalElements_ = 0;
+        return result;
+      }
+
+      //-----------------------------------------------------------------------
+      template <typename U>
+      auto size(U&& value) const noexcept
+      {
+        if constexpr (!std::is_const_v<std::remove_reference_t<U>>) {
+          if (BlobReferences* references{ BlobReferences::active() }) {
+            if (references->accepts(value))
+              return sizeCount();
+          }
+        }
+        return sizeCount() + value.size();
+      }
+
+      //-----------------------------------------------------------------------
+      template <typename U>
+      void pack(std::byte*& buffer, U&& value, size_type& remaining) const noexcept
+      {
+        if constexpr (!std::is_const_v<std::remove_reference_t<U>>) {
+          if (BlobReferences* references{ BlobReferences::active() }) {
+            if (references->accepts(value)) {
+              const std::byte* before{ buffer };
+              packCount(buffer, value.size(), remaining);
+              if (buffer != before)
+                references->add(value, buffer);
+              return;
+            }
+          }
+        }
+        packCount(buffer, value.size(), remaining);
+        packData(buffer, value.data(), value.size(), remaining);
+      }
+    };
+
     //-------------------------------------------------------------------------
     template <typename T, zs::size_type N>
     struct MetaDataType<const T [N], std::enable_if_t<std::is_integral_v<T> || std::is_floating_point_v<T>>>  final : public MetaDataTypeVariable
@@ -580,7 +632,7 @@ namespace zs
       {
         if (!value)
           return sizeCount();
-        count_ = std::min(maxStringLength(), strlen(value));
+        count_ = stringLength(strlen(value));
         return sizeCount() + (count_ * sizeof(element_type));
       }
 
@@ -611,7 +663,7 @@ namespace zs
           count_ = 0;
           return sizeCount();
         }
-        count_ = std::min(maxStringLength(), wcslen(value));
+        count_ = stringLength(wcslen(value));
         return sizeCount() + (count_ * sizeof(element_type));
       }
 
@@ -1,13 +1,27 @@
 
 #pragma once
 
+#include <atomic>
+#include <ranges>
+#include <mutex>
+#include <string>
 #include <string_view>
 #include <cstring>
 #include <cwchar>
 #include <cassert>
+#include <tuple>
+#include <type_traits>
+#include <unordered_set>
 
 #include "enum.h"
 #include "traits.h"
+#include "LogTransport.h"
+#include "LogContext.h"
+#include "LogFormat.h"
+#include "LogBacktrace.h"
+#include "LogSequence.h"
+#include "LogRepeat.h"
+#include "MoveSharedPtr.h"
 #include "dependency/safeint.h"
 #include "dependency/gsl.h"
 
@@ -18,6 +32,7 @@ namespace zs
     inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(64 * 1024)> maxLogBufferSize;
     inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(512)> maxLogArrayEntries;
     inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(1024)> maxLogStringLength;
+    inline constexpr std::integral_constant<zs::size_type, static_cast<zs::size_type>(256)> minBlobReferenceSize;
 
     class Component;
 
@@ -101,15 +116,29 @@ namespace zs
       friend iterator;
       friend const_iterator;
 
+      //-----------------------------------------------------------------------
+      // inherits the level of the nearest configured "::" ancestor
+      Component(const std::string_view name) noexcept :
+        id_{ nextId() },
+        level_{ Level::Basic },
+        name_{ name },
+        next_{ std::exchange(head(), this) }
+      {
+        attach();
+      }
+
       //-----------------------------------------------------------------------
       Component(
         const std::string_view name,
-        Level level = Level::Basic) noexcept :
+        Level level) noexcept :
         id_{ nextId() },
         level_{ level },
+        configured_{ level },
+        explicit_{ true },
         name_{ name },
         next_{ std::exchange(head(), this) }
       {
+        attach();
       }
 
       //-----------------------------------------------------------------------
@@ -119,6 +148,8 @@ namespace zs
         Level level = Level::Basic) noexcept :
         id_{},
         level_{ level },
+        configured_{ level },
+        explicit_{ true },
         name_{ name }
       {
       }
@@ -132,12 +163,57 @@ namespace zs
 
       [[nodiscard]] constexpr bool isLogging(Level level) const noexcept { return level_ >= level; }
 
-      constexpr void level(Level level) noexcept { level_ = level; }
       [[nodiscard]] constexpr Level level() const noexcept { return level_; }
+      [[nodiscard]] constexpr bool configured() const noexcept { return explicit_; }
 
       [[nodiscard]] constexpr id_type id() const noexcept { return id_; }
       [[nodiscard]] constexpr const std::string_view name() const noexcept { return name_; }
 
+      [[nodiscard]] constexpr const Component* parent() const noexcept { return parent_; }
+
+      // bumped whenever a level or the component tree changes; caches derived
+      // from effective levels compare against it rather than walking parents
+      [[nodiscard]] static size_type generation() noexcept { return generationCounter().load(std::memory_order_acquire); }
+      [[nodiscard]] constexpr size_type resolved() const noexcept { return resolved_; }
+
+      //-----------------------------------------------------------------------
+      void level(Level level) noexcept
+      {
+        std::lock_guard lock{ treeMutex() };
+        configured_ = level;
+        explicit_ = true;
+        propagate();
+      }
+
+      //-----------------------------------------------------------------------
+      void inherit() noexcept
+      {
+        std::lock_guard lock{ treeMutex() };
+        explicit_ = false;
+        propagate();
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static Component* find(const std::string_view name) noexcept
+      {
+        std::lock_guard lock{ treeMutex() };
+        for (auto* component{ head() }; component; component = component->next_) {
+          if (name == component->name_)
+            return component;
+        }
+        return nullptr;
+      }
+
+      //-----------------------------------------------------------------------
+      static bool level(const std::string_view name, Level level) noexcept
+      {
+        auto* component{ find(name) };
+        if (!component)
+          return false;
+        component->level(level);
+        return true;
+      }
+
       //-----------------------------------------------------------------------
       template <typename TComponent>
       struct Iterator
@@ -209,11 +285,100 @@ namespace zs
         return gId;
       }
 
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::mutex& treeMutex() noexcept
+      {
+        static std::mutex gMutex;
+        return gMutex;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::atomic<size_type>& generationCounter() noexcept
+      {
+        static std::atomic<size_type> gGeneration{ 1 };
+        return gGeneration;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr bool isAncestorOf(const std::string_view name) const noexcept
+      {
+        return (name.size() > name_.size() + 2) &&
+          (name.substr(0, name_.size()) == name_) &&
+          (name.substr(name_.size(), 2) == "::");
+      }
+
+      //-----------------------------------------------------------------------
+      void link(Component* parent) noexcept
+      {
+        if (parent_) {
+          auto** slot{ &parent_->child_ };
+          while (*slot != this)
+            slot = &((*slot)->sibling_);
+          *slot = sibling_;
+        }
+        parent_ = parent;
+        sibling_ = nullptr;
+        if (parent_)
+          sibling_ = std::exchange(parent_->child_, this);
+      }
+
+      //-----------------------------------------------------------------------
+      // registration only happens during start up, so walking the whole list
+      // here keeps the steady state to a single load per check
+      void attach() noexcept
+      {
+        std::lock_guard lock{ treeMutex() };
+
+        Component* parent{};
+        for (auto* component{ next_ }; component; component = component->next_) {
+          if (!component->isAncestorOf(name_))
+            continue;
+          if ((!parent) || (component->name_.size() > parent->name_.size()))
+            parent = component;
+        }
+        link(parent);
+
+        // adopt anything registered earlier that now has a nearer ancestor
+        for (auto* component{ next_ }; component; component = component->next_) {
+          if (!isAncestorOf(component->name_))
+            continue;
+          if ((component->parent_) && (component->parent_->name_.size() >= name_.size()))
+            continue;
+          component->link(this);
+        }
+        propagate();
+      }
+
+      //-----------------------------------------------------------------------
+      // only the sub-tree below a change is visited, never the head() list
+      void propagate() noexcept
+      {
+        const size_type generation{ generationCounter().fetch_add(1, std::memory_order_acq_rel) + 1 };
+        refresh(generation);
+      }
+
+      //-----------------------------------------------------------------------
+      void refresh(size_type generation) noexcept
+      {
+        level_ = explicit_ ? configured_ : (parent_ ? parent_->level_ : Level::Basic);
+        resolved_ = generation;
+        for (auto* child{ child_ }; child; child = child->sibling_) {
+          if (!child->explicit_)
+            child->refresh(generation);
+        }
+      }
+
       const id_type id_{};
       volatile Level level_{};
+      Level configured_{ Level::Basic };
+      bool explicit_{};
+      size_type resolved_{};
       const std::string_view name_{};
 
       Component* const next_{ nullptr };
+      Component* parent_{};
+      Component* child_{};
+      Component* sibling_{};
     };
 
     //-------------------------------------------------------------------------
@@ -264,6 +429,166 @@ namespace zs
       constexpr void fixTypeName() noexcept { typeName_ = typeid(T).name(); }
     };
 
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // Bytes logged by reference. A blob that owns (a share of) its buffer is
+    // not copied into the ring; the drain hands the bytes to the sinks
+    // straight from the buffer and lets go of the owner once they are
+    // written. Logging such a blob takes its owner, leaving it empty. A blob
+    // without an owner is copied like any other array, as are small blobs
+    // and blobs logged through a ring shared with another process.
+    class Blob final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      Blob() noexcept = default;
+
+      //-----------------------------------------------------------------------
+      Blob(gsl::span<const std::byte> bytes) noexcept :
+        bytes_{ bytes }
+      {}
+
+      //-----------------------------------------------------------------------
+      Blob(gsl::span<const std::byte> bytes, move_shared_ptr<const void>&& owner) noexcept :
+        bytes_{ bytes },
+        owner_{ std::move(owner) }
+      {}
+
+      //-----------------------------------------------------------------------
+      // any contiguous buffer, e.g. a std::vector<std::byte> or std::string
+      template <typename T>
+      Blob(move_shared_ptr<T>&& buffer) noexcept
+      {
+        if (!buffer)
+          return;
+        bytes_ = gsl::span<const std::byte>{ reinterpret_cast<const std::byte*>(buffer->data()), buffer->size() * sizeof(*(buffer->data())) };
+        owner_ = move_shared_ptr<const void>{ std::move(buffer) };
+      }
+
+      Blob(Blob&&) noexcept = default;
+      Blob& operator=(Blob&&) noexcept = default;
+
+      [[nodiscard]] const std::byte* data() const noexcept { return bytes_.data(); }
+      [[nodiscard]] size_type size() const noexcept { return bytes_.size(); }
+      [[nodiscard]] bool owned() const noexcept { return static_cast<bool>(owner_); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] move_shared_ptr<const void> release() noexcept
+      {
+        bytes_ = {};
+        return std::move(owner_);
+      }
+
+    protected:
+      gsl::span<const std::byte> bytes_;
+      move_shared_ptr<const void> owner_;
+    };
+
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    //-------------------------------------------------------------------------
+    // The blobs an entry refers to instead of holding them. While one is alive
+    // on a thread the blob meta data type asks it whether to take each blob,
+    // once when the entry is sized and once when it is packed; the answers
+    // are the same both times so both agree on the size.
+    class BlobReferences final
+    {
+    public:
+      using size_type = zs::size_type;
+
+      struct Reference
+      {
+        size_type offset_{};
+        Blob* blob_{ nullptr };
+      };
+
+      //-----------------------------------------------------------------------
+      BlobReferences(gsl::span<Reference> storage) noexcept :
+        storage_{ storage },
+        previous_{ std::exchange(current(), this) }
+      {}
+
+      BlobReferences(const BlobReferences&) noexcept = delete;
+      BlobReferences& operator=(const BlobReferences&) noexcept = delete;
+
+      ~BlobReferences() noexcept { current() = previous_; }
+
+      [[nodiscard]] static BlobReferences* active() noexcept { return current(); }
+
+      // room to keep at the end of the record for the blobs taken while sizing
+      [[nodiscard]] size_type trailerSize() const noexcept { return 0 == accepted_ ? 0 : (accepted_ * sizeof(RecordReference)) + sizeof(RecordReferences); }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] bool accepts(const Blob& blob) noexcept
+      {
+        if ((!blob.owned()) || (blob.size() < minBlobReferenceSize()) || (accepted_ >= storage_.size()))
+          return false;
+        ++accepted_;
+        return true;
+      }
+
+      //-----------------------------------------------------------------------
+      // sizing is done, packing into the payload starts
+      void begin(std::byte* payload) noexcept
+      {
+        payload_ = payload;
+        accepted_ = 0;
+      }
+
+      //-----------------------------------------------------------------------
+      void add(Blob& blob, const std::byte* at) noexcept
+      {
+        storage_[taken_++] = Reference{ static_cast<size_type>(at - payload_), &blob };
+      }
+
+      //-----------------------------------------------------------------------
+      // moves the references behind the packed parameters (ending at end) and
+      // returns the size of the record holding them both
+      [[nodiscard]] size_type finish(std::byte* record, const std::byte* end) noexcept
+      {
+        RecordHeader& header{ *reinterpret_cast<RecordHeader*>(record) };
+        if (0 == taken_)
+          return header.size_;
+
+        const size_type payloadSize{ static_cast<size_type>(end - payload_) };
+        std::byte* pos{ record + RecordHeader::recordSize(payloadSize) };
+        for (size_type index{}; index < taken_; ++index) {
+          auto& reference{ storage_[index] };
+          const auto* data{ reference.blob_->data() };
+          const auto size{ reference.blob_->size() };
+          new (pos) RecordReference{ reference.offset_, size, data, reference.blob_->release() };
+          pos += sizeof(RecordReference);
+        }
+
+        const RecordReferences trailer{ static_cast<std::uint32_t>(taken_), static_cast<std::uint32_t>(payloadSize) };
+        memcpy(pos, &trailer, sizeof(trailer));
+        pos += sizeof(trailer);
+
+        header.flags_ = static_cast<std::uint16_t>(header.flags_ | recordFlagReferences());
+        header.size_ = static_cast<std::uint32_t>(pos - record);
+        return header.size_;
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static BlobReferences*& current() noexcept
+      {
+        thread_local BlobReferences* current{ nullptr };
+        return current;
+      }
+
+    protected:
+      const gsl::span<Reference> storage_;
+      BlobReferences* const previous_{ nullptr };
+      std::byte* payload_{ nullptr };
+      size_type accepted_{};
+      size_type taken_{};
+    };
+
     //-------------------------------------------------------------------------
     //-------------------------------------------------------------------------
     //-------------------------------------------------------------------------
@@ -317,24 +642,31 @@ namespace zs
 
       constexpr static size_type sizeCount() noexcept { return sizeof(array_count_size_type); }
 
+      //-----------------------------------------------------------------------
+      // strings are only clamped when the entry has to fit a single record
+      constexpr static size_type stringLength(size_type length) noexcept
+      {
+        if (std::is_constant_evaluated() || !FragmentWriter::active())
+          return std::min(length, maxLogStringLength());
+        return length;
+      }
+
       //-----------------------------------------------------------------------
       void packCount(std::byte*& buffer, size_type total, size_type& remaining) const noexcept
       {
         array_count_size_type count = gsl::narrow_cast<decltype(count)>(total);
-
-        if (remaining < sizeof(count)) {
-          remaining = 0;
-          return;
-        }
-
-        memcpy(buffer, &count, sizeof(count));
-        buffer += sizeof(count);
-        remaining -= sizeof(count);
+        packData(buffer, &count, sizeof(count), remaining);
       }
 
       //-----------------------------------------------------------------------
       void packData(std::byte*& buffer, const void* source, size_type size, size_type& remaining) const noexcept
       {
+        if (remaining <= size) {
+          if (FragmentWriter* writer{ FragmentWriter::active() }) {
+            writer->write(buffer, source, size, remaining);
+            return;
+          }
+        }
         if (remaining < size) {
           remaining = 0;
           return;
@@ -381,6 +713,7 @@ namespace zs
       const std::string_view file_{};
       const std::string_view func_{};
       const int line_{};
+      const Severity severity_{ Severity::Info };
     };
 
     //-------------------------------------------------------------------------
@@ -393,17 +726,26 @@ namespace zs
 
       using size_type = zs::size_type;
       using index_type = zs::index_type;
-      using id_type = size_type;
+      using id_type = std::uint64_t;
       using constexpr_type = allow_constexpr;
 
       //-----------------------------------------------------------------------
-      MetaDataLogEntry(MetaDataLogEntryInfo &info) noexcept :
-        id_{ nextId() },
+      // The id is a hash of the call site (component, name, file, line and
+      // argument signature) so it stays the same across builds and link
+      // orders. Only the file's name goes in, not its directory: __FILE__
+      // holds whatever path the compiler was given, which differs between
+      // build directories and machines. The component tells apart same named
+      // files of different libraries; hashed ids always have the top bit set
+      // and the rare call site whose hash is already taken gets a counter id
+      // instead.
+      MetaDataLogEntry(MetaDataLogEntryInfo &info, id_type signature = {}) noexcept :
+        id_{ claimId(hashSite(info, signature)) },
         component_{ info.component_ },
         name_{ info.name_ },
         file_{ info.file_ },
         func_{ info.func_ },
         line_{ info.line_ },
+        severity_{ info.severity_ },
         next_{ std::exchange(head(), this) }
       {}
       //-----------------------------------------------------------------------
@@ -411,10 +753,12 @@ namespace zs
         const constexpr_type &,
         MetaDataLogEntryInfo& info) noexcept :
         id_{},
+        component_{ info.component_ },
         name_{ info.name_ },
         file_{ info.file_ },
         func_{ info.func_ },
-        line_{ info.line_ }
+        line_{ info.line_ },
+        severity_{ info.severity_ }
       {}
 
       constexpr MetaDataLogEntry() = delete;
@@ -425,7 +769,84 @@ namespace zs
       constexpr MetaDataLogEntry& operator=(MetaDataLogEntry&&) = delete;
 
       [[nodiscard]] constexpr id_type id() const noexcept { return id_; }
+      [[nodiscard]] constexpr const Component* component() const noexcept { return component_; }
       [[nodiscard]] constexpr const std::string_view name() const noexcept { return name_; }
+      [[nodiscard]] constexpr const std::string_view file() const noexcept { return file_; }
+      [[nodiscard]] constexpr const std::string_view func() const noexcept { return func_; }
+      [[nodiscard]] constexpr int line() const noexcept { return line_; }
+      [[nodiscard]] constexpr Severity severity() const noexcept { return severity_; }
+      [[nodiscard]] constexpr const std::string_view format() const noexcept { return format_; }
+
+      // severe entries carry the stack that logged them while Backtrace is enabled
+      [[nodiscard]] bool capturesBacktrace() const noexcept { return (severity_ >= Severity::Error) && Backtrace::enabled(); }
+
+      // checked before anything is packed, one load on the hot path
+      [[nodiscard]] bool enabled() const noexcept { return enabled_.load(std::memory_order_relaxed); }
+      void enable(bool value) noexcept { enabled_.store(value, std::memory_order_relaxed); }
+
+      //-----------------------------------------------------------------------
+      // Switches registered call sites on or off at runtime, similar to the
+      // kernel's dynamic debug; each returns how many call sites matched.
+      // Patterns are globs ('*' and '?'); a site pattern is "file" or
+      // "file:line", e.g. "*/parser.cpp:*" or "*net*:120".
+      static size_type enableId(id_type id, bool value) noexcept
+      {
+        return enableIf([&](const MetaDataLogEntry& entry) noexcept { return entry.id_ == id; }, value);
+      }
+
+      //-----------------------------------------------------------------------
+      static size_type enableSite(std::string_view pattern, bool value) noexcept
+      {
+        std::string_view line{ "*" };
+        const auto colon{ pattern.rfind(':') };
+        if ((std::string_view::npos != colon) && (colon + 1 < pattern.size()) &&
+          (pattern.find_first_not_of("0123456789*?", colon + 1) == std::string_view::npos)) {
+          line = pattern.substr(colon + 1);
+          pattern = pattern.substr(0, colon);
+        }
+        return enableIf([&](const MetaDataLogEntry& entry) noexcept {
+          return glob(pattern, entry.file_) && glob(line, std::to_string(entry.line_));
+        }, value);
+      }
+
+      //-----------------------------------------------------------------------
+      static size_type enableFunction(std::string_view pattern, bool value) noexcept
+      {
+        return enableIf([&](const MetaDataLogEntry& entry) noexcept { return glob(pattern, entry.func_); }, value);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static bool glob(std::string_view pattern, std::string_view value) noexcept
+      {
+        size_type pos{};
+        size_type index{};
+        size_type star{ std::string_view::npos };
+        size_type resume{};
+        while (index < value.size()) {
+          if ((pos < pattern.size()) && (('?' == pattern[pos]) || (pattern[pos] == value[index]))) {
+            ++pos;
+            ++index;
+          }
+          else if ((pos < pattern.size()) && ('*' == pattern[pos])) {
+            star = pos++;
+            resume = index;
+          }
+          else if (std::string_view::npos != star) {
+            pos = star + 1;
+            index = ++resume;
+          }
+          else
+            return false;
+        }
+        while ((pos < pattern.size()) && ('*' == pattern[pos])) {
+          ++pos;
+        }
+        return pos == pattern.size();
+      }
+
+      // registered entries form a list, newest first
+      [[nodiscard]] static const MetaDataLogEntry* first() noexcept { return head(); }
+      [[nodiscard]] constexpr const MetaDataLogEntry* next() const noexcept { return next_; }
 
       struct all_types {
         friend class MetaDataLogEntry;
@@ -440,7 +861,7 @@ namespace zs
         MetaDataTypeInfo* last_{ nullptr };
       };
 
-      constexpr all_types types() noexcept
+      constexpr all_types types() const noexcept
       {
         all_types result;
         result.first_ = first_;
@@ -456,6 +877,20 @@ namespace zs
         return gHead;
       }
 
+      //-----------------------------------------------------------------------
+      template <typename TMatch>
+      static size_type enableIf(TMatch&& match, bool value) noexcept
+      {
+        size_type result{};
+        for (MetaDataLogEntry* entry{ head() }; entry; entry = entry->next_) {
+          if (!match(*entry))
+            continue;
+          entry->enable(value);
+          ++result;
+        }
+        return result;
+      }
+
       //-----------------------------------------------------------------------
       [[nodiscard]] static id_type nextId() noexcept
       {
@@ -464,19 +899,94 @@ namespace zs
         return gId;
       }
 
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static std::unordered_set<id_type>& ids() noexcept
+      {
+        static std::unordered_set<id_type> gIds;
+        return gIds;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static id_type claimId(id_type hashed) noexcept
+      {
+        auto& used{ ids() };
+        if (used.insert(hashed).second)
+          return hashed;
+
+        id_type result{ nextId() };
+        while (!used.insert(result).second) {
+          result = nextId();
+        }
+        return result;
+      }
+
+    public:
+      //-----------------------------------------------------------------------
+      // FNV-1a, usable at compile time
+      [[nodiscard]] constexpr static id_type hash(std::string_view value, id_type seed = 0xcbf29ce484222325ull) noexcept
+      {
+        for (auto c : value) {
+          seed = (seed ^ static_cast<std::uint8_t>(c)) * 0x100000001b3ull;
+        }
+        return seed;
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] constexpr static id_type hash(id_type value, id_type seed) noexcept
+      {
+        for (int shift = 0; shift < 64; shift += 8) {
+          seed = (seed ^ ((value >> shift) & 0xff)) * 0x100000001b3ull;
+        }
+        return seed;
+      }
+
+      //-----------------------------------------------------------------------
+      // the file name of a path, either separator accepted
+      [[nodiscard]] constexpr static std::string_view baseName(std::string_view path) noexcept
+      {
+        const auto found{ path.find_last_of("/\\") };
+        return std::string_view::npos == found ? path : path.substr(found + 1);
+      }
+
+      //-----------------------------------------------------------------------
+      [[nodiscard]] static id_type hashSite(const MetaDataLogEntryInfo& info, id_type signature) noexcept
+      {
+        id_type result{ hash(info.component_ ? info.component_->name() : std::string_view{}) };
+        result = hash(info.name_, hash(0x1f, result));
+        result = hash(baseName(info.file_), hash(0x1f, result));
+        result = hash(static_cast<id_type>(info.line_), result);
+        result = hash(signature, result);
+        return result | (static_cast<id_type>(1) << 63);
+      }
+
    protected:
       const id_type id_{};
+      std::atomic_bool enabled_{ true };
       const Component* const component_{ nullptr };
       const std::string_view name_{};
       const std::string_view file_{};
       const std::string_view func_{};
       const int line_{};
+      const Severity severity_{};
+      std::string_view format_{};
       MetaDataTypeInfo* first_{ nullptr };
       MetaDataTypeInfo* last_{ nullptr };
 
       MetaDataLogEntry* const next_{ nullptr };
     };
 
+    //-------------------------------------------------------------------------
+    // a call site gets a message with a static constexpr format() next to its
+    // info() and paramNames(), see MessageFormat
+    template <typename TAnon>
+    constexpr std::string_view formatOf() noexcept
+    {
+      if constexpr (requires { std::remove_cvref_t<TAnon>::format(); })
+        return std::remove_cvref_t<TAnon>::format();
+      else
+        return {};
+    }
+
     //-------------------------------------------------------------------------
     //-------------------------------------------------------------------------
     //-------------------------------------------------------------------------
@@ -492,9 +1002,11 @@ namespace zs
         MetaDataLogEntryInfo& info,
         const param_array_type& params
         ) noexcept :
-        MetaDataLogEntry(info)
+        MetaDataLogEntry(info, signature())
       {
         static_assert(TAnon::totalParams() == sizeof...(Args));
+        static_assert(formatOf<TAnon>().empty() || MessageFormat::check(formatOf<TAnon>(), TAnon::paramNames()), "every placeholder of the format must name a parameter, each parameter exactly once");
+        format_ = formatOf<TAnon>();
         fillEntries<Args...>(static_cast<size_type>(0), begin(params));
         first_ = entries_.data();
         last_ = first_ + totalEntries_;
@@ -507,7 +1019,39 @@ namespace zs
         MetaDataLogEntry(constexpr_type{}, info)
       {}
 
+      //-----------------------------------------------------------------------
+      // hash of the parameter names and the shape of every argument type,
+      // computed at compile time
+      [[nodiscard]] constexpr static id_type signature() noexcept
+      {
+        id_type result{ hash(std::string_view{}) };
+        for (auto name : TAnon::paramNames()) {
+          result = hash(name, hash(0x1f, result));
+        }
+        return signatureOf<Args...>(result);
+      }
+
     protected:
+      //-----------------------------------------------------------------------
+      template <typename T = void, typename ...Args>
+      constexpr static id_type signatureOf(id_type seed) noexcept
+      {
+        using type = std::remove_cvref_t<T>;
+        using meta_type = MetaDataType<type>;
+
+        if constexpr (std::is_same_v<void, T>) {
+          return seed;
+        }
+        else {
+          constexpr MetaDataTypeInfo info{ meta_type::info() };
+          id_type result{ hash(static_cast<id_type>((info.isIntegral_ ? 1 : 0) | (info.isSigned_ ? 2 : 0) | (info.isFloatingPoint_ ? 4 : 0)), seed) };
+          result = hash(static_cast<id_type>(info.elementWidth_), result);
+          result = hash(static_cast<id_type>(info.totalElements_), result);
+          result = hash(static_cast<id_type>(info.totalSubEntries_), result);
+          return signatureOf<Args...>(result);
+        }
+      }
+
       //-----------------------------------------------------------------------
       template <typename T = void, typename ...Args>
       constexpr static size_type calculateTotalEntries() noexcept
@@ -577,23 +1121,71 @@ namespace zs
       //-----------------------------------------------------------------------
       void operator()(const MetaDataLogEntry& entry, Args&& ...args) const noexcept
       {
+        write(entry, std::forward<Args>(args)...);
+        if (Severity::Fatal == entry.severity())
+          Drain::singleton().flushUrgent();
+      }
+
+      //-----------------------------------------------------------------------
+      // for call sites that opted into fragmenting: the payload is not limited
+      // to maxLogBufferSize but continues in as many records as it needs
+      void fragmented(const MetaDataLogEntry& entry, Args&& ...args) const noexcept
+      {
+        if constexpr (isFixedSize<Args...>())
+          write(entry, std::forward<Args>(args)...);
+        else
+          writeFragmented(entry, std::forward<Args>(args)...);
+        if (Severity::Fatal == entry.severity())
+          Drain::singleton().flushUrgent();
+      }
+
+      //-----------------------------------------------------------------------
+      // one entry per element of range, project(element) returning the
+      // arguments as a std::tuple; see BatchRecord
+      template <typename TRange, typename TProject>
+      void batch(const MetaDataLogEntry& entry, TRange&& range, TProject& project) const noexcept
+      {
+        writeBatch(entry, range, project);
+        if (Severity::Fatal == entry.severity())
+          Drain::singleton().flushUrgent();
+      }
+
+    protected:
+      //-----------------------------------------------------------------------
+      // Critical and Fatal entries go to the thread's urgent ring so they do
+      // not queue up behind whatever the ordinary ring still holds
+      [[nodiscard]] static Ring& ring(const MetaDataLogEntry& entry) noexcept
+      {
+        return entry.severity() >= Severity::Critical ? Drain::urgent() : Drain::local();
+      }
+
+      //-----------------------------------------------------------------------
+      static void write(const MetaDataLogEntry& entry, Args&& ...args) noexcept
+      {
+        Ring& ring{ LogEntry::ring(entry) };
+
         if constexpr (isFixedSize<Args...>()) {
           constexpr size_type size{ fixedSizeInBytes<Args...>() };
 
+          Frames frames;
+          const Prefix prefix{ Prefix::make(ring, entry, frames) };
+          std::byte* record{ ring.reserve(RecordHeader::recordSize(size + prefix.size())) };
+          if (!record)
+            return;
+
+          std::byte* pos{ prefix.write(record + sizeof(RecordHeader)) };
           if constexpr (size > 0) {
-            std::array<std::byte, size> buffer;
-            std::byte* pos = &(buffer[0]);
             PackerFixedSize pack{ pos, size };
 
             (pack << ... << args);
           }
+          commit(ring, entry, record, pos, pos + size, finishRecord(record, entry, pos + size, prefix));
         }
         else {
           constexpr size_type bufferMetaDataLargestAlignment{ largestAlignment<Args...>() };
           constexpr size_type bufferMetaDataLargestSize{ largestSize<Args...>() };
           constexpr size_type bufferMetaDataSizePadding{ calculatePadding(bufferMetaDataLargestAlignment + bufferMetaDataLargestSize, bufferMetaDataLargestAlignment) };
           constexpr size_type bufferMetaDataSizeWithPadding{ bufferMetaDataLargestSize + bufferMetaDataSizePadding };
-          constexpr size_type maxSize{ maxLogBufferSize() };
 
           std::array<std::byte, bufferMetaDataLargestAlignment + (bufferMetaDataSizeWithPadding * sizeof...(Args))> bufferMetaData;
           size_type bufferPadding{ calculatePadding(reinterpret_cast<uintptr_t>(bufferMetaData.data()), bufferMetaDataLargestAlignment) };
@@ -602,20 +1194,163 @@ namespace zs
 
           ctorMetaData<Args...>(start, bufferMetaDataSizeWithPadding);
 
+          // blobs are referenced rather than copied unless the ring may be
+          // read by another process, which cannot follow the references
+          constexpr size_type totalBlobs{ countBlobs<Args...>() };
+          if constexpr (totalBlobs > 0) {
+            std::array<BlobReferences::Reference, totalBlobs> storage;
+            if (!ring.shared()) {
+              BlobReferences references{ storage };
+              pack(ring, entry, start, bufferMetaDataSizeWithPadding, &references, args...);
+            }
+            else
+              pack(ring, entry, start, bufferMetaDataSizeWithPadding, nullptr, args...);
+          }
+          else
+            pack(ring, entry, start, bufferMetaDataSizeWithPadding, nullptr, args...);
+
+          dtorMetaData<Args...>(start, bufferMetaDataSizeWithPadding);
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      static void writeFragmented(const MetaDataLogEntry& entry, Args&& ...args) noexcept
+      {
+        constexpr size_type bufferMetaDataLargestAlignment{ largestAlignment<Args...>() };
+        constexpr size_type bufferMetaDataLargestSize{ largestSize<Args...>() };
+        constexpr size_type bufferMetaDataSizePadding{ calculatePadding(bufferMetaDataLargestAlignment + bufferMetaDataLargestSize, bufferMetaDataLargestAlignment) };
+        constexpr size_type bufferMetaDataSizeWithPadding{ bufferMetaDataLargestSize + bufferMetaDataSizePadding };
+
+        std::array<std::byte, bufferMetaDataLargestAlignment + (bufferMetaDataSizeWithPadding * sizeof...(Args))> bufferMetaData;
+        size_type bufferPadding{ calculatePadding(reinterpret_cast<uintptr_t>(bufferMetaData.data()), bufferMetaDataLargestAlignment) };
+
+        std::byte* start{ bufferMetaData.data() + bufferPadding };
+
+        ctorMetaData<Args...>(start, bufferMetaDataSizeWithPadding);
+        {
+          Ring& ring{ LogEntry::ring(entry) };
+          FragmentWriter writer{ ring };
+
           PackerFlexSizeCalculator sizer{ start, bufferMetaDataSizeWithPadding };
           (sizer << ... << args);
 
-          std::array<std::byte, maxSize> buffer;
+          Frames frames;
+          const Prefix prefix{ Prefix::make(ring, entry, frames) };
+          std::array<std::byte, Prefix::maxSize()> prefixBytes;
+          const auto prefixSize{ static_cast<size_type>(prefix.write(prefixBytes.data()) - prefixBytes.data()) };
 
-          PackerFlexSizePack pack{ start, bufferMetaDataSizeWithPadding, buffer.data(), maxSize };
+          if (writer.begin(entry.id(), sizer.size_, prefix.flags(), gsl::span<const std::byte>{ prefixBytes.data(), prefixSize })) {
+            PackerFlexSizePack pack{ start, bufferMetaDataSizeWithPadding, writer.pos(), writer.remaining() };
 
-          (pack << ... << args);
+            (pack << ... << args);
 
-          dtorMetaData<Args...>(start, bufferMetaDataSizeWithPadding);
+            writer.finish(pack.pos_);
+          }
         }
+        dtorMetaData<Args...>(start, bufferMetaDataSizeWithPadding);
+      }
+
+      //-----------------------------------------------------------------------
+      // the elements share one reservation, prefix and timestamp per record;
+      // only as many go in a record as fit maxLogBufferSize
+      template <typename TRange, typename TProject>
+      static void writeBatch(const MetaDataLogEntry& entry, TRange& range, TProject& project) noexcept
+      {
+        static_assert(isFixedSize<Args...>(), "batched call sites take fixed size parameters");
+        constexpr size_type size{ fixedSizeInBytes<Args...>() };
+
+        auto element{ std::ranges::begin(range) };
+        const auto last{ std::ranges::end(range) };
+        if (element == last)
+          return;
+
+        Ring& ring{ LogEntry::ring(entry) };
+        Frames frames;
+        const Prefix prefix{ Prefix::make(ring, entry, frames) };
+        const size_type overhead{ sizeof(RecordHeader) + prefix.size() + sizeof(BatchRecord) };
+        const size_type perRecord{ 0 == size ? UINT32_MAX : std::max<size_type>(1, (std::min(maxLogBufferSize(), ring.maxRecordSize() - overhead)) / size) };
+        size_type remaining{ perRecord };
+        if constexpr (std::ranges::sized_range<TRange>)
+          remaining = static_cast<size_type>(std::ranges::size(range));
+
+        while (element != last) {
+          const size_type count{ std::min(remaining, perRecord) };
+          std::byte* record{ ring.reserve(RecordHeader::recordSize(overhead - sizeof(RecordHeader) + (count * size))) };
+          if (!record)
+            return;
+
+          std::byte* batch{ prefix.write(record + sizeof(RecordHeader)) };
+          std::byte* pos{ batch + sizeof(BatchRecord) };
+          BatchRecord header{ 0, static_cast<std::uint32_t>(size) };
+          for (; (header.count_ < count) && (element != last); ++header.count_, ++element) {
+            std::apply([&](auto&& ...args) noexcept {
+              PackerFixedSize pack{ pos, size };
+
+              (pack << ... << args);
+            }, project(*element));
+            pos += size;
+          }
+          memcpy(batch, &header, sizeof(header));
+
+          const size_type recordSize{ finishRecord(record, entry, pos, prefix) };
+          reinterpret_cast<RecordHeader*>(record)->kind_ = RecordKind::Batch;
+          ring.commit(recordSize);
+          if constexpr (std::ranges::sized_range<TRange>)
+            remaining -= count;
+        }
+      }
+
+      //-----------------------------------------------------------------------
+      // packs straight into the ring, there is no intermediate staging buffer
+      static void pack(Ring& ring, const MetaDataLogEntry& entry, std::byte* start, size_type sizeWithPadding, BlobReferences* references, Args& ...args) noexcept
+      {
+        PackerFlexSizeCalculator sizer{ start, sizeWithPadding };
+        (sizer << ... << args);
+
+        const size_type size{ std::min(sizer.size_, maxLogBufferSize()) };
+        const size_type trailerSize{ references ? references->trailerSize() : 0 };
+        Frames frames;
+        const Prefix prefix{ Prefix::make(ring, entry, frames) };
+        std::byte* record{ ring.reserve(RecordHeader::recordSize(size + prefix.size()) + trailerSize) };
+        if (!record)
+          return;
+
+        if (references)
+          references->begin(record + sizeof(RecordHeader));
+
+        std::byte* params{ prefix.write(record + sizeof(RecordHeader)) };
+        PackerFlexSizePack pack{ start, sizeWithPadding, params, size };
+
+        (pack << ... << args);
+
+        const size_type recordSize{ finishRecord(record, entry, pack.pos_, prefix) };
+        if (references)
+          ring.commit(references->finish(record, pack.pos_));
+        else
+          commit(ring, entry, record, params, pack.pos_, recordSize);
+      }
+
+      //-----------------------------------------------------------------------
+      // entries that repeat the previous one of their call site are only
+      // counted (see Repeats), urgent ones are always written
+      static void commit(Ring& ring, const MetaDataLogEntry& entry, std::byte* record, const std::byte* params, const std::byte* end, size_type recordSize) noexcept
+      {
+        if (Repeats::enabled() && (entry.severity() < Severity::Critical) && (!Repeats::check(ring, record, params, end)))
+          return;
+        ring.commit(recordSize);
+      }
+
+      //-----------------------------------------------------------------------
+      template<typename T = void, typename ...Args>
+      constexpr static size_type countBlobs() noexcept
+      {
+        using type = std::remove_cvref_t<T>;
+        if constexpr (std::is_same_v<type, void>)
+          return 0;
+        else
+          return (std::is_same_v<type, Blob> ? 1 : 0) + countBlobs<Args...>();
       }
 
-    protected:
       //-----------------------------------------------------------------------
       template<typename T = void, typename ...Args>
       constexpr static bool isFixedSize() noexcept
@@ -639,7 +1374,7 @@ namespace zs
         else if constexpr (sizeof...(Args) == 0)
           return MetaDataType<type>::size();
         else
-          return MetaDataType<type>::size() + size<Args...>();
+          return MetaDataType<type>::size() + fixedSizeInBytes<Args...>();
       }
 
       //-----------------------------------------------------------------------
@@ -685,6 +1420,85 @@ namespace zs
         return static_cast<size_type>((static_cast<type>(align) - (static_cast<type>(offset) % static_cast<type>(align))) % static_cast<type>(align));
       }
 
+      //-----------------------------------------------------------------------
+      using Frames = std::array<std::uint64_t, maxBacktraceDepth()>;
+
+      //-----------------------------------------------------------------------
+      // what the payload holds ahead of the parameters: the id of the thread's
+      // context and the stack of a severe entry, either may be missing
+      struct Prefix final
+      {
+        LogContext::id_type context_{};
+        std::uint32_t depth_{};
+        const std::uint64_t* frames_{ nullptr };
+        std::uint64_t sequence_{};
+
+        [[nodiscard]] constexpr static size_type maxSize() noexcept { return sizeof(LogContext::id_type) + (sizeof(std::uint64_t) * (1 + maxBacktraceDepth())) + sizeof(sequence_); }
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] static Prefix make(Ring& ring, const MetaDataLogEntry& entry, Frames& frames) noexcept
+        {
+          Prefix result{ LogContext::local().prepare(ring) };
+          if (entry.capturesBacktrace()) {
+            result.depth_ = static_cast<std::uint32_t>(Backtrace::capture(frames.data(), frames.size()));
+            result.frames_ = frames.data();
+          }
+          if (Sequence::enabled())
+            result.sequence_ = Sequence::next();
+          if (Repeats::enabled())
+            Repeats::settle();
+          return result;
+        }
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] size_type size() const noexcept
+        {
+          return (0 != context_ ? sizeof(context_) : 0) + (0 != depth_ ? sizeof(std::uint64_t) * (1 + static_cast<size_type>(depth_)) : 0) + (0 != sequence_ ? sizeof(sequence_) : 0);
+        }
+
+        //---------------------------------------------------------------------
+        [[nodiscard]] std::uint16_t flags() const noexcept
+        {
+          return static_cast<std::uint16_t>((0 != context_ ? recordFlagContext() : 0) | (0 != depth_ ? recordFlagBacktrace() : 0) | (0 != sequence_ ? recordFlagSequence() : 0));
+        }
+
+        //---------------------------------------------------------------------
+        // returns where the parameters start
+        [[nodiscard]] std::byte* write(std::byte* pos) const noexcept
+        {
+          if (0 != context_) {
+            memcpy(pos, &context_, sizeof(context_));
+            pos += sizeof(context_);
+          }
+          if (0 != depth_) {
+            const std::uint64_t depth{ depth_ };
+            memcpy(pos, &depth, sizeof(depth));
+            memcpy(pos + sizeof(depth), frames_, sizeof(std::uint64_t) * depth_);
+            pos += sizeof(std::uint64_t) * (1 + static_cast<size_type>(depth_));
+          }
+          if (0 != sequence_) {
+            memcpy(pos, &sequence_, sizeof(sequence_));
+            pos += sizeof(sequence_);
+          }
+          return pos;
+        }
+      };
+
+      // Critical and Fatal entries are not clamped any further than the others
+      static_assert(RecordHeader::recordSize(maxLogBufferSize() + Prefix::maxSize()) <= urgentRingCapacity() / 2);
+
+      //-----------------------------------------------------------------------
+      static size_type finishRecord(std::byte* record, const MetaDataLogEntry& entry, const std::byte* end, const Prefix& prefix) noexcept
+      {
+        RecordHeader& header{ *reinterpret_cast<RecordHeader*>(record) };
+        header.size_ = static_cast<std::uint32_t>(RecordHeader::align(static_cast<size_type>(end - record)));
+        header.kind_ = RecordKind::Entry;
+        header.flags_ = prefix.flags();
+        header.entry_ = entry.id();
+        header.timestamp_ = RecordHeader::now();
+        return header.size_;
+      }
+
       //-----------------------------------------------------------------------
       struct PackerFixedSize final
       {
@@ -786,18 +1600,126 @@ namespace zs
           // in-place dtor the meta data type
           reinterpret_cast<meta_type*>(buffer)->~meta_type();
           if constexpr (sizeof...(Args) > 0) {
-            ctorMetaData<Args...>(buffer + sizeWithPadding, sizeWithPadding);
+            dtorMetaData<Args...>(buffer + sizeWithPadding, sizeWithPadding);
           }
         }
       }
     };
 
+    //-------------------------------------------------------------------------
+    // a call site opts into fragmented records with a static constexpr
+    // fragmented() returning true next to its info() and paramNames()
+    template <typename TAnon>
+    constexpr bool isFragmented() noexcept
+    {
+      if constexpr (requires { std::remove_cvref_t<TAnon>::fragmented(); })
+        return std::remove_cvref_t<TAnon>::fragmented();
+      else
+        return false;
+    }
+
+    //-------------------------------------------------------------------------
+    // a call site is only logged while its component is logging at the
+    // static constexpr level() next to its info(), if it has one
+    template <typename TAnon>
+    constexpr Level levelOf() noexcept
+    {
+      if constexpr (requires { std::remove_cvref_t<TAnon>::level(); })
+        return std::remove_cvref_t<TAnon>::level();
+      else
+        return Level::None;
+    }
+
+    //-------------------------------------------------------------------------
+    // an argument that can be called without arguments, e.g.
+    // [&]{ return summary(); }, is logged as what it returns and only called
+    // once the entry is known to be logged
+    template <typename T>
+    constexpr bool isLazy() noexcept
+    {
+      using type = std::remove_cvref_t<T>;
+      if constexpr (std::is_invocable_v<type&>)
+        return !std::is_void_v<std::invoke_result_t<type&>>;
+      else
+        return false;
+    }
+
+    //-------------------------------------------------------------------------
+    template <typename T, typename Enabled = void>
+    struct Evaluated
+    {
+      using type = T;
+    };
+
+    //-------------------------------------------------------------------------
+    template <typename T>
+    struct Evaluated<T, std::enable_if_t<isLazy<T>()>>
+    {
+      using type = std::invoke_result_t<std::remove_reference_t<T>&>;
+    };
+
+    //-------------------------------------------------------------------------
+    template <typename T>
+    using evaluated_t = typename Evaluated<T>::type;
+
+    //-------------------------------------------------------------------------
+    template <typename T>
+    constexpr decltype(auto) evaluate(T&& value) noexcept
+    {
+      if constexpr (isLazy<T>())
+        return value();
+      else
+        return std::forward<T>(value);
+    }
+
     //-------------------------------------------------------------------------
     template <typename TAnon, typename ...Args>
     void output(TAnon&& anon, Args&& ...args) noexcept
     {
-      auto& metaData = logEntryMetaData<TAnon, Args...>;
-      LogEntry<Args...>{}(metaData, std::forward<Args>(args)...);
+      auto& metaData = logEntryMetaData<TAnon, evaluated_t<Args>...>;
+      if (!metaData.enabled())
+        return;
+      if constexpr (Level::None != levelOf<TAnon>()) {
+        if ((metaData.component()) && (!metaData.component()->isLogging(levelOf<TAnon>())))
+          return;
+      }
+      if constexpr (isFragmented<TAnon>())
+        LogEntry<evaluated_t<Args>...>{}.fragmented(metaData, evaluate(std::forward<Args>(args))...);
+      else
+        LogEntry<evaluated_t<Args>...>{}(metaData, evaluate(std::forward<Args>(args))...);
+    }
+
+    //-------------------------------------------------------------------------
+    template <typename TAnon, typename TTuple>
+    struct BatchOutput;
+
+    //-------------------------------------------------------------------------
+    template <typename TAnon, typename ...Args>
+    struct BatchOutput<TAnon, std::tuple<Args...>>
+    {
+      template <typename TRange, typename TProject>
+      static void output(TRange&& range, TProject& project) noexcept
+      {
+        auto& metaData = logEntryMetaData<TAnon, Args...>;
+        if (!metaData.enabled())
+          return;
+        if constexpr (Level::None != levelOf<TAnon>()) {
+          if ((metaData.component()) && (!metaData.component()->isLogging(levelOf<TAnon>())))
+            return;
+        }
+        LogEntry<Args...>{}.batch(metaData, range, project);
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    // logs one entry of the call site per element of range, the arguments of
+    // each being the std::tuple project(element) returns; the checks, the
+    // ring reservation and the timestamp are paid once for all of them
+    template <typename TAnon, typename TRange, typename TProject>
+    void outputEach(TAnon&& anon, TRange&& range, TProject&& project) noexcept
+    {
+      using tuple_type = std::remove_cvref_t<decltype(project(*std::ranges::begin(range)))>;
+      BatchOutput<std::remove_cvref_t<TAnon>, tuple_type>::output(range, project);
     }
 
     //-------------------------------------------------------------------------
@@ -810,6 +1732,8 @@ namespace zs
 
 } // namespace zs
 
+#include "LogSchema.h"
+
 namespace std
 {
   inline auto begin(zs::log::Component::all_components& comp) noexcept
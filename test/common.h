@@ -34,6 +34,10 @@ namespace zsTest
   void testMoveSharedPtr() noexcept(false);
   void testEnum() noexcept(false);
   void testLog() noexcept(false);
+  void testLogTransport() noexcept(false);
+  void testLogSharedMemory() noexcept(false);
+  void testLogSocket() noexcept(false);
+  void testLogReader() noexcept(false);
   void testTraits() noexcept(false);
   void testReflect() noexcept(false);
   void testTupleReflect() noexcept(false);
@@ -95,6 +95,10 @@ int runAllTests() noexcept
     testMoveSharedPtr();
     testEnum();
     testLog();
+    testLogTransport();
+    testLogSharedMemory();
+    testLogSocket();
+    testLogReader();
     testTraits();
     testReflect();
     testTupleReflect();
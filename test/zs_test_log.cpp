@@ -3,8 +3,11 @@
 
 #include "common.h"
 
+#include <algorithm>
+#include <deque>
 #include <optional>
 #include <iostream>
+#include <string>
 
 namespace zsTest
 {
@@ -70,6 +73,217 @@ namespace zsTest
       output(__FILE__ "::" __FUNCTION__);
     }
 
+    //-------------------------------------------------------------------------
+    void testEntryIds() noexcept(false)
+    {
+      struct _AnonEntry {
+        static auto& info() {
+          static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "ids", __FILE__, __FUNCTION__, __LINE__ };
+          return info;
+        }
+        constexpr static std::size_t totalParams() noexcept { return 1; }
+        constexpr static const auto paramNames() noexcept {
+          const std::array<std::string_view, 1> results{ { "value" } };
+          return results;
+        }
+      };
+
+      using int_entry_type = zs::log::MetaDataLogEntryWithArgs<_AnonEntry, int>;
+      using double_entry_type = zs::log::MetaDataLogEntryWithArgs<_AnonEntry, double>;
+
+      // the argument signature is known at compile time
+      constexpr auto intSignature{ int_entry_type::signature() };
+      constexpr auto doubleSignature{ double_entry_type::signature() };
+      static_assert(intSignature != doubleSignature);
+
+      // ids are a hash of the call site rather than a registration counter
+      auto& intEntry{ zs::log::logEntryMetaData<_AnonEntry, int> };
+      auto& doubleEntry{ zs::log::logEntryMetaData<_AnonEntry, double> };
+      TEST(intEntry.id() == zs::log::MetaDataLogEntry::hashSite(_AnonEntry::info(), intSignature));
+      TEST(doubleEntry.id() == zs::log::MetaDataLogEntry::hashSite(_AnonEntry::info(), doubleSignature));
+      TEST(intEntry.id() != doubleEntry.id());
+      TEST(0 != (intEntry.id() >> 63));
+
+      // the directory a file was compiled from does not change the id
+      const zs::log::MetaDataLogEntryInfo built{ nullptr, "site", "/home/a/build/src/zs_test_log.cpp", "f", 7 };
+      const zs::log::MetaDataLogEntryInfo rebuilt{ nullptr, "site", "C:\\work\\src\\zs_test_log.cpp", "f", 7 };
+      const zs::log::MetaDataLogEntryInfo renamed{ nullptr, "site", "/home/a/build/src/zs_test_other.cpp", "f", 7 };
+      TEST(zs::log::MetaDataLogEntry::hashSite(built, intSignature) == zs::log::MetaDataLogEntry::hashSite(rebuilt, intSignature));
+      TEST(zs::log::MetaDataLogEntry::hashSite(built, intSignature) != zs::log::MetaDataLogEntry::hashSite(renamed, intSignature));
+
+      // a second registration of the same site collides and falls back to the counter
+      static int_entry_type duplicate{ _AnonEntry::info(), _AnonEntry::paramNames() };
+      TEST(duplicate.id() != intEntry.id());
+      TEST(0 == (duplicate.id() >> 63));
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testEnable() noexcept(false)
+    {
+      struct _AnonEntry {
+        static auto& info() {
+          static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "enable", __FILE__, "zsTestEnable", __LINE__ };
+          return info;
+        }
+        constexpr static std::size_t totalParams() noexcept { return 1; }
+        constexpr static const auto paramNames() noexcept {
+          const std::array<std::string_view, 1> results{ { "value" } };
+          return results;
+        }
+      };
+
+      static_assert(zs::log::MetaDataLogEntry::glob("*/zs_*.cpp", "test/zs_test.cpp"));
+      static_assert(zs::log::MetaDataLogEntry::glob("a?c*", "abc"));
+      static_assert(!zs::log::MetaDataLogEntry::glob("*.h", "log.cpp"));
+
+      auto& entry{ zs::log::logEntryMetaData<_AnonEntry, int> };
+      TEST(entry.enabled());
+
+      auto& ring{ zs::log::Drain::local() };
+      auto logged{ [&]() noexcept -> bool {
+        const auto head{ ring.head() };
+        zs::log::output(_AnonEntry{}, 1);
+        return head != ring.head();
+      } };
+
+      TEST(1 == zs::log::MetaDataLogEntry::enableId(entry.id(), false));
+      TEST(!entry.enabled());
+      TEST(!logged());
+
+      const std::string site{ "*zs_test_log.cpp:" + std::to_string(_AnonEntry::info().line_) };
+      TEST(1 <= zs::log::MetaDataLogEntry::enableSite(site, true));
+      TEST(entry.enabled());
+      TEST(logged());
+
+      TEST(0 == zs::log::MetaDataLogEntry::enableSite("*zs_test_log.cpp:0", false));
+      TEST(1 <= zs::log::MetaDataLogEntry::enableFunction("zsTest*", false));
+      TEST(!entry.enabled());
+      TEST(!logged());
+      zs::log::MetaDataLogEntry::enableFunction("zsTestEnable", true);
+      TEST(entry.enabled());
+
+      zs::log::Drain::singleton().drainOnce(true);
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testLazy() noexcept(false)
+    {
+      static zs::log::Component lazyComponent{ "zsTestLazy", zs::log::Level::Basic };
+      struct _AnonEntry {
+        static auto& info() {
+          static zs::log::MetaDataLogEntryInfo info{ &lazyComponent, "lazy", __FILE__, __FUNCTION__, __LINE__ };
+          return info;
+        }
+        constexpr static std::size_t totalParams() noexcept { return 2; }
+        constexpr static const auto paramNames() noexcept {
+          const std::array<std::string_view, 2> results{ { "value", "summary" } };
+          return results;
+        }
+        constexpr static zs::log::Level level() noexcept { return zs::log::Level::Debug; }
+      };
+
+      static_assert(zs::log::isLazy<decltype([] { return 1; })>());
+      static_assert(!zs::log::isLazy<decltype([] {})>());
+      static_assert(!zs::log::isLazy<int>());
+      static_assert(std::is_same_v<std::string, zs::log::evaluated_t<decltype([] { return std::string{}; })>>);
+      static_assert(std::is_same_v<int&, zs::log::evaluated_t<int&>>);
+
+      int calls{};
+      auto summary{ [&]() noexcept {
+        ++calls;
+        return std::string{ "expensive" };
+      } };
+
+      auto& ring{ zs::log::Drain::local() };
+      auto logged{ [&]() noexcept -> bool {
+        const auto head{ ring.head() };
+        zs::log::output(_AnonEntry{}, 1, summary);
+        return head != ring.head();
+      } };
+
+      // the component logs at Basic, the call site at Debug
+      TEST(!logged());
+      TEST(0 == calls);
+
+      lazyComponent.level(zs::log::Level::Debug);
+      TEST(logged());
+      TEST(1 == calls);
+
+      // the lambda's result picked the call site's metadata
+      auto& entry{ zs::log::logEntryMetaData<_AnonEntry, int, std::string> };
+      entry.enable(false);
+      TEST(!logged());
+      TEST(1 == calls);
+      entry.enable(true);
+
+      lazyComponent.level(zs::log::Level::Basic);
+      zs::log::Drain::singleton().drainOnce(true);
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testHierarchy() noexcept(false)
+    {
+      // components register for the lifetime of the process
+      struct Tree
+      {
+        std::deque<std::string> names_;
+        std::deque<zs::log::Component> components_;
+
+        Tree() noexcept
+        {
+          // register children before their parent to exercise adoption
+          for (int index = 0; index < 300; ++index) {
+            names_.push_back("zsTestNet::sub" + std::to_string(index % 3) + "::leaf" + std::to_string(index));
+            components_.emplace_back(names_.back());
+          }
+          components_.emplace_back("zsTestNet::sub1");
+          components_.emplace_back("zsTestNet", zs::log::Level::Detail);
+        }
+      };
+      static Tree tree;
+
+      auto& net{ tree.components_.back() };
+      auto& sub1{ tree.components_[tree.components_.size() - 2] };
+      auto& leaf0{ tree.components_[0] };
+      auto& leaf1{ tree.components_[1] };
+
+      TEST(&net == zs::log::Component::find("zsTestNet"));
+      TEST(nullptr == net.parent());
+      TEST(&net == sub1.parent());
+      TEST(&net == leaf0.parent());
+      TEST(&sub1 == leaf1.parent());
+      TEST(net.configured());
+      TEST(!leaf0.configured());
+      TEST(zs::log::Level::Detail == leaf0.level());
+      TEST(zs::log::Level::Detail == leaf1.level());
+
+      const auto before{ zs::log::Component::generation() };
+      TEST(zs::log::Component::level("zsTestNet", zs::log::Level::Trace));
+      TEST(zs::log::Component::generation() > before);
+      TEST(std::all_of(tree.components_.begin(), tree.components_.end(), [](auto& component) noexcept { return component.isLogging(zs::log::Level::Trace); }));
+      TEST(leaf1.resolved() == zs::log::Component::generation());
+
+      // the nearest configured ancestor wins
+      sub1.level(zs::log::Level::None);
+      TEST(!leaf1.isLogging(zs::log::Level::Basic));
+      TEST(leaf0.isLogging(zs::log::Level::Trace));
+      net.level(zs::log::Level::Basic);
+      TEST(!leaf1.isLogging(zs::log::Level::Basic));
+      TEST(!leaf0.isLogging(zs::log::Level::Detail));
+
+      sub1.inherit();
+      TEST(zs::log::Level::Basic == leaf1.level());
+      TEST(!zs::log::Component::level("zsTestNet::missing", zs::log::Level::Trace));
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
     //-------------------------------------------------------------------------
     void runAll() noexcept(false)
     {
@@ -78,6 +292,10 @@ namespace zsTest
       runner([&]() { test(); });
       runner([&]() { testEntry(); });
       runner([&]() { testEntry(); });
+      runner([&]() { testEntryIds(); });
+      runner([&]() { testEnable(); });
+      runner([&]() { testLazy(); });
+      runner([&]() { testHierarchy(); });
     }
   };
 
@@ -0,0 +1,1157 @@
+
+#include <zs/log.h>
+#include <zs/LogFileSink.h>
+#include <zs/LogMetrics.h>
+#include <zs/LogReader.h>
+#include <zs/LogUringSink.h>
+#include <zs/MoveSharedPtr.h>
+
+#include "common.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif //_WIN32
+
+namespace zsTest
+{
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  struct LogReaderBasics
+  {
+    using size_type = zs::size_type;
+
+    struct Values
+    {
+      std::vector<int> values_;
+      std::vector<std::string> names_;
+    };
+
+    std::optional<Values> values_;
+
+    //-------------------------------------------------------------------------
+    struct CaptureSink : public zs::log::Sink
+    {
+      std::vector<std::byte> bytes_;
+
+      void write(const zs::log::Batch& batch) noexcept override
+      {
+        for (auto& record : batch.records_) {
+          bytes_.insert(bytes_.end(), record.begin(), record.end());
+        }
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    struct _AnonEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "reader", __FILE__, __FUNCTION__, __LINE__ };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 2; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 2> results{ { "value", "name" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    struct _AnonLargeEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "large", __FILE__, __FUNCTION__, __LINE__ };
+        return info;
+      }
+      constexpr static bool fragmented() noexcept { return true; }
+      constexpr static std::size_t totalParams() noexcept { return 2; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 2> results{ { "value", "body" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    struct _AnonBlobEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "blob", __FILE__, __FUNCTION__, __LINE__ };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 2; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 2> results{ { "value", "bytes" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    struct _AnonErrorEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "error", __FILE__, __FUNCTION__, __LINE__, zs::log::Severity::Error };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 1; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 1> results{ { "value" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    struct _AnonLevelEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "level", __FILE__, __FUNCTION__, __LINE__ };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 2; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 2> results{ { "price", "quantity" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    void reset()
+    {
+      values_.reset();
+      values_.emplace();
+    }
+
+    //-------------------------------------------------------------------------
+    void log(int first, int count) noexcept
+    {
+      for (int i = 0; i < count; ++i) {
+        std::string name{ "name" + std::to_string(first + i) };
+        zs::log::output(_AnonEntry{}, first + i, std::string_view{ name });
+      }
+    }
+
+    //-------------------------------------------------------------------------
+    void collect(const zs::log::RecordDecoder::Record& record) noexcept(false)
+    {
+      TEST(nullptr != record.entry_);
+      if (!record.entry_)
+        return;
+      TEST("reader" == record.entry_->name_);
+
+      zs::log::ParamReader reader{ *record.entry_, record.payload_ };
+      zs::log::ParamReader::Param value;
+      zs::log::ParamReader::Param name;
+      TEST(reader.next(value));
+      TEST(reader.next(name));
+      TEST(!reader.next(name));
+      TEST(1 == value.count_);
+      TEST(sizeof(int) == value.data_.size());
+
+      int number{};
+      memcpy(&number, value.data_.data(), sizeof(number));
+      values_->values_.push_back(number);
+      values_->names_.emplace_back(reinterpret_cast<const char*>(name.data_.data()), name.count_);
+    }
+
+    //-------------------------------------------------------------------------
+    void testDecoder() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      drain.add(capture);
+      log(0, 100);
+      drain.drainOnce(true);
+      drain.remove(capture);
+
+      // hand the stream over in awkward pieces, keeping what was not consumed
+      zs::log::RecordDecoder decoder;
+      std::vector<std::byte> pending;
+      auto& bytes{ capture->bytes_ };
+      for (size_type pos{}; pos < bytes.size(); pos += 7) {
+        const size_type size{ std::min<size_type>(7, bytes.size() - pos) };
+        pending.insert(pending.end(), bytes.begin() + pos, bytes.begin() + pos + size);
+        const size_type consumed{ decoder.decode(pending, [&](const auto& record) noexcept(false) { collect(record); }) };
+        pending.erase(pending.begin(), pending.begin() + consumed);
+      }
+      TEST(pending.empty());
+      TEST(100 == decoder.records());
+      TEST(0 == decoder.corrupt());
+      TEST(100 == values_->values_.size());
+      TEST(42 == values_->values_[42]);
+      TEST("name42" == values_->names_[42]);
+
+      // reserved but uncommitted (zeroed) space is not a record
+      std::vector<std::byte> zeroes(64);
+      TEST(0 == decoder.decode(zeroes, [&](const auto&) noexcept { TEST(false); }));
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testFragmented() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      std::string large(200 * 1024, 'x');
+      for (size_type index{}; index < large.size(); ++index) {
+        large[index] = static_cast<char>('a' + (index % 26));
+      }
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      drain.add(capture);
+      zs::log::output(_AnonLargeEntry{}, 1, std::string_view{ large });
+      log(0, 1);
+      zs::log::output(_AnonLargeEntry{}, 2, std::string_view{ "short" });
+      drain.drainOnce(true);
+      drain.remove(capture);
+
+      size_type fragments{};
+      auto& bytes{ capture->bytes_ };
+      for (size_type pos{}; pos < bytes.size();) {
+        auto& header{ *reinterpret_cast<const zs::log::RecordHeader*>(bytes.data() + pos) };
+        fragments += (zs::log::RecordKind::Fragment == header.kind_) ? 1 : 0;
+        pos += header.size_;
+      }
+      TEST(fragments >= 3);
+
+      std::vector<std::string> bodies;
+      auto collector{ [&](const zs::log::RecordDecoder::Record& record) noexcept(false) {
+        TEST(nullptr != record.entry_);
+        if ((!record.entry_) || ("large" != record.entry_->name_))
+          return;
+        zs::log::ParamReader reader{ *record.entry_, record.payload_ };
+        zs::log::ParamReader::Param value;
+        zs::log::ParamReader::Param body;
+        TEST(reader.next(value));
+        TEST(reader.next(body));
+        bodies.emplace_back(reinterpret_cast<const char*>(body.data_.data()), body.count_);
+      } };
+
+      // strings are not clamped and the chain comes out as one record
+      zs::log::RecordDecoder decoder;
+      std::vector<std::byte> pending;
+      for (size_type pos{}; pos < bytes.size(); pos += 4093) {
+        const size_type size{ std::min<size_type>(4093, bytes.size() - pos) };
+        pending.insert(pending.end(), bytes.begin() + pos, bytes.begin() + pos + size);
+        const size_type consumed{ decoder.decode(pending, collector) };
+        pending.erase(pending.begin(), pending.begin() + consumed);
+      }
+      TEST(pending.empty());
+      TEST(3 == decoder.records());
+      TEST(0 == decoder.discarded());
+      TEST(2 == bodies.size());
+      TEST(large == bodies.front());
+      TEST("short" == bodies.back());
+
+      // a chain that outgrows what the decoder keeps pending is given up
+      bodies.clear();
+      zs::log::RecordDecoder bounded{ 100 * 1024 };
+      TEST(bytes.size() == bounded.decode(bytes, collector));
+      TEST(2 == bounded.records());
+      TEST(0 != bounded.discarded());
+      TEST(1 == bodies.size());
+      TEST("short" == bodies.front());
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testContext() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      drain.add(capture);
+      log(0, 1);
+      {
+        auto request{ zs::log::LogContext::scope("request", "r1") };
+        log(1, 2);
+        {
+          auto session{ zs::log::LogContext::scope("session", "s9") };
+          TEST(2 == zs::log::LogContext::local().depth());
+          log(3, 1);
+          zs::log::output(_AnonLargeEntry{}, 4, std::string_view{ std::string(100 * 1024, 'y') });
+        }
+        log(5, 1);
+      }
+      TEST(zs::log::LogContext::local().empty());
+      log(6, 1);
+      drain.drainOnce(true);
+      drain.remove(capture);
+
+      // one context record per change, not per entry, and one once the stack emptied
+      size_type contexts{};
+      size_type ends{};
+      auto& bytes{ capture->bytes_ };
+      for (size_type pos{}; pos < bytes.size();) {
+        auto& header{ *reinterpret_cast<const zs::log::RecordHeader*>(bytes.data() + pos) };
+        if (zs::log::RecordKind::Context == header.kind_)
+          ++(0 != (header.flags_ & zs::log::recordFlagEnded()) ? ends : contexts);
+        pos += header.size_;
+      }
+      TEST(3 == contexts);
+      TEST(1 == ends);
+
+      std::vector<std::vector<zs::log::ContextField>> fields;
+      zs::log::RecordDecoder decoder;
+      TEST(bytes.size() == decoder.decode(bytes, [&](const zs::log::RecordDecoder::Record& record) noexcept(false) {
+        TEST((0 == record.contextId_) == (nullptr == record.context_));
+        fields.push_back(record.context_ ? *record.context_ : std::vector<zs::log::ContextField>{});
+        if ((record.entry_) && ("reader" == record.entry_->name_))
+          collect(record);
+      }));
+
+      const std::vector<zs::log::ContextField> none;
+      const std::vector<zs::log::ContextField> request{ { "request", "r1" } };
+      const std::vector<zs::log::ContextField> both{ { "request", "r1" }, { "session", "s9" } };
+      TEST(7 == fields.size());
+      if (7 == fields.size()) {
+        TEST(none == fields[0]);
+        TEST(request == fields[1]);
+        TEST(request == fields[2]);
+        TEST(both == fields[3]);
+        TEST(both == fields[4]);
+        TEST(request == fields[5]);
+        TEST(none == fields[6]);
+      }
+      TEST(6 == values_->values_.size());
+      TEST(5 == values_->values_[4]);
+      TEST(0 == decoder.corrupt());
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testMetrics() noexcept(false)
+    {
+      static zs::log::Component metricsComponent{ "zsTestMetrics" };
+      static zs::log::Counter requests{ metricsComponent, "requests" };
+      static zs::log::Gauge connections{ metricsComponent, "connections" };
+      static zs::log::Histogram latency{ metricsComponent, "latency" };
+
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      // a thread that exits leaves its counts behind
+      std::thread thread{ []() noexcept {
+        for (int i = 0; i < 1000; ++i) {
+          requests.add();
+          latency.record(static_cast<std::uint64_t>(i));
+        }
+      } };
+      thread.join();
+      ++requests;
+      requests.add(9);
+      latency.record(1000000);
+      connections.set(42);
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      drain.add(capture);
+      TEST(3 <= zs::log::Metric::snapshot(zs::log::Drain::local()));
+      metricsComponent.level(zs::log::Level::None);
+      zs::log::Metric::snapshot(zs::log::Drain::local());
+      metricsComponent.level(zs::log::Level::Basic);
+      drain.drainOnce(true);
+      drain.remove(capture);
+
+      std::vector<zs::log::MetricSample> samples;
+      zs::log::RecordDecoder decoder;
+      size_type snapshots{};
+      TEST(capture->bytes_.size() == decoder.decode(capture->bytes_, [](const zs::log::RecordDecoder::Record&) noexcept {}, [&](const zs::log::RecordHeader& header, const std::vector<zs::log::MetricSample>& metrics) noexcept {
+        TEST(0 != header.timestamp_);
+        ++snapshots;
+        for (auto& sample : metrics) {
+          if ("zsTestMetrics" == sample.component_)
+            samples.push_back(sample);
+        }
+      }));
+      TEST(0 == decoder.corrupt());
+      TEST(0 != snapshots);
+
+      // only the first snapshot was taken with the component switched on
+      TEST(3 == samples.size());
+      for (auto& sample : samples) {
+        if ("requests" == sample.name_) {
+          TEST(zs::log::MetricKind::Counter == sample.kind_);
+          TEST(1010 == sample.value_);
+        }
+        else if ("connections" == sample.name_) {
+          TEST(zs::log::MetricKind::Gauge == sample.kind_);
+          TEST(42 == sample.value_);
+        }
+        else {
+          TEST("latency" == sample.name_);
+          TEST(zs::log::MetricKind::Histogram == sample.kind_);
+          TEST(1001 == sample.count_);
+          TEST((999 * 1000 / 2) + 1000000 == sample.sum_);
+          std::uint64_t total{};
+          for (auto& bucket : sample.buckets_) {
+            total += bucket.second;
+          }
+          TEST(1001 == total);
+          TEST(!sample.buckets_.empty());
+          if (!sample.buckets_.empty())
+            TEST(zs::log::Histogram::bucket(1000000) == sample.buckets_.back().first);
+        }
+      }
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testBacktrace() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      zs::log::Backtrace::enable(true);
+      auto capture{ std::make_shared<CaptureSink>() };
+      drain.add(capture);
+      zs::log::output(_AnonErrorEntry{}, 1);
+      log(2, 1);
+      zs::log::Backtrace::enable(false);
+      zs::log::output(_AnonErrorEntry{}, 3);
+      drain.drainOnce(true);
+      drain.remove(capture);
+
+      std::vector<size_type> depths;
+      std::vector<std::uint64_t> frames;
+      zs::log::RecordDecoder decoder;
+      TEST(capture->bytes_.size() == decoder.decode(capture->bytes_, [&](const zs::log::RecordDecoder::Record& record) noexcept(false) {
+        depths.push_back(record.backtrace_.size());
+        if (frames.empty())
+          frames.assign(record.backtrace_.begin(), record.backtrace_.end());
+        if ((record.entry_) && ("reader" == record.entry_->name_))
+          collect(record);
+      }));
+      TEST(0 == decoder.corrupt());
+
+      // only the severe entry logged while enabled carries a stack
+      TEST(3 == depths.size());
+      if (3 == depths.size()) {
+#ifdef __linux__
+        TEST(0 != depths[0]);
+#endif //__linux__
+        TEST(0 == depths[1]);
+        TEST(0 == depths[2]);
+      }
+      TEST(1 == values_->values_.size());
+
+      // the stack points into the modules described with the stream
+#ifdef __linux__
+      TEST(!decoder.modules().empty());
+      for (auto address : frames) {
+        TEST(nullptr != zs::log::ModuleMap::find(decoder.modules(), address));
+      }
+#endif //__linux__
+
+#ifndef _WIN32
+      // a module path is handed to the symbolizer as is, never to a shell
+      const char* injected{ "zs_test_log_injected" };
+      std::remove(injected);
+      std::vector<zs::log::Module> forged(1);
+      forged[0].base_ = 0x1000;
+      forged[0].low_ = 0x1000;
+      forged[0].high_ = 0x2000;
+      forged[0].path_ = std::string{ "/nonexistent'; touch " } + injected + "; '";
+      const std::uint64_t address{ 0x1010 };
+      zs::log::Symbolizer symbolizer;
+      symbolizer.resolve(forged, gsl::span<const std::uint64_t>{ &address, 1 });
+      TEST(forged[0].path_ + "+0x10" == symbolizer.symbol(address));
+      TEST(!std::ifstream{ injected });
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testSequence() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+      zs::log::Sequence::enable(true);
+
+      auto first{ std::make_shared<CaptureSink>() };
+      drain.add(first);
+      std::thread{ [&]() noexcept { log(0, 3); } }.join();
+      drain.drainOnce(true);
+      drain.remove(first);
+
+      auto second{ std::make_shared<CaptureSink>() };
+      drain.add(second);
+      {
+        auto request{ zs::log::LogContext::scope("request", "r2") };
+        log(3, 3);
+      }
+      drain.drainOnce(true);
+      drain.remove(second);
+      zs::log::Sequence::enable(false);
+
+      // the sequence follows the context id in the prefix
+      std::vector<std::uint64_t> sequences;
+      zs::log::RecordDecoder decoder;
+      decoder.decode(second->bytes_, [&](const zs::log::RecordDecoder::Record& record) noexcept(false) {
+        TEST(nullptr != record.context_);
+        sequences.push_back(record.sequence_);
+        collect(record);
+      });
+      TEST(3 == sequences.size());
+      TEST(std::is_sorted(sequences.begin(), sequences.end()));
+      TEST(std::all_of(sequences.begin(), sequences.end(), [](auto sequence) noexcept { return 0 != sequence; }));
+      TEST((std::vector<int>{ 3, 4, 5 }) == values_->values_);
+
+      auto merge{ [&]() noexcept(false) {
+        values_->values_.clear();
+        zs::log::RecordMerger merger{ 2 };
+        auto callback{ [&](const zs::log::RecordDecoder::Record& record) noexcept(false) { collect(record); } };
+        TEST(second->bytes_.size() == merger.decode(0, second->bytes_, callback));
+        TEST(first->bytes_.size() == merger.decode(1, first->bytes_, callback));
+
+        // both inputs could still bring entries from within the window
+        TEST(values_->values_.empty());
+        TEST(6 == merger.buffered());
+        merger.finish(0, callback);
+        merger.finish(1, callback);
+        TEST(0 == merger.buffered());
+        TEST(0 == merger.late());
+        TEST((std::vector<int>{ 0, 1, 2, 3, 4, 5 }) == values_->values_);
+      } };
+      merge();
+
+      // the sequence numbers break ties, the order of the inputs does not
+      for (auto* capture : { first.get(), second.get() }) {
+        for (size_type pos{}; pos < capture->bytes_.size();) {
+          auto& header{ *reinterpret_cast<zs::log::RecordHeader*>(capture->bytes_.data() + pos) };
+          if (zs::log::RecordKind::Entry == header.kind_)
+            header.timestamp_ = 1;
+          pos += header.size_;
+        }
+      }
+      merge();
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testRepeat() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      drain.add(capture);
+      zs::log::Repeats::enable(true);
+      std::thread{ [&]() noexcept {
+        for (int i = 0; i < 5; ++i) {
+          log(7, 1);
+        }
+        log(8, 1);
+        // counted until the thread exits
+        for (int i = 0; i < 3; ++i) {
+          log(9, 1);
+        }
+      } }.join();
+      zs::log::Repeats::enable(false);
+      drain.drainOnce(true);
+      drain.remove(capture);
+
+      std::vector<std::uint64_t> repeats;
+      zs::log::RecordDecoder decoder;
+      decoder.decode(capture->bytes_, [&](const zs::log::RecordDecoder::Record& record) noexcept(false) {
+        if (0 == record.repeats())
+          return collect(record);
+        TEST(nullptr != record.entry_);
+        TEST(record.payload_.size() == sizeof(zs::log::RepeatRecord));
+        values_->values_.push_back(-1);
+        repeats.push_back(record.repeats());
+      });
+      TEST((std::vector<int>{ 7, -1, 8, 9, -1 }) == values_->values_);
+      TEST((std::vector<std::uint64_t>{ 4, 2 }) == repeats);
+      TEST(0 == decoder.corrupt());
+
+      // a thread that goes quiet has its count written by the drain once it
+      // is flushed, and the count follows the entry it repeats
+      capture = std::make_shared<CaptureSink>();
+      drain.add(capture);
+      zs::log::Repeats::enable(true);
+      std::mutex mutex;
+      std::condition_variable wake;
+      bool logged{};
+      bool done{};
+      std::thread idle{ [&]() noexcept {
+        for (int i = 0; i < 4; ++i) {
+          log(11, 1);
+        }
+        std::unique_lock lock{ mutex };
+        logged = true;
+        wake.notify_all();
+        wake.wait(lock, [&]() noexcept { return done; });
+      } };
+      {
+        std::unique_lock lock{ mutex };
+        wake.wait(lock, [&]() noexcept { return logged; });
+      }
+      drain.drainOnce(true);
+      const auto held{ capture->bytes_.size() };
+      drain.flush();
+      TEST(held + zs::log::RecordHeader::recordSize(sizeof(zs::log::RepeatRecord)) == capture->bytes_.size());
+      {
+        std::lock_guard lock{ mutex };
+        done = true;
+      }
+      wake.notify_all();
+      idle.join();
+      zs::log::Repeats::enable(false);
+      drain.drainOnce(true);
+      drain.remove(capture);
+
+      values_->values_.clear();
+      repeats.clear();
+      zs::log::RecordDecoder quiet;
+      quiet.decode(capture->bytes_, [&](const zs::log::RecordDecoder::Record& record) noexcept(false) {
+        if (0 == record.repeats())
+          return collect(record);
+        values_->values_.push_back(-1);
+        repeats.push_back(record.repeats());
+      });
+      TEST((std::vector<int>{ 11, -1 }) == values_->values_);
+      TEST((std::vector<std::uint64_t>{ 3 }) == repeats);
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testBatch() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      struct Level
+      {
+        int price_{};
+        std::uint32_t quantity_{};
+      };
+      std::vector<Level> book(10000);
+      for (int index = 0; index < static_cast<int>(book.size()); ++index) {
+        book[index] = Level{ index, static_cast<std::uint32_t>(index * 2) };
+      }
+      auto project{ [](const Level& level) noexcept { return std::tuple{ level.price_, level.quantity_ }; } };
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      drain.add(capture);
+      zs::log::outputEach(_AnonLevelEntry{}, book, project);
+      zs::log::outputEach(_AnonLevelEntry{}, std::vector<Level>{}, project);
+      // one site, whether logged singly or batched
+      zs::log::output(_AnonLevelEntry{}, -1, std::uint32_t{ 7 });
+      drain.drainOnce(true);
+      drain.remove(capture);
+
+      // too many for one record
+      size_type batches{};
+      for (size_type pos{}; pos < capture->bytes_.size();) {
+        auto& header{ *reinterpret_cast<zs::log::RecordHeader*>(capture->bytes_.data() + pos) };
+        if (zs::log::RecordKind::Batch == header.kind_)
+          ++batches;
+        pos += header.size_;
+      }
+      TEST(2 == batches);
+
+      std::vector<Level> levels;
+      std::vector<std::uint64_t> timestamps;
+      zs::log::RecordDecoder decoder;
+      decoder.decode(capture->bytes_, [&](const zs::log::RecordDecoder::Record& record) noexcept(false) {
+        TEST(nullptr != record.entry_);
+        if (!record.entry_)
+          return;
+        TEST("level" == record.entry_->name_);
+        TEST(zs::log::RecordKind::Entry == record.header_.kind_);
+        zs::log::ParamReader reader{ *record.entry_, record.payload_ };
+        zs::log::ParamReader::Param price;
+        zs::log::ParamReader::Param quantity;
+        TEST(reader.next(price));
+        TEST(reader.next(quantity));
+        Level level;
+        memcpy(&level.price_, price.data_.data(), sizeof(level.price_));
+        memcpy(&level.quantity_, quantity.data_.data(), sizeof(level.quantity_));
+        levels.push_back(level);
+        timestamps.push_back(record.header_.timestamp_);
+      });
+      TEST(0 == decoder.corrupt());
+      TEST(book.size() + 1 == levels.size());
+      TEST(book.size() + 1 == decoder.records());
+      bool same{ true };
+      for (size_type index{}; index < book.size() && index < levels.size(); ++index) {
+        same = same && (book[index].price_ == levels[index].price_) && (book[index].quantity_ == levels[index].quantity_);
+      }
+      TEST(same);
+      TEST((!levels.empty()) && (-1 == levels.back().price_) && (7 == levels.back().quantity_));
+      TEST((!timestamps.empty()) && (timestamps.front() == timestamps[book.size() / 4]));
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testBlob() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      bool released{};
+      std::vector<std::byte> packet(4000);
+      for (size_type index{}; index < packet.size(); ++index) {
+        packet[index] = static_cast<std::byte>(index);
+      }
+      const std::byte* packetData{ packet.data() };
+      zs::move_shared_ptr<const std::vector<std::byte>> buffer{ std::shared_ptr<const std::vector<std::byte>>{ new std::vector<std::byte>(std::move(packet)), [&](const std::vector<std::byte>* value) noexcept { released = true; delete value; } } };
+
+      std::vector<std::byte> small(16, std::byte{ 0x5A });
+      zs::move_shared_ptr<const std::vector<std::byte>> smallBuffer{ std::make_shared<const std::vector<std::byte>>(small) };
+
+      struct SpanSink : public CaptureSink
+      {
+        std::vector<const std::byte*> spans_;
+
+        void write(const zs::log::Batch& batch) noexcept override
+        {
+          for (auto& record : batch.records_) {
+            spans_.push_back(record.data());
+          }
+          CaptureSink::write(batch);
+        }
+      };
+
+      auto capture{ std::make_shared<SpanSink>() };
+      drain.add(capture);
+      zs::log::output(_AnonBlobEntry{}, 1, zs::log::Blob{ std::move(buffer) });
+      zs::log::output(_AnonBlobEntry{}, 2, zs::log::Blob{ std::move(smallBuffer) });
+      zs::log::output(_AnonBlobEntry{}, 3, zs::log::Blob{ gsl::span<const std::byte>{ small } });
+
+      // the ring holds on to the buffer until the drain wrote it
+      TEST(!released);
+      drain.drainOnce(true);
+      drain.remove(capture);
+      TEST(released);
+
+      // the sink was handed the bytes where they were, not a copy of them
+      TEST(std::find(capture->spans_.begin(), capture->spans_.end(), packetData) != capture->spans_.end());
+
+      std::vector<std::vector<std::byte>> blobs;
+      zs::log::RecordDecoder decoder;
+      TEST(capture->bytes_.size() == decoder.decode(capture->bytes_, [&](const zs::log::RecordDecoder::Record& record) noexcept(false) {
+        TEST(nullptr != record.entry_);
+        if ((!record.entry_) || ("blob" != record.entry_->name_))
+          return;
+        zs::log::ParamReader reader{ *record.entry_, record.payload_ };
+        zs::log::ParamReader::Param value;
+        zs::log::ParamReader::Param bytes;
+        TEST(reader.next(value));
+        TEST(reader.next(bytes));
+        blobs.emplace_back(bytes.data_.begin(), bytes.data_.end());
+      }));
+      TEST(0 == decoder.corrupt());
+      TEST(3 == blobs.size());
+      if (3 != blobs.size())
+        return;
+      TEST(4000 == blobs[0].size());
+      TEST(std::byte{ 123 } == blobs[0][123]);
+      TEST(std::byte{ 0x9F } == blobs[0][3999]);
+      TEST(small == blobs[1]);
+      TEST(small == blobs[2]);
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testFollow() noexcept(false)
+    {
+#ifndef _WIN32
+      const char* path{ "zs_test_log_follow.bin" };
+      const int fd{ ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+      TEST(fd >= 0);
+
+      auto follower{ zs::log::LogFollower::open(path) };
+      TEST(!!follower);
+      if (!follower)
+        return;
+      auto collector{ [&](const auto& record) noexcept(false) { collect(record); } };
+      TEST(0 == follower->follow(collector));
+
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      zs::log::WritevSink::Options options;
+      options.closeOnDestroy_ = true;
+      auto sink{ std::make_shared<zs::log::WritevSink>(fd, options) };
+      drain.add(sink);
+      log(0, 10);
+      drain.drainOnce(true);
+      TEST(10 == follower->follow(collector));
+
+      // a writer on another thread wakes the follower up long before the timeout
+      std::thread writer{ [&]() noexcept {
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+        log(10, 10);
+        drain.drainOnce(true);
+      } };
+      const auto start{ std::chrono::steady_clock::now() };
+      size_type total{};
+      while ((total < 10) && (std::chrono::steady_clock::now() - start < std::chrono::seconds{ 5 })) {
+        total += follower->follow(collector, std::chrono::seconds{ 5 });
+      }
+      writer.join();
+      TEST(10 == total);
+      TEST(std::chrono::steady_clock::now() - start < std::chrono::seconds{ 2 });
+
+      drain.remove(sink);
+      sink.reset();
+
+      // a record that is only partly written is held back until it is complete
+      const int append{ ::open(path, O_WRONLY | O_APPEND | O_CLOEXEC) };
+      TEST(append >= 0);
+      zs::log::RecordHeader header{};
+      header.size_ = static_cast<std::uint32_t>(zs::log::RecordHeader::recordSize(16));
+      header.kind_ = zs::log::RecordKind::Entry;
+      header.entry_ = 0xFFFF'FFFF;
+      std::vector<std::byte> record(header.size_);
+      memcpy(record.data(), &header, sizeof(header));
+      TEST(20 == ::write(append, record.data(), 20));
+      TEST(0 == follower->follow([](const auto&) noexcept { TEST(false); }));
+      TEST(static_cast<::ssize_t>(record.size() - 20) == ::write(append, record.data() + 20, record.size() - 20));
+      size_type unknown{};
+      TEST(1 == follower->follow([&](const auto& decoded) noexcept { unknown += decoded.entry_ ? 0 : 1; }));
+      TEST(1 == unknown);
+      ::close(append);
+
+      TEST(20 == values_->values_.size());
+      TEST(19 == values_->values_.back());
+      TEST(0 == follower->decoder().corrupt());
+
+      follower.reset();
+      std::remove(path);
+
+      // a hole read before it is filled is read again afterwards
+      const char* holePath{ "zs_test_log_follow_hole.bin" };
+      const int holed{ ::open(holePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+      TEST(holed >= 0);
+      follower = zs::log::LogFollower::open(holePath);
+      TEST(!!follower);
+      if (!follower)
+        return;
+      TEST(static_cast<::ssize_t>(record.size()) == ::pwrite(holed, record.data(), record.size(), static_cast<::off_t>(record.size())));
+      TEST(0 == follower->follow([](const auto&) noexcept { TEST(false); }));
+      TEST(0 == follower->offset());
+      TEST(static_cast<::ssize_t>(record.size()) == ::pwrite(holed, record.data(), record.size(), 0));
+      TEST(2 == follower->follow([](const auto&) noexcept {}));
+      TEST(static_cast<::off_t>(record.size() * 2) == follower->offset());
+      TEST(0 == follower->decoder().corrupt());
+      ::close(holed);
+      follower.reset();
+      std::remove(holePath);
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testChecksum() noexcept(false)
+    {
+      const char* text{ "123456789" };
+      TEST(0xe3069283 == zs::log::Crc32c::update(0, reinterpret_cast<const std::byte*>(text), 9));
+
+      std::vector<std::byte> noise(100000);
+      for (size_type index{}; index < noise.size(); ++index) {
+        noise[index] = static_cast<std::byte>((index * 2654435761u) >> 13);
+      }
+      bool same{ true };
+      for (size_type size : { 0, 1, 7, 255, 768, 769, 24576, 24583, 99997 }) {
+        const auto crc{ zs::log::Crc32c::update(0, noise.data() + 3, size) };
+        same = same && (crc == zs::log::Crc32c::updateSoftware(0, noise.data() + 3, size));
+        same = same && (crc == zs::log::Crc32c::update(zs::log::Crc32c::update(0, noise.data() + 3, size / 3), noise.data() + 3 + (size / 3), size - (size / 3)));
+      }
+      TEST(same);
+
+#ifndef _WIN32
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto readFile{ [](const char* path) noexcept(false) {
+        std::ifstream file{ path, std::ios::binary };
+        std::vector<char> chars{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+        std::vector<std::byte> result(chars.size());
+        memcpy(result.data(), chars.data(), chars.size());
+        return result;
+      } };
+
+      auto check{ [&](std::shared_ptr<zs::log::Sink> sink, const char* path) noexcept(false) {
+        drain.add(sink);
+        for (int pass = 0; pass < 20; ++pass) {
+          log(pass * 100, 100);
+          drain.drainOnce(true);
+        }
+        drain.flush();
+        drain.remove(sink);
+        sink.reset();
+
+        auto bytes{ readFile(path) };
+        std::remove(path);
+        {
+          zs::log::RecordDecoder decoder;
+          TEST(bytes.size() == decoder.decode(bytes, [&](const zs::log::RecordDecoder::Record& record) noexcept(false) { collect(record); }));
+          TEST(2000 == values_->values_.size());
+          TEST(decoder.verified() > 2);
+          TEST(decoder.damaged().empty());
+          TEST(0 == decoder.unverified());
+        }
+
+        // a flipped bit spoils the block it is in and no other
+        const size_type flipped{ bytes.size() / 2 };
+        bytes[flipped] ^= std::byte{ 0x10 };
+        zs::log::RecordDecoder decoder;
+        std::vector<std::byte> pending;
+        for (size_type pos{}; pos < bytes.size(); pos += 1000) {
+          pending.insert(pending.end(), bytes.begin() + pos, bytes.begin() + std::min(pos + 1000, bytes.size()));
+          const auto consumed{ decoder.decode(pending, [](const zs::log::RecordDecoder::Record&) noexcept {}) };
+          pending.erase(pending.begin(), pending.begin() + consumed);
+        }
+        TEST(1 == decoder.damaged().size());
+        if (1 == decoder.damaged().size()) {
+          TEST(decoder.damaged().front().offset_ <= flipped);
+          TEST(decoder.damaged().front().offset_ + decoder.damaged().front().size_ > flipped);
+        }
+        TEST(decoder.verified() > 1);
+        bytes[flipped] ^= std::byte{ 0x10 };
+
+        // a header claiming an absurd size spoils its block; decoding picks
+        // up again at the checksum record ending it, holding on to nothing
+        size_type broken{};
+        for (size_type pos{}; pos < bytes.size();) {
+          auto& header{ *reinterpret_cast<const zs::log::RecordHeader*>(bytes.data() + pos) };
+          if ((pos >= flipped) && (zs::log::RecordKind::Entry == header.kind_)) {
+            broken = pos;
+            break;
+          }
+          pos += header.size_;
+        }
+        TEST(0 != broken);
+        auto spoilt{ bytes };
+        const std::uint32_t size{ 0x7ffffff8 };
+        memcpy(spoilt.data() + broken, &size, sizeof(size));
+        {
+          zs::log::RecordDecoder resync;
+          size_type entries{};
+          size_type held{};
+          pending.clear();
+          for (size_type pos{}; pos < spoilt.size(); pos += 1000) {
+            pending.insert(pending.end(), spoilt.begin() + pos, spoilt.begin() + std::min(pos + 1000, spoilt.size()));
+            const auto consumed{ resync.decode(pending, [&](const zs::log::RecordDecoder::Record&) noexcept { ++entries; }) };
+            pending.erase(pending.begin(), pending.begin() + consumed);
+            held = std::max(held, pending.size());
+          }
+          TEST(pending.empty());
+          TEST(held < 4096);
+          TEST((entries > 1000) && (entries < 2000));
+          TEST(1 == resync.damaged().size());
+          if (1 == resync.damaged().size()) {
+            TEST(resync.damaged().front().offset_ <= broken);
+            TEST(resync.damaged().front().offset_ + resync.damaged().front().size_ > broken);
+          }
+          TEST(resync.verified() > 1);
+        }
+
+        // a zeroed stretch in the middle (what power loss leaves behind) spoils
+        // the blocks it touches and no other, unless the file is still being
+        // written and the stretch may yet be filled
+        {
+          auto zeroed{ bytes };
+          const size_type start{ (bytes.size() / 3) & ~size_type{ 7 } };
+          std::fill(zeroed.begin() + static_cast<std::ptrdiff_t>(start), zeroed.begin() + static_cast<std::ptrdiff_t>(start + 3000), std::byte{});
+          zs::log::RecordDecoder resync;
+          size_type entries{};
+          TEST(zeroed.size() == resync.decode(zeroed, [&](const zs::log::RecordDecoder::Record&) noexcept { ++entries; }));
+          TEST((entries > 1000) && (entries < 2000));
+          TEST((!resync.damaged().empty()) && (resync.damaged().size() <= 2));
+          for (auto& block : resync.damaged()) {
+            TEST(block.offset_ < start + 3000);
+            TEST(block.offset_ + block.size_ > start);
+          }
+          TEST(resync.verified() > 2);
+          TEST(0 == resync.unverified());
+
+          zs::log::RecordDecoder live{ zs::log::RecordDecoder::Input::Live };
+          TEST(live.decode(zeroed, [](const zs::log::RecordDecoder::Record&) noexcept {}) < start + 3000);
+          TEST(live.damaged().empty());
+        }
+
+        // a record cut short at the end spoils the block it is in
+        {
+          zs::log::RecordDecoder torn;
+          const gsl::span<const std::byte> cut{ bytes.data(), bytes.size() - 20 };
+          const auto consumed{ torn.decode(cut, [](const zs::log::RecordDecoder::Record&) noexcept {}) };
+          TEST(consumed < cut.size());
+          TEST(torn.damaged().empty());
+          torn.finish(cut.subspan(consumed));
+          TEST(1 == torn.damaged().size());
+          if (1 == torn.damaged().size())
+            TEST(torn.damaged().front().offset_ + torn.damaged().front().size_ == cut.size());
+        }
+        values_->values_.clear();
+        values_->names_.clear();
+      } };
+
+      const char* pwritePath{ "zs_test_log_checksum_pwrite.bin" };
+      {
+        const int fd{ ::open(pwritePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+        TEST(fd >= 0);
+        zs::log::PwriteSink::Options options;
+        options.closeOnDestroy_ = true;
+        options.checksumBytes_ = 16 * 1024;
+        check(std::make_shared<zs::log::PwriteSink>(fd, options), pwritePath);
+      }
+
+      const char* openPath{ "zs_test_log_checksum_open.bin" };
+      {
+        zs::log::FileSinkOptions options;
+        options.checksumBytes_ = 16 * 1024;
+        auto sink{ zs::log::openFileSink(openPath, options) };
+        TEST(!!sink);
+        check(std::move(sink), openPath);
+      }
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testParallel() noexcept(false)
+    {
+#ifndef _WIN32
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      drain.add(capture);
+      log(0, 1);
+      drain.drainOnce(true);
+      drain.remove(capture);
+
+      // every segment gets the schema, then entries interleaving with those
+      // of the other segments by timestamp, each a little out of order
+      std::vector<std::byte> schema;
+      std::vector<std::byte> entry;
+      for (size_type pos{}; pos < capture->bytes_.size();) {
+        auto& header{ *reinterpret_cast<const zs::log::RecordHeader*>(capture->bytes_.data() + pos) };
+        auto& target{ zs::log::RecordKind::Entry == header.kind_ ? entry : schema };
+        target.insert(target.end(), capture->bytes_.begin() + pos, capture->bytes_.begin() + pos + header.size_);
+        pos += header.size_;
+      }
+
+      constexpr int segments{ 3 };
+      constexpr int perSegment{ 2000 };
+      std::vector<std::string> paths;
+      for (int segment = 0; segment < segments; ++segment) {
+        std::vector<std::byte> bytes{ schema };
+        for (int index = 0; index < perSegment; ++index) {
+          const int swapped{ index ^ 1 };
+          const int value{ (swapped * segments) + segment };
+          auto& header{ *reinterpret_cast<zs::log::RecordHeader*>(entry.data()) };
+          header.timestamp_ = 1'000'000'000 + (static_cast<std::uint64_t>(value) * 1000);
+          memcpy(entry.data() + sizeof(header), &value, sizeof(value));
+          bytes.insert(bytes.end(), entry.begin(), entry.end());
+        }
+        paths.push_back("zs_test_log_segment" + std::to_string(segment) + ".bin");
+        std::ofstream{ paths.back(), std::ios::binary }.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+      }
+
+      zs::log::ParallelDecoder::Options options;
+      options.threads_ = 2;
+      options.readSize_ = 4096;
+      options.merge_.window_ = std::chrono::microseconds{ 10 };
+      options.merge_.maxBuffered_ = 300;
+      auto decoder{ zs::log::ParallelDecoder::open(paths, options) };
+      TEST(!!decoder);
+      if (decoder) {
+        TEST(segments * perSegment == decoder->run([&](const zs::log::RecordDecoder::Record& record) noexcept(false) { collect(record); }));
+        TEST(0 == decoder->late());
+        TEST(0 == decoder->corrupt());
+      }
+
+      TEST(segments * perSegment == values_->values_.size());
+      for (int index = 0; index < static_cast<int>(values_->values_.size()); ++index) {
+        if (index != values_->values_[index]) {
+          TEST(index == values_->values_[index]);
+          break;
+        }
+      }
+
+      TEST(!zs::log::ParallelDecoder::open({ "zs_test_log_missing.bin" }));
+      for (auto& path : paths) {
+        std::remove(path.c_str());
+      }
+
+      // a stretch of zeros longer than any record is not held on to; the
+      // entries past it are decoded and the stretch counts as corrupt once
+      const char* holePath{ "zs_test_log_segment_hole.bin" };
+      {
+        std::vector<std::byte> bytes{ schema };
+        for (int index = 0; index < 10; ++index) {
+          bytes.insert(bytes.end(), entry.begin(), entry.end());
+        }
+        const int fd{ ::open(holePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+        TEST(fd >= 0);
+        TEST(static_cast<::ssize_t>(bytes.size()) == ::pwrite(fd, bytes.data(), bytes.size(), 0));
+        const auto past{ static_cast<::off_t>(bytes.size() + (24 * 1024 * 1024)) };
+        TEST(static_cast<::ssize_t>(bytes.size() - schema.size()) == ::pwrite(fd, bytes.data() + schema.size(), bytes.size() - schema.size(), past));
+        ::close(fd);
+      }
+      options.threads_ = 1;
+      options.readSize_ = 1024 * 1024;
+      decoder = zs::log::ParallelDecoder::open({ holePath }, options);
+      TEST(!!decoder);
+      if (decoder) {
+        TEST(20 == decoder->run([](const zs::log::RecordDecoder::Record&) noexcept {}));
+        TEST(1 == decoder->corrupt());
+      }
+      std::remove(holePath);
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void runAll() noexcept(false)
+    {
+      auto runner{ [&](auto&& func) noexcept(false) { reset(); func(); } };
+
+      runner([&]() { testDecoder(); });
+      runner([&]() { testFragmented(); });
+      runner([&]() { testContext(); });
+      runner([&]() { testMetrics(); });
+      runner([&]() { testBacktrace(); });
+      runner([&]() { testSequence(); });
+      runner([&]() { testRepeat(); });
+      runner([&]() { testBatch(); });
+      runner([&]() { testBlob(); });
+      runner([&]() { testFollow(); });
+      runner([&]() { testChecksum(); });
+      runner([&]() { testParallel(); });
+    }
+  };
+
+  //---------------------------------------------------------------------------
+  void testLogReader() noexcept(false)
+  {
+    LogReaderBasics{}.runAll();
+  }
+
+}
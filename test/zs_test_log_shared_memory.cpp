@@ -0,0 +1,281 @@
+
+#include <zs/log.h>
+#include <zs/LogSharedMemory.h>
+
+#include "common.h"
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif //_WIN32
+
+namespace zsTest
+{
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  struct LogSharedMemoryBasics
+  {
+    using size_type = zs::size_type;
+
+    struct Values
+    {
+      std::string name_;
+    };
+
+    std::optional<Values> values_;
+
+    //-------------------------------------------------------------------------
+    struct CaptureSink : public zs::log::Sink
+    {
+      std::vector<zs::log::RecordHeader> headers_;
+      std::vector<int> values_;
+      std::vector<zs::log::SchemaEntry> schema_;
+      int schemaRecords_{};
+
+      void write(const zs::log::Batch& batch) noexcept override
+      {
+        for (auto& record : batch.records_) {
+          auto& header{ *reinterpret_cast<const zs::log::RecordHeader*>(record.data()) };
+          if (zs::log::RecordKind::Schema == header.kind_) {
+            ++schemaRecords_;
+            TEST(zs::log::SchemaReader::decode(record.subspan(sizeof(header)), schema_));
+            continue;
+          }
+          int value{};
+          memcpy(&value, record.data() + sizeof(header), sizeof(value));
+          headers_.push_back(header);
+          values_.push_back(value);
+        }
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    struct _AnonEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "shared", __FILE__, __FUNCTION__, __LINE__ };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 1; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 1> results{ { "value" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    // only ever logged through late(), which registers it long after startup
+    struct _LateEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "late", __FILE__, __FUNCTION__, __LINE__ };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 1; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 1> results{ { "value" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    static const zs::log::MetaDataLogEntry& late() noexcept
+    {
+      static zs::log::MetaDataLogEntryWithArgs<_LateEntry, int> entry{ _LateEntry::info(), _LateEntry::paramNames() };
+      return entry;
+    }
+
+    //-------------------------------------------------------------------------
+    void reset()
+    {
+      values_.reset();
+      values_.emplace();
+#ifndef _WIN32
+      values_->name_ = "zsTest" + std::to_string(::getpid());
+#endif //_WIN32
+    }
+
+    //-------------------------------------------------------------------------
+    void testSameProcess() noexcept(false)
+    {
+#ifndef _WIN32
+      auto sink{ std::make_shared<CaptureSink>() };
+      auto collector{ zs::log::SharedMemoryCollector::create(values_->name_, sink) };
+      TEST(!!collector);
+      if (!collector)
+        return;
+
+      zs::log::SharedMemoryProducer::Options options;
+      options.rings_ = 2;
+      options.ringCapacity_ = 64 * 1024;
+      auto producer{ zs::log::SharedMemoryProducer::attach(values_->name_, options) };
+      TEST(!!producer);
+      if (!producer)
+        return;
+
+      // only threads that log for the first time pick up a shared ring
+      for (int pass = 0; pass < 3; ++pass) {
+        std::thread thread{ [pass]() noexcept {
+          for (int i = 0; i < 100; ++i) {
+            zs::log::output(_AnonEntry{}, (pass * 100) + i);
+          }
+        } };
+        thread.join();
+      }
+      producer->detach();
+
+      TEST(collector->collectOnce());
+      TEST(1 == collector->processes());
+      TEST(0 == collector->unknown());
+      TEST(1 == sink->schemaRecords_);
+      TEST(300 == sink->values_.size());
+      TEST(std::is_sorted(sink->values_.begin(), sink->values_.end()));
+
+      auto found{ std::find_if(sink->schema_.begin(), sink->schema_.end(), [](auto& entry) noexcept { return "shared" == entry.name_; }) };
+      TEST(found != sink->schema_.end());
+      if (found != sink->schema_.end()) {
+        // the collector keeps the stable call site id of the producer
+        auto& metaData{ zs::log::logEntryMetaData<_AnonEntry, int> };
+        TEST(found->id_ == metaData.id());
+        TEST(std::all_of(sink->headers_.begin(), sink->headers_.end(), [&](auto& header) noexcept { return header.entry_ == found->id_; }));
+      }
+
+      // the collector notices the producer is done once it lets go of the region
+      producer.reset();
+      TEST(!collector->collectOnce());
+      TEST(0 == collector->processes());
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testCrashedProducer() noexcept(false)
+    {
+#ifndef _WIN32
+      auto sink{ std::make_shared<CaptureSink>() };
+      auto collector{ zs::log::SharedMemoryCollector::create(values_->name_, sink) };
+      TEST(!!collector);
+      if (!collector)
+        return;
+
+      auto produce{ [&](int first) noexcept -> ::pid_t {
+        const ::pid_t pid{ ::fork() };
+        if (0 != pid)
+          return pid;
+
+        zs::log::SharedMemoryProducer::Options options;
+        options.rings_ = 1;
+        options.ringCapacity_ = 64 * 1024;
+        auto producer{ zs::log::SharedMemoryProducer::attach(values_->name_, options) };
+        if (!producer)
+          ::_exit(1);
+        std::thread thread{ [first]() noexcept {
+          for (int i = 0; i < 50; ++i) {
+            zs::log::output(_AnonEntry{}, first + i);
+          }
+        } };
+        thread.join();
+
+        // die without draining, closing or unmapping anything
+        ::_exit(0);
+      } };
+
+      for (int child = 0; child < 2; ++child) {
+        const ::pid_t pid{ produce(child * 1000) };
+        TEST(pid > 0);
+        int status{};
+        TEST(pid == ::waitpid(pid, &status, 0));
+        TEST(WIFEXITED(status) && (0 == WEXITSTATUS(status)));
+      }
+
+      TEST(collector->collectOnce());
+      TEST(0 == collector->processes());
+      TEST(100 == sink->values_.size());
+      TEST(0 == sink->values_.front());
+      TEST(1049 == sink->values_.back());
+
+      // the same call site from two processes is described once
+      TEST(1 == std::count_if(sink->schema_.begin(), sink->schema_.end(), [](auto& entry) noexcept { return "shared" == entry.name_; }));
+      TEST(std::all_of(sink->headers_.begin(), sink->headers_.end(), [&](auto& header) noexcept { return header.entry_ == sink->headers_.front().entry_; }));
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testLateSites() noexcept(false)
+    {
+#ifndef _WIN32
+      auto sink{ std::make_shared<CaptureSink>() };
+      auto collector{ zs::log::SharedMemoryCollector::create(values_->name_, sink) };
+      TEST(!!collector);
+      if (!collector)
+        return;
+
+      // a schema area too small for the call sites known at attach time
+      zs::log::SharedMemoryProducer::Options options;
+      options.rings_ = 1;
+      options.ringCapacity_ = 64 * 1024;
+      options.schemaCapacity_ = 64;
+      TEST(!zs::log::SharedMemoryProducer::attach(values_->name_, options));
+
+      // the site registers after the producer attached and published
+      options.schemaCapacity_ = 1024 * 1024;
+      options.schemaInterval_ = std::chrono::hours{ 1 };
+      auto producer{ zs::log::SharedMemoryProducer::attach(values_->name_, options) };
+      TEST(!!producer);
+      if (!producer)
+        return;
+
+      std::thread thread{ []() noexcept {
+        zs::log::output(_AnonEntry{}, 1);
+        zs::log::LogEntry<int>{}(late(), 2);
+        zs::log::output(_AnonEntry{}, 3);
+      } };
+      thread.join();
+
+      // held back in the ring, not dropped, until the schema describes it
+      TEST(collector->collectOnce());
+      TEST(0 == collector->unknown());
+      TEST(1 == sink->values_.size());
+
+      TEST(producer->publishSchema());
+      TEST(collector->collectOnce());
+      TEST(0 == collector->unknown());
+      TEST(3 == sink->values_.size());
+      TEST(std::is_sorted(sink->values_.begin(), sink->values_.end()));
+      TEST(1 == std::count_if(sink->schema_.begin(), sink->schema_.end(), [](auto& entry) noexcept { return "late" == entry.name_; }));
+      producer->detach();
+      producer.reset();
+      TEST(!collector->collectOnce());
+      TEST(0 == collector->processes());
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void runAll() noexcept(false)
+    {
+      auto runner{ [&](auto&& func) noexcept(false) { reset(); func(); } };
+
+      runner([&]() { testSameProcess(); });
+      runner([&]() { testCrashedProducer(); });
+      runner([&]() { testLateSites(); });
+    }
+  };
+
+  //---------------------------------------------------------------------------
+  void testLogSharedMemory() noexcept(false)
+  {
+    LogSharedMemoryBasics{}.runAll();
+  }
+
+}
@@ -0,0 +1,252 @@
+
+#include <zs/log.h>
+#include <zs/LogSocketSink.h>
+
+#include "common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif //_WIN32
+
+namespace zsTest
+{
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  struct LogSocketBasics
+  {
+    using size_type = zs::size_type;
+
+    struct Values
+    {
+      std::string path_;
+    };
+
+    std::optional<Values> values_;
+
+    //-------------------------------------------------------------------------
+    struct CaptureSink : public zs::log::Sink
+    {
+      std::vector<zs::log::RecordHeader> headers_;
+      std::vector<int> values_;
+      std::vector<zs::log::SchemaEntry> schema_;
+
+      void write(const zs::log::Batch& batch) noexcept override
+      {
+        for (auto& record : batch.records_) {
+          auto& header{ *reinterpret_cast<const zs::log::RecordHeader*>(record.data()) };
+          if (zs::log::RecordKind::Schema == header.kind_) {
+            TEST(zs::log::SchemaReader::decode(record.subspan(sizeof(header)), schema_));
+            continue;
+          }
+          int value{};
+          memcpy(&value, record.data() + sizeof(header), sizeof(value));
+          headers_.push_back(header);
+          values_.push_back(value);
+        }
+      }
+
+      [[nodiscard]] bool described(std::uint64_t id) const noexcept
+      {
+        return std::any_of(schema_.begin(), schema_.end(), [&](auto& entry) noexcept { return entry.id_ == id; });
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    struct _AnonEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "socket", __FILE__, __FUNCTION__, __LINE__ };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 1; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 1> results{ { "value" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    // runs a collector on its own thread for as long as it is in scope
+    struct Background
+    {
+      std::unique_ptr<zs::log::SocketCollector> collector_;
+      std::atomic_bool running_{ true };
+      std::thread thread_;
+
+      Background(std::unique_ptr<zs::log::SocketCollector> collector) noexcept :
+        collector_{ std::move(collector) },
+        thread_{ [this]() noexcept { collector_->run(running_, std::chrono::milliseconds{ 5 }); } }
+      {}
+
+      ~Background() noexcept
+      {
+        running_.store(false);
+        thread_.join();
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    void reset()
+    {
+      values_.reset();
+      values_.emplace();
+#ifndef _WIN32
+      values_->path_ = "/tmp/zs_test_log_" + std::to_string(::getpid()) + ".sock";
+#endif //_WIN32
+    }
+
+    //-------------------------------------------------------------------------
+    void log(int first, int count) noexcept
+    {
+      for (int i = 0; i < count; ++i) {
+        zs::log::output(_AnonEntry{}, first + i);
+      }
+    }
+
+    //-------------------------------------------------------------------------
+    void testUnix() noexcept(false)
+    {
+#ifndef _WIN32
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      zs::log::SocketCollector::Options collectorOptions;
+      collectorOptions.window_ = 4096;      // far less than what is sent, credit has to flow
+      auto collector{ zs::log::SocketCollector::listenUnix(values_->path_.c_str(), capture, collectorOptions) };
+      TEST(!!collector);
+      if (!collector)
+        return;
+
+      auto sink{ zs::log::SocketSink::connectUnix(values_->path_.c_str()) };
+      TEST(!!sink);
+      {
+        Background background{ std::move(collector) };
+        drain.add(sink);
+        for (int pass = 0; pass < 10; ++pass) {
+          log(pass * 1000, 1000);
+          drain.drainOnce(true);
+        }
+        drain.flush();
+        drain.remove(sink);
+      }
+
+      TEST(sink->connected());
+      TEST(1 == sink->connects());
+      TEST(0 == sink->spooled());
+      TEST(10000 == capture->values_.size());
+      TEST(std::is_sorted(capture->values_.begin(), capture->values_.end()));
+      TEST(std::all_of(capture->headers_.begin(), capture->headers_.end(), [&](auto& header) noexcept { return capture->described(header.entry_); }));
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testTcp() noexcept(false)
+    {
+#ifndef _WIN32
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      auto collector{ zs::log::SocketCollector::listenTcp("127.0.0.1", 0, capture) };
+      TEST(!!collector);
+      if (!collector)
+        return;
+      const auto port{ collector->port() };
+      TEST(0 != port);
+
+      auto sink{ zs::log::SocketSink::connectTcp("127.0.0.1", port) };
+      TEST(!!sink);
+      {
+        Background background{ std::move(collector) };
+        drain.add(sink);
+        log(0, 500);
+        drain.flush();
+        drain.remove(sink);
+      }
+
+      TEST(0 == sink->spooled());
+      TEST(500 == capture->values_.size());
+      TEST(499 == capture->values_.back());
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testReconnect() noexcept(false)
+    {
+#ifndef _WIN32
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      zs::log::SocketSink::Options options;
+      options.reconnectMax_ = std::chrono::milliseconds{ 20 };
+      options.flushTimeout_ = std::chrono::milliseconds{ 2000 };
+      auto sink{ zs::log::SocketSink::connectUnix(values_->path_.c_str(), options) };
+      TEST(!!sink);
+      drain.add(sink);
+
+      // nothing is listening yet, everything is spooled
+      log(0, 100);
+      drain.drainOnce(true);
+      TEST(!sink->connected());
+      TEST(0 != sink->spooled());
+
+      auto first{ std::make_shared<CaptureSink>() };
+      {
+        Background background{ zs::log::SocketCollector::listenUnix(values_->path_.c_str(), first) };
+        drain.flush();
+        TEST(0 == sink->spooled());
+      }
+      TEST(100 == first->values_.size());
+
+      // the collector went away; a new one gets the schema again plus the records
+      log(100, 100);
+      drain.drainOnce(true);
+
+      auto second{ std::make_shared<CaptureSink>() };
+      {
+        Background background{ zs::log::SocketCollector::listenUnix(values_->path_.c_str(), second) };
+        drain.flush();
+        TEST(0 == sink->spooled());
+      }
+      drain.remove(sink);
+
+      TEST(2 == sink->connects());
+      TEST(100 == second->values_.size());
+      TEST(100 == second->values_.front());
+      TEST(std::all_of(second->headers_.begin(), second->headers_.end(), [&](auto& header) noexcept { return second->described(header.entry_); }));
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void runAll() noexcept(false)
+    {
+      auto runner{ [&](auto&& func) noexcept(false) { reset(); func(); } };
+
+      runner([&]() { testUnix(); });
+      runner([&]() { testTcp(); });
+      runner([&]() { testReconnect(); });
+    }
+  };
+
+  //---------------------------------------------------------------------------
+  void testLogSocket() noexcept(false)
+  {
+    LogSocketBasics{}.runAll();
+  }
+
+}
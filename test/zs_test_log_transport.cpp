@@ -0,0 +1,896 @@
+
+#include <zs/log.h>
+#include <zs/LogFileSink.h>
+#include <zs/LogRetention.h>
+#include <zs/LogTextSink.h>
+#include <zs/LogUringSink.h>
+
+#include "common.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif //_WIN32
+
+namespace zsTest
+{
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  //---------------------------------------------------------------------------
+  struct LogTransportBasics
+  {
+    using size_type = zs::size_type;
+
+    struct Values
+    {
+    };
+
+    std::optional<Values> values_;
+
+    //-------------------------------------------------------------------------
+    struct CaptureSink : public zs::log::Sink
+    {
+      std::vector<std::byte> bytes_;
+      std::vector<zs::log::RecordHeader> headers_;
+      std::vector<zs::log::SchemaEntry> schema_;
+      int writes_{};
+
+      bool ready(const zs::log::Batch&, clock_type::duration) const noexcept override { return false; }
+
+      void write(const zs::log::Batch& batch) noexcept override
+      {
+        ++writes_;
+        for (auto& record : batch.records_) {
+          auto& header{ *reinterpret_cast<const zs::log::RecordHeader*>(record.data()) };
+          if (zs::log::RecordKind::Schema == header.kind_)
+            TEST(zs::log::SchemaReader::decode(record.subspan(sizeof(header)), schema_));
+          else
+            headers_.push_back(header);
+          bytes_.insert(bytes_.end(), record.begin(), record.end());
+        }
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    struct _AnonEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "transport", __FILE__, __FUNCTION__, __LINE__ };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 2; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 2> results{ { "value", "name" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    struct _AnonOtherEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "other", __FILE__, __FUNCTION__, __LINE__ };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 1; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 1> results{ { "value" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    template <zs::log::Severity severity>
+    struct _AnonUrgentEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "urgent", __FILE__, __FUNCTION__, __LINE__, severity };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 1; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 1> results{ { "value" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    // about 40 KiB with every parameter at maxLogStringLength
+    struct _AnonWideEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "wide", __FILE__, __FUNCTION__, __LINE__, zs::log::Severity::Critical };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 40; }
+      constexpr static const auto paramNames() noexcept {
+        std::array<std::string_view, 40> results{};
+        results.fill("part");
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    // only ever logged through late(), which registers it long after startup
+    struct _AnonLateEntry {
+      static auto& info() {
+        static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "late", __FILE__, __FUNCTION__, __LINE__, zs::log::Severity::Critical };
+        return info;
+      }
+      constexpr static std::size_t totalParams() noexcept { return 1; }
+      constexpr static const auto paramNames() noexcept {
+        const std::array<std::string_view, 1> results{ { "value" } };
+        return results;
+      }
+    };
+
+    //-------------------------------------------------------------------------
+    static const zs::log::MetaDataLogEntry& late() noexcept
+    {
+      static zs::log::MetaDataLogEntryWithArgs<_AnonLateEntry, int> entry{ _AnonLateEntry::info(), _AnonLateEntry::paramNames() };
+      return entry;
+    }
+
+    //-------------------------------------------------------------------------
+    void reset()
+    {
+      values_.reset();
+      values_.emplace();
+    }
+
+    //-------------------------------------------------------------------------
+    void testRing() noexcept(false)
+    {
+      zs::log::Ring ring{ 256 };
+      TEST(256 == ring.capacity());
+
+      auto write{ [&](std::uint64_t entry) noexcept -> bool {
+        auto* record{ ring.reserve(64) };
+        if (!record)
+          return false;
+        auto& header{ *reinterpret_cast<zs::log::RecordHeader*>(record) };
+        header.size_ = 64;
+        header.kind_ = zs::log::RecordKind::Entry;
+        header.entry_ = entry;
+        ring.commit(64);
+        return true;
+      } };
+
+      TEST(write(1));
+      TEST(write(2));
+      TEST(write(3));
+      TEST(write(4));
+      TEST(!write(5));
+      TEST(1 == ring.dropped());
+      TEST(256 == ring.used());
+
+      ring.release(128);
+      TEST(write(6));
+      TEST(write(7));
+      TEST(!write(8));
+
+      // a record that cannot fit before the end of the buffer wraps after a padding record
+      ring.release(384);
+      TEST(write(9));
+      ring.release(448);
+      TEST(nullptr == ring.reserve(ring.maxRecordSize() + zs::log::recordAlignment()));
+      auto* record{ ring.reserve(96) };
+      TEST(nullptr != record);
+      ring.commit(96);
+      TEST(zs::log::RecordKind::Padding == ring.at(448).kind_);
+      TEST(64 == ring.at(448).size_);
+      TEST(512 + 96 == ring.head());
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testHugePages() noexcept(false)
+    {
+      // rounded up to a whole huge page, and on Linux always mapped
+      zs::log::Ring ring{ 4096, zs::log::RingPages::Huge };
+      TEST(zs::log::hugePageSize() == ring.capacity());
+      TEST(!ring.shared());
+#ifdef __linux__
+      TEST(zs::log::hugePageSize() == ring.memory().mapped());
+#endif //__linux__
+      auto* record{ ring.reserve(64) };
+      TEST(nullptr != record);
+      reinterpret_cast<zs::log::RecordHeader*>(record)->size_ = 64;
+      ring.commit(64);
+      TEST(64 == ring.at(0).size_);
+
+      zs::log::Ring plain{ 4096 };
+      TEST(4096 == plain.capacity());
+      TEST(0 == plain.memory().mapped());
+
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+      auto sink{ std::make_shared<CaptureSink>() };
+      drain.add(sink);
+
+      // only threads logging for the first time get huge rings
+      drain.ringPages(zs::log::RingPages::Huge);
+      zs::log::RingMemory memory;
+      std::string_view name{ "huge" };
+      std::thread{ [&]() noexcept {
+        zs::log::output(_AnonEntry{}, 1, name);
+        memory = zs::log::Drain::local().memory();
+      } }.join();
+      drain.ringPages(zs::log::RingPages::Normal);
+#ifdef __linux__
+      TEST(0 != memory.mapped());
+#endif //__linux__
+
+      // a drain thread pinned to the CPUs of the node it started on
+      const int node{ zs::log::Numa::node() };
+      TEST(node >= 0);
+      zs::log::Drain::Options options;
+      options.idle_ = std::chrono::microseconds{ 10 };
+      options.cpus_ = zs::log::Numa::cpus(node);
+      if (options.cpus_.empty())
+        options.cpus_.push_back(0);
+      drain.start(options);
+      drain.stop();
+      TEST(1 == std::count_if(sink->headers_.begin(), sink->headers_.end(), [](auto& header) noexcept { return zs::log::RecordKind::Entry == header.kind_; }));
+      drain.remove(sink);
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testDrain() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto sink{ std::make_shared<CaptureSink>() };
+      drain.add(sink);
+
+      std::string_view name{ "hello" };
+      zs::log::output(_AnonEntry{}, 42, name);
+      zs::log::output(_AnonEntry{}, 43, name);
+
+      // the schema is written as soon as the sink is added
+      TEST(1 == sink->writes_);
+      auto& metaData{ zs::log::logEntryMetaData<_AnonEntry, int, std::string_view&> };
+      auto found{ std::find_if(sink->schema_.begin(), sink->schema_.end(), [&](auto& entry) noexcept { return entry.id_ == metaData.id(); }) };
+      TEST(found != sink->schema_.end());
+      if (found != sink->schema_.end()) {
+        TEST("zs::log" == found->component_);
+        TEST("transport" == found->name_);
+        TEST(2 == found->types_.size());
+        TEST("value" == found->types_[0].paramName_);
+        TEST(found->types_[0].isIntegral_);
+        TEST(sizeof(int) == found->types_[0].elementWidth_);
+        TEST("name" == found->types_[1].paramName_);
+        TEST(found->types_[1].isArrayVariableSized());
+      }
+
+      TEST(drain.drainOnce(true));
+      TEST(2 == sink->writes_);
+      TEST(2 == sink->headers_.size());
+      TEST(metaData.id() == sink->headers_[0].entry_);
+      TEST(zs::log::RecordKind::Entry == sink->headers_[0].kind_);
+      TEST(sink->headers_[0].entry_ == sink->headers_[1].entry_);
+      TEST(sink->headers_[0].timestamp_ <= sink->headers_[1].timestamp_);
+      TEST(0 == (sink->headers_[0].size_ % zs::log::recordAlignment()));
+
+      int value{};
+      memcpy(&value, sink->bytes_.data() + sink->bytes_.size() - sink->headers_[0].size_ - sink->headers_[1].size_ + sizeof(zs::log::RecordHeader), sizeof(value));
+      TEST(42 == value);
+
+      TEST(!drain.drainOnce(true));
+      drain.remove(sink);
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testFanOut() noexcept(false)
+    {
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      struct SlowSink : public CaptureSink
+      {
+        std::vector<const std::byte*> spans_;
+
+        void write(const zs::log::Batch& batch) noexcept override
+        {
+          std::this_thread::sleep_for(std::chrono::milliseconds{ 50 });
+          for (auto& record : batch.records_) {
+            spans_.push_back(record.data());
+          }
+          CaptureSink::write(batch);
+        }
+      };
+
+      auto fast{ std::make_shared<CaptureSink>() };
+      auto slow{ std::make_shared<SlowSink>() };
+      auto slowOther{ std::make_shared<SlowSink>() };
+
+      zs::log::SinkOptions onlyOther;
+      onlyOther.filter_ = [](const zs::log::RecordHeader&, const zs::log::MetaDataLogEntry* site) noexcept { return site && ("other" == site->name()); };
+      zs::log::SinkOptions queued;
+      queued.queued_ = true;
+
+      drain.add(fast, onlyOther);
+      drain.add(slow, queued);
+      drain.add(slowOther, queued);
+
+      for (int i = 0; i < 10; ++i) {
+        std::string_view name{ "fan" };
+        zs::log::output(_AnonEntry{}, i, name);
+        zs::log::output(_AnonOtherEntry{}, i);
+      }
+
+      // the queued sinks are written behind the drain's back
+      const auto start{ std::chrono::steady_clock::now() };
+      TEST(drain.drainOnce(true));
+      TEST(std::chrono::steady_clock::now() - start < std::chrono::milliseconds{ 40 });
+      TEST(10 == fast->headers_.size());
+      auto& other{ zs::log::logEntryMetaData<_AnonOtherEntry, int&> };
+      TEST(std::all_of(fast->headers_.begin(), fast->headers_.end(), [&](auto& header) noexcept { return other.id() == header.entry_; }));
+
+      drain.flush();
+      TEST(20 == slow->headers_.size());
+      TEST(20 == slowOther->headers_.size());
+
+      // both queued sinks were handed the same copy of the batch, past the
+      // description each of them was written when it was added
+      TEST(slow->spans_.size() == slowOther->spans_.size());
+      TEST(std::equal(std::next(slow->spans_.begin()), slow->spans_.end(), std::next(slowOther->spans_.begin())));
+      TEST(slow->bytes_ == slowOther->bytes_);
+      TEST(0 == drain.lagDropped(slow));
+
+      drain.remove(fast);
+      drain.remove(slow);
+      drain.remove(slowOther);
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testPriority() noexcept(false)
+    {
+      using Critical = _AnonUrgentEntry<zs::log::Severity::Critical>;
+      using Fatal = _AnonUrgentEntry<zs::log::Severity::Fatal>;
+
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto sink{ std::make_shared<CaptureSink>() };
+      drain.add(sink);
+
+      for (int i = 0; i < 5; ++i) {
+        zs::log::output(_AnonOtherEntry{}, i);
+      }
+      int value{ 99 };
+      zs::log::output(Critical{}, value);
+
+      // the sink is not ready for the backlog but gets the critical entry,
+      // described in the same batch, right away
+      auto& critical{ zs::log::logEntryMetaData<Critical, int&> };
+      TEST(drain.drainOnce());
+      TEST(1 == sink->headers_.size());
+      TEST(critical.id() == sink->headers_[0].entry_);
+      auto found{ std::find_if(sink->schema_.begin(), sink->schema_.end(), [&](auto& entry) noexcept { return entry.id_ == critical.id(); }) };
+      TEST(found != sink->schema_.end());
+      if (found != sink->schema_.end())
+        TEST(zs::log::Severity::Critical == found->severity_);
+
+      TEST(drain.drainOnce(true));
+      TEST(6 == sink->headers_.size());
+
+      // an entry far larger than half the old urgent ring still gets through;
+      // a filtered sink that takes none of it is not written to
+      auto rejecting{ std::make_shared<CaptureSink>() };
+      zs::log::SinkOptions filtered;
+      filtered.filter_ = [](const zs::log::RecordHeader&, const zs::log::MetaDataLogEntry*) noexcept { return false; };
+      drain.add(rejecting, filtered);
+      const auto writes{ rejecting->writes_ };
+      const auto dropped{ drain.dropped() };
+      const std::string text(zs::log::maxLogStringLength(), 'x');
+      std::string_view part{ text };
+      [&]<std::size_t ...index>(std::index_sequence<index...>) noexcept {
+        zs::log::output(_AnonWideEntry{}, ((void)index, part)...);
+      }(std::make_index_sequence<_AnonWideEntry::totalParams()>{});
+      TEST(drain.drainOnce());
+      TEST(dropped == drain.dropped());
+      TEST(7 == sink->headers_.size());
+      TEST(sink->headers_.back().size_ > _AnonWideEntry::totalParams() * text.size());
+      TEST(writes == rejecting->writes_);
+      drain.remove(rejecting);
+
+      // a call site described along with an urgent record is not described
+      // again with the backlog
+      zs::log::LogEntry<int>{}(late(), 7);
+      TEST(drain.drainOnce());
+      drain.drainOnce(true);
+      TEST(8 == sink->headers_.size());
+      TEST(1 == std::count_if(sink->schema_.begin(), sink->schema_.end(), [](auto& entry) noexcept { return entry.id_ == late().id(); }));
+      drain.remove(sink);
+
+      // a fatal entry waits until its queued sink has written it, but not for
+      // the backlog queued ahead of it
+      struct SlowSink : public zs::log::Sink
+      {
+        std::mutex mutex_;
+        std::vector<std::uint64_t> entries_;
+
+        void write(const zs::log::Batch& batch) noexcept override
+        {
+          std::this_thread::sleep_for(std::chrono::milliseconds{ 50 });
+          std::lock_guard lock{ mutex_ };
+          for (auto& record : batch.records_) {
+            entries_.push_back(reinterpret_cast<const zs::log::RecordHeader*>(record.data())->entry_);
+          }
+        }
+
+        std::vector<std::uint64_t> entries() noexcept
+        {
+          std::lock_guard lock{ mutex_ };
+          return entries_;
+        }
+      };
+
+      auto slow{ std::make_shared<SlowSink>() };
+      zs::log::SinkOptions queued;
+      queued.queued_ = true;
+      drain.add(slow, queued);
+      drain.flush();
+
+      auto& other{ zs::log::logEntryMetaData<_AnonOtherEntry, int&> };
+      for (int i = 0; i < 4; ++i) {
+        zs::log::output(_AnonOtherEntry{}, i);
+        TEST(drain.drainOnce(true));
+      }
+      zs::log::output(Fatal{}, value);
+
+      auto& fatal{ zs::log::logEntryMetaData<Fatal, int&> };
+      auto entries{ slow->entries() };
+      TEST(std::find(entries.begin(), entries.end(), fatal.id()) != entries.end());
+      TEST(std::count(entries.begin(), entries.end(), other.id()) < 4);
+
+      drain.flush();
+      entries = slow->entries();
+      TEST(4 == std::count(entries.begin(), entries.end(), other.id()));
+      drain.remove(slow);
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testRetention() noexcept(false)
+    {
+      using Warning = _AnonUrgentEntry<zs::log::Severity::Warning>;
+
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      zs::log::RetentionSink::Options options;
+      options.key_ = "request";
+      auto capture{ std::make_shared<CaptureSink>() };
+      auto sink{ std::make_shared<zs::log::RetentionSink>(capture, options) };
+      drain.add(sink);
+      options.maxHeldBytes_ = 0;
+      auto tightCapture{ std::make_shared<CaptureSink>() };
+      auto tight{ std::make_shared<zs::log::RetentionSink>(tightCapture, options) };
+      drain.add(tight);
+
+      auto& info{ zs::log::logEntryMetaData<_AnonEntry, int, std::string_view&> };
+      auto& warning{ zs::log::logEntryMetaData<Warning, int> };
+      std::string_view name{ "retained" };
+      auto entries{ [&](const CaptureSink& captured) noexcept {
+        std::vector<std::uint64_t> result;
+        for (auto& header : captured.headers_) {
+          if (zs::log::RecordKind::Entry == header.kind_)
+            result.push_back(header.entry_);
+        }
+        return result;
+      } };
+
+      // a request that succeeds is held until it ends and then dropped
+      {
+        auto request{ zs::log::LogContext::scope("request", "a") };
+        zs::log::output(_AnonEntry{}, 1, name);
+        zs::log::output(_AnonEntry{}, 2, name);
+        drain.drainOnce(true);
+        TEST(entries(*capture).empty());
+        TEST(0 != sink->held());
+        TEST(2 == tight->evicted());
+        TEST(0 == tight->held());
+      }
+      drain.drainOnce(true);
+      TEST(2 == sink->discarded());
+      TEST(0 == sink->held());
+
+      // one that fails is written in full, its nested contexts included
+      {
+        auto request{ zs::log::LogContext::scope("request", "b") };
+        zs::log::output(_AnonEntry{}, 3, name);
+        {
+          auto step{ zs::log::LogContext::scope("step", "parse") };
+          zs::log::output(_AnonEntry{}, 4, name);
+          zs::log::output(Warning{}, 5);
+        }
+        zs::log::output(_AnonEntry{}, 6, name);
+      }
+      zs::log::output(_AnonEntry{}, 7, name);
+      drain.drainOnce(true);
+
+      const std::vector<std::uint64_t> expected{ info.id(), info.id(), warning.id(), info.id(), info.id() };
+      TEST(expected == entries(*capture));
+      TEST(2 == sink->released());
+      TEST(0 == sink->held());
+      auto contexts{ std::count_if(capture->headers_.begin(), capture->headers_.end(), [](auto& header) noexcept {
+        return (zs::log::RecordKind::Context == header.kind_) && (0 == (header.flags_ & zs::log::recordFlagEnded()));
+      }) };
+      TEST(3 == contexts);
+      auto ends{ std::count_if(capture->headers_.begin(), capture->headers_.end(), [](auto& header) noexcept {
+        return (zs::log::RecordKind::Context == header.kind_) && (0 != (header.flags_ & zs::log::recordFlagEnded()));
+      }) };
+      TEST(1 == ends);
+
+      // the decoder sees the held entries with their fields
+      zs::log::RecordDecoder decoder;
+      std::vector<std::string> requests;
+      decoder.decode(capture->bytes_, [&](const zs::log::RecordDecoder::Record& record) noexcept {
+        if ((record.context_) && (!record.context_->empty()))
+          requests.push_back(record.context_->front().value_);
+      });
+      TEST((std::vector<std::string>{ "b", "b", "b", "b" }) == requests);
+      TEST(0 == decoder.corrupt());
+
+      // what is logged into a context after its window was evicted goes the
+      // same way, bar what is severe enough to pass on anyway
+      const auto evicted{ tight->evicted() };
+      const auto passed{ entries(*tightCapture) };
+      {
+        auto request{ zs::log::LogContext::scope("request", "c") };
+        zs::log::output(_AnonEntry{}, 8, name);
+        drain.drainOnce(true);
+        TEST(evicted + 1 == tight->evicted());
+        zs::log::output(_AnonEntry{}, 9, name);
+        drain.drainOnce(true);
+        TEST(evicted + 2 == tight->evicted());
+        TEST(passed == entries(*tightCapture));
+        zs::log::output(Warning{}, 10);
+        drain.drainOnce(true);
+        TEST(passed.size() + 1 == entries(*tightCapture).size());
+        TEST(warning.id() == entries(*tightCapture).back());
+      }
+      const auto headers{ tightCapture->headers_.size() };
+      drain.drainOnce(true);
+      TEST(headers == tightCapture->headers_.size());
+      TEST(0 == tight->held());
+
+      drain.remove(sink);
+      drain.remove(tight);
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testWritevSink() noexcept(false)
+    {
+#ifndef _WIN32
+      int fds[2]{};
+      TEST(0 == ::pipe(fds));
+
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto capture{ std::make_shared<CaptureSink>() };
+      zs::log::WritevSink::Options options;
+      options.maxLatency_ = std::chrono::hours{ 1 };
+      options.batchBytes_ = 1024 * 1024;
+      options.closeOnDestroy_ = true;
+      auto sink{ std::make_shared<zs::log::WritevSink>(fds[1], options) };
+      drain.add(capture);
+      drain.add(sink);
+
+      std::string_view name{ "writev" };
+      for (int i = 0; i < 100; ++i) {
+        zs::log::output(_AnonEntry{}, i, name);
+      }
+
+      // neither the size nor the latency cap has been reached yet
+      const auto syscalls{ sink->syscalls() };
+      TEST(!drain.drainOnce());
+      TEST(syscalls == sink->syscalls());
+
+      TEST(drain.drainOnce(true));
+      TEST(syscalls + 1 == sink->syscalls());
+      TEST(0 == sink->errors());
+
+      std::vector<std::byte> bytes(capture->bytes_.size());
+      size_type total{};
+      while (total < bytes.size()) {
+        auto result{ ::read(fds[0], bytes.data() + total, bytes.size() - total) };
+        if (result <= 0)
+          break;
+        total += static_cast<size_type>(result);
+      }
+      TEST(total == capture->bytes_.size());
+      TEST(bytes == capture->bytes_);
+
+      drain.remove(capture);
+      drain.remove(sink);
+      sink.reset();
+      ::close(fds[0]);
+
+      // a pipe nobody reads holds the write up for writeTimeout_ only
+      TEST(0 == ::pipe(fds));
+      TEST(0 == ::fcntl(fds[1], F_SETFL, ::fcntl(fds[1], F_GETFL) | O_NONBLOCK));
+      options.writeTimeout_ = std::chrono::milliseconds{ 20 };
+      auto stalled{ std::make_shared<zs::log::WritevSink>(fds[1], options) };
+
+      std::vector<std::byte> big(4 * 1024 * 1024);
+      zs::log::Batch batch;
+      batch.add(zs::log::Batch::record_type{ big.data(), big.size() }, false);
+      const auto start{ std::chrono::steady_clock::now() };
+      stalled->write(batch);
+      TEST(std::chrono::steady_clock::now() - start < std::chrono::seconds{ 10 });
+      TEST(0 != stalled->dropped());
+      TEST(stalled->dropped() < big.size());
+      stalled.reset();
+      ::close(fds[0]);
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testFileSinks() noexcept(false)
+    {
+#ifndef _WIN32
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      auto readFile{ [](const char* path) noexcept(false) {
+        std::ifstream file{ path, std::ios::binary };
+        std::vector<char> chars{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+        std::vector<std::byte> result(chars.size());
+        memcpy(result.data(), chars.data(), chars.size());
+        return result;
+      } };
+
+      auto check{ [&](std::shared_ptr<zs::log::Sink> sink, const char* path) noexcept(false) {
+        auto capture{ std::make_shared<CaptureSink>() };
+        drain.add(capture);
+        drain.add(sink);
+
+        std::string_view name{ "file sink" };
+        for (int pass = 0; pass < 10; ++pass) {
+          for (int i = 0; i < 1000; ++i) {
+            zs::log::output(_AnonEntry{}, i, name);
+          }
+          drain.drainOnce(true);
+        }
+        drain.flush();
+        drain.remove(capture);
+        drain.remove(sink);
+        sink.reset();
+
+        TEST(readFile(path) == capture->bytes_);
+        std::remove(path);
+      } };
+
+      const char* pwritePath{ "zs_test_log_pwrite.bin" };
+      {
+        const int fd{ ::open(pwritePath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+        TEST(fd >= 0);
+        zs::log::PwriteSink::Options options;
+        options.closeOnDestroy_ = true;
+        options.sync_ = true;
+        check(std::make_shared<zs::log::PwriteSink>(fd, options), pwritePath);
+      }
+
+      const char* openPath{ "zs_test_log_open.bin" };
+      {
+        zs::log::FileSinkOptions options;
+        options.sync_ = true;
+        auto sink{ zs::log::openFileSink(openPath, options) };
+        TEST(!!sink);
+        check(std::move(sink), openPath);
+      }
+
+#ifdef ZS_LOG_HAS_IO_URING
+      const char* uringPath{ "zs_test_log_uring.bin" };
+      {
+        const int fd{ ::open(uringPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+        TEST(fd >= 0);
+        zs::log::UringSink::Options options;
+        options.closeOnDestroy_ = true;
+        options.sync_ = true;
+        options.segments_ = 3;
+        options.segmentSize_ = 16 * 1024;
+        auto sink{ zs::log::UringSink::create(fd, options) };
+        if (sink) {
+          check(std::move(sink), uringPath);
+        }
+        else {
+          // io_uring is unavailable here, the fallback path is covered above
+          ::close(fd);
+          std::remove(uringPath);
+        }
+      }
+#endif //ZS_LOG_HAS_IO_URING
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testTextSink() noexcept(false)
+    {
+#ifndef _WIN32
+      struct _AnonTextEntry {
+        static auto& info() {
+          static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "text", __FILE__, __FUNCTION__, __LINE__, zs::log::Severity::Warning };
+          return info;
+        }
+        constexpr static std::size_t totalParams() noexcept { return 5; }
+        constexpr static const auto paramNames() noexcept {
+          const std::array<std::string_view, 5> results{ { "low", "high", "price", "ratio", "side" } };
+          return results;
+        }
+      };
+
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      const char* path{ "zs_test_log_text.txt" };
+      const int fd{ ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+      TEST(fd >= 0);
+      zs::log::TextSink::Options options;
+      options.closeOnDestroy_ = true;
+      options.bufferSize_ = 4096;
+      auto sink{ std::make_shared<zs::log::TextSink>(fd, options) };
+      drain.add(sink);
+
+      const auto before{ std::time(nullptr) };
+      std::string_view side{ "buy" };
+      zs::log::output(_AnonTextEntry{}, std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::uint64_t>::max(), 0.1, 1.0f / 3.0f, side);
+      for (int i = 0; i < 1000; ++i) {
+        zs::log::output(_AnonOtherEntry{}, i * 1001);
+      }
+      drain.flush();
+      const auto after{ std::time(nullptr) };
+      TEST(1001 == sink->lines());
+      drain.remove(sink);
+      sink.reset();
+
+      std::ifstream file{ path };
+      std::vector<std::string> lines;
+      for (std::string line; std::getline(file, line);) {
+        lines.push_back(line);
+      }
+      TEST(1001 == lines.size());
+      if (1001 == lines.size()) {
+        // the date is UTC and ends in nanoseconds
+        const std::string& first{ lines[0] };
+        TEST('.' == first[19]);
+        TEST(' ' == first[29]);
+        bool dated{};
+        for (auto second{ before }; second <= after; ++second) {
+          char text[32]{};
+          std::tm utc{};
+          ::gmtime_r(&second, &utc);
+          std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &utc);
+          dated = dated || (0 == first.compare(0, 19, text));
+        }
+        TEST(dated);
+
+        const std::string site{ " warning zs::log text " __FILE__ ":" + std::to_string(_AnonTextEntry::info().line_) };
+        TEST(first.substr(29) == site + " low=-9223372036854775808 high=18446744073709551615 price=0.1 ratio=0.33333334 side=\"buy\"");
+        TEST(lines[1].substr(29) == " info zs::log other " __FILE__ ":" + std::to_string(_AnonOtherEntry::info().line_) + " value=0");
+        TEST(lines[1000].substr(lines[1000].size() - 13) == " value=999999");
+      }
+      std::remove(path);
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void testFormat() noexcept(false)
+    {
+      constexpr std::array<std::string_view, 2> names{ { "qty", "px" } };
+      static_assert(zs::log::MessageFormat::check("filled {qty} @ {px}", names));
+      static_assert(zs::log::MessageFormat::check("{px} {{{qty}}}", names));
+      static_assert(!zs::log::MessageFormat::check("filled {qty}", names));
+      static_assert(!zs::log::MessageFormat::check("filled {qty} @ {price}", names));
+      static_assert(!zs::log::MessageFormat::check("filled {qty} @ {px", names));
+      static_assert(!zs::log::MessageFormat::check("filled {qty} } {px}", names));
+      static_assert(!zs::log::MessageFormat::check("filled {qty} @ {qty}", names));
+
+      struct _AnonFillEntry {
+        static auto& info() {
+          static zs::log::MetaDataLogEntryInfo info{ &zs::log::component, "fill", __FILE__, __FUNCTION__, __LINE__ };
+          return info;
+        }
+        constexpr static std::size_t totalParams() noexcept { return 3; }
+        constexpr static const auto paramNames() noexcept {
+          const std::array<std::string_view, 3> results{ { "qty", "px", "venue" } };
+          return results;
+        }
+        constexpr static std::string_view format() noexcept { return "{venue}: filled {qty} @ {{{px}}}"; }
+      };
+
+      std::string_view venue{ "xnas" };
+      auto& metaData{ zs::log::logEntryMetaData<_AnonFillEntry, int, double, std::string_view&> };
+      TEST(metaData.format() == _AnonFillEntry::format());
+      TEST((zs::log::logEntryMetaData<_AnonOtherEntry, int>.format().empty()));
+
+      // the format travels with the schema
+      std::vector<std::byte> schema;
+      zs::log::SchemaWriter::encode(schema, &metaData, metaData.next());
+      std::vector<zs::log::SchemaEntry> entries;
+      TEST(zs::log::SchemaReader::decode(gsl::span<const std::byte>{ schema }.subspan(sizeof(zs::log::RecordHeader)), entries));
+      TEST(1 == entries.size());
+      if (1 == entries.size())
+        TEST(entries[0].format_ == _AnonFillEntry::format());
+
+#ifndef _WIN32
+      auto& drain{ zs::log::Drain::singleton() };
+      drain.drainOnce(true);
+
+      const char* path{ "zs_test_log_format.txt" };
+      const int fd{ ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) };
+      TEST(fd >= 0);
+      zs::log::TextSink::Options options;
+      options.closeOnDestroy_ = true;
+      auto sink{ std::make_shared<zs::log::TextSink>(fd, options) };
+      drain.add(sink);
+
+      zs::log::output(_AnonFillEntry{}, 100, 12.5, venue);
+      drain.flush();
+      drain.remove(sink);
+      sink.reset();
+
+      std::ifstream file{ path };
+      std::string line;
+      TEST(static_cast<bool>(std::getline(file, line)));
+      TEST(line.substr(29) == " info zs::log fill " __FILE__ ":" + std::to_string(_AnonFillEntry::info().line_) + " xnas: filled 100 @ {12.5}");
+      std::remove(path);
+#endif //_WIN32
+
+      output(__FILE__ "::" __FUNCTION__);
+    }
+
+    //-------------------------------------------------------------------------
+    void runAll() noexcept(false)
+    {
+      auto runner{ [&](auto&& func) noexcept(false) { reset(); func(); } };
+
+      runner([&]() { testRing(); });
+      runner([&]() { testHugePages(); });
+      runner([&]() { testDrain(); });
+      runner([&]() { testFanOut(); });
+      runner([&]() { testPriority(); });
+      runner([&]() { testRetention(); });
+      runner([&]() { testWritevSink(); });
+      runner([&]() { testFileSinks(); });
+      runner([&]() { testTextSink(); });
+      runner([&]() { testFormat(); });
+    }
+  };
+
+  //---------------------------------------------------------------------------
+  void testLogTransport() noexcept(false)
+  {
+    LogTransportBasics{}.runAll();
+  }
+
+}
@@ -4,6 +4,22 @@
 #include "AutoScope.h"
 #include "enum.h"
 #include "log.h"
+#include "LogBacktrace.h"
+#include "LogChecksum.h"
+#include "LogContext.h"
+#include "LogFileSink.h"
+#include "LogFormat.h"
+#include "LogMetrics.h"
+#include "LogReader.h"
+#include "LogRepeat.h"
+#include "LogRetention.h"
+#include "LogSchema.h"
+#include "LogSequence.h"
+#include "LogSharedMemory.h"
+#include "LogSocketSink.h"
+#include "LogTextSink.h"
+#include "LogTransport.h"
+#include "LogUringSink.h"
 #include "MoveSharedPtr.h"
 #include "reflect.h"
 #include "traits.h"